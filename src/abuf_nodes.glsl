@@ -0,0 +1,65 @@
+// Node layout of the linked list A-buffer, inserted into every shader which
+// accesses the nodes (COMPACT_NODES is defined by the loader to select the
+// 8 byte layout).  Defines NODE (the type of a node) and functions to build
+// and take apart nodes; colors are premultiplied and packed as by
+// packUnorm4x8(), and a next index of 0 ends the list (see
+// draw_abuf0_frag.glsl).
+
+#ifdef COMPACT_NODES
+
+// x: depth (16 bit) and color (RGB 5:6:5), y: next index (24 bit) and alpha
+#define NODE uvec2
+
+NODE make_node(vec4 color, float depth, uint next)
+{
+    uvec4 c = uvec4(round(clamp(color, 0.0, 1.0) * vec4(31.0, 63.0, 31.0, 255.0)));
+    uint d = uint(round(clamp(depth, 0.0, 1.0) * 65535.0));
+
+    return uvec2((d << 16) | (c.r << 11) | (c.g << 5) | c.b,
+                 (next << 8) | c.a);
+}
+
+uint node_color(NODE n)
+{
+    return packUnorm4x8(vec4(float((n.x >> 11) & 0x1fu) / 31.0,
+                             float((n.x >> 5) & 0x3fu) / 63.0,
+                             float(n.x & 0x1fu) / 31.0,
+                             float(n.y & 0xffu) / 255.0));
+}
+
+float node_depth(NODE n)
+{
+    return float(n.x >> 16) / 65535.0;
+}
+
+uint node_next(NODE n)
+{
+    return n.y >> 8;
+}
+
+#else
+
+// x: color, y: depth, z: unused, w: next index
+#define NODE uvec4
+
+NODE make_node(vec4 color, float depth, uint next)
+{
+    return uvec4(packUnorm4x8(color), floatBitsToUint(depth), 0u, next);
+}
+
+uint node_color(NODE n)
+{
+    return n.x;
+}
+
+float node_depth(NODE n)
+{
+    return uintBitsToFloat(n.y);
+}
+
+uint node_next(NODE n)
+{
+    return n.w;
+}
+
+#endif
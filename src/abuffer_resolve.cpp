@@ -0,0 +1,150 @@
+#include <cstddef>
+#include <string>
+
+#include <dake/gl/gl.hpp>
+
+#include "abuffer_resolve.hpp"
+#include "compute.hpp"
+#include "gpu_timer.hpp"
+
+
+const unsigned ABufferResolve::BIN_BOUNDS[BINS] = {4, 8, 16, 32, 64};
+
+
+ABufferResolve *ABufferResolve::create(int width, int height,
+                                       const std::string &defines)
+{
+    std::string bounds;
+    for (int i = 0; i < BINS; i++) {
+        bounds += (i ? ", " : "") + std::to_string(BIN_BOUNDS[i]) + "u";
+    }
+
+    ComputeProgram *classify = ComputeProgram::load_async("classify_abuf_comp.glsl",
+        "#define BINS " + std::to_string(BINS) + "\n"
+        "#define BIN_BOUNDS uint[](" + bounds + ")\n" + defines);
+
+    ComputeProgram *resolve[BINS];
+    bool ok = classify;
+    for (int i = 0; i < BINS; i++) {
+        resolve[i] = ComputeProgram::load_async("resolve_abuf_comp.glsl",
+            "#define K " + std::to_string(BIN_BOUNDS[i]) + "\n" + defines);
+        ok = ok && resolve[i];
+    }
+
+    if (!ok) {
+        delete classify;
+        for (ComputeProgram *prg: resolve) {
+            delete prg;
+        }
+        return nullptr;
+    }
+
+    return new ABufferResolve(classify, resolve, width, height);
+}
+
+
+ABufferResolve::ABufferResolve(ComputeProgram *classify,
+                               ComputeProgram **resolve,
+                               int width, int height):
+    classify_prg(classify),
+    tiles_x((width + TILE_SIZE - 1) / TILE_SIZE),
+    tiles_y((height + TILE_SIZE - 1) / TILE_SIZE)
+{
+    for (int i = 0; i < BINS; i++) {
+        resolve_prgs[i] = resolve[i];
+    }
+
+    glGenBuffers(1, &tile_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, tile_buffer);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, BINS * tiles_x * tiles_y * 4,
+                    nullptr, 0);
+
+    glGenBuffers(1, &dispatch_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, dispatch_buffer);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, BINS * 3 * 4, nullptr,
+                    GL_DYNAMIC_STORAGE_BIT);
+}
+
+
+size_t ABufferResolve::size_bytes(int width, int height)
+{
+    size_t tiles = static_cast<size_t>((width + TILE_SIZE - 1) / TILE_SIZE)
+                 * ((height + TILE_SIZE - 1) / TILE_SIZE);
+    return BINS * tiles * 4 + BINS * 3 * 4;
+}
+
+
+bool ABufferResolve::ready(void) const
+{
+    bool r = classify_prg->ready();
+    for (ComputeProgram *prg: resolve_prgs) {
+        r = r && prg->ready();
+    }
+    return r;
+}
+
+
+bool ABufferResolve::finish(void)
+{
+    bool ok = classify_prg->finish();
+    for (ComputeProgram *prg: resolve_prgs) {
+        ok = prg->finish() && ok;
+    }
+    return ok;
+}
+
+
+ABufferResolve::~ABufferResolve(void)
+{
+    glDeleteBuffers(1, &tile_buffer);
+    glDeleteBuffers(1, &dispatch_buffer);
+
+    delete classify_prg;
+    for (ComputeProgram *prg: resolve_prgs) {
+        delete prg;
+    }
+}
+
+
+void ABufferResolve::run(GLint accum_tmu, GLint transp_tmu)
+{
+    GPUScope pass("classify");
+
+    // No tiles in any bin (and the y and z dimensions are always 1)
+    GLuint reset[BINS * 3];
+    for (int i = 0; i < BINS; i++) {
+        reset[i * 3 + 0] = 0;
+        reset[i * 3 + 1] = 1;
+        reset[i * 3 + 2] = 1;
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, dispatch_buffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(reset), reset);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, tile_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, dispatch_buffer);
+
+    GLuint bin_tiles = tiles_x * tiles_y;
+
+    classify_prg->use();
+    classify_prg->uniform("accum", accum_tmu);
+    classify_prg->uniform("transp", transp_tmu);
+    classify_prg->uniform("bin_tiles", bin_tiles);
+    glDispatchCompute(tiles_x, tiles_y, 1);
+
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+    pass.next("sort");
+
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, dispatch_buffer);
+
+    for (int i = 0; i < BINS; i++) {
+        resolve_prgs[i]->use();
+        resolve_prgs[i]->uniform("accum", accum_tmu);
+        resolve_prgs[i]->uniform("transp", transp_tmu);
+        resolve_prgs[i]->uniform("tile_offset", i * bin_tiles);
+        glDispatchComputeIndirect(i * 3 * 4);
+    }
+
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+}
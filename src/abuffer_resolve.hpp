@@ -0,0 +1,61 @@
+#ifndef ABUFFER_RESOLVE_HPP
+#define ABUFFER_RESOLVE_HPP
+
+#include <cstddef>
+#include <string>
+
+#include <dake/gl/gl.hpp>
+
+#include "compute.hpp"
+
+
+// Resolves the linked list A-buffer with compute shaders.  A classification
+// pass first sorts the 8x8 screen tiles into bins by the length of their
+// longest list; every bin is then resolved by a variant of
+// resolve_abuf_comp.glsl built for that bound (using an indirect dispatch),
+// so only the tiles which need it pay for a large bound.  Tiles without any
+// fragments are resolved by the classification pass already.
+//
+// Expects the head image on image binding 0, the result image on image
+// binding 1 and the nodes on shader storage buffer binding 0; uses the shader
+// storage buffer bindings 1 and 2.
+class ABufferResolve {
+    public:
+        static const int TILE_SIZE = 8;
+        static const int BINS = 5;
+        // Maximum list length of every bin; longer lists in the last bin are
+        // truncated (blending the rest into the tail)
+        static const unsigned BIN_BOUNDS[BINS];
+
+        // Returns nullptr if the shaders cannot be read; they are built in
+        // the background (see ComputeProgram::load_async()), and finish()
+        // has to succeed before run() can be used.  @defines is inserted
+        // into every shader (it has to define the node layout, see
+        // abuf_nodes.glsl).
+        static ABufferResolve *create(int width, int height,
+                                      const std::string &defines);
+        ~ABufferResolve(void);
+
+        // Whether finish() would not block
+        bool ready(void) const;
+        // Returns false if the shaders could not be built
+        bool finish(void);
+
+        // @accum_tmu and @transp_tmu are the texture units of the tail
+        void run(GLint accum_tmu, GLint transp_tmu);
+
+        // GPU memory held by the tile lists and dispatch parameters
+        static size_t size_bytes(int width, int height);
+
+    private:
+        ABufferResolve(ComputeProgram *classify, ComputeProgram **resolve,
+                       int width, int height);
+
+        ComputeProgram *classify_prg, *resolve_prgs[BINS];
+        int tiles_x, tiles_y;
+        // Tile lists of all bins (each with room for all tiles) and the
+        // indirect dispatch parameters of all bins
+        GLuint tile_buffer, dispatch_buffer;
+};
+
+#endif
@@ -0,0 +1,85 @@
+#version 330 core
+#extension GL_ARB_compute_shader: require
+#extension GL_ARB_shader_image_load_store: require
+#extension GL_ARB_shader_storage_buffer_object: require
+#extension GL_ARB_shading_language_420pack: require
+#extension GL_ARB_shading_language_packing: require
+
+
+// Sorts the 8x8 tiles of the linked list A-buffer into bins by the length of
+// their longest list (BINS and BIN_BOUNDS are defined by the loader), for
+// resolve_abuf_comp.glsl.  Tiles without any fragments only need their tail,
+// so they are resolved right here.
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (r32ui, binding = 0) uniform readonly uimage2D head;
+layout (rgba8, binding = 1) uniform writeonly image2D result;
+uniform sampler2D accum, transp;
+
+// NODE is defined by the loader (see abuf_nodes.glsl)
+layout (std430, binding = 0) buffer node_buffer {
+    NODE nodes[];
+};
+
+// Bin b's tiles start at b * bin_tiles
+layout (std430, binding = 1) buffer tile_buffer {
+    uint tiles[];
+};
+
+// Indirect dispatch parameters (x, y, z) of every bin
+layout (std430, binding = 2) buffer dispatch_buffer {
+    uint dispatch[];
+};
+
+uniform uint bin_tiles;
+
+
+#ifndef EPSILON
+#define EPSILON 0.0001
+#endif
+
+
+shared uint max_count;
+
+
+void main(void)
+{
+    ivec2 pix = ivec2(gl_GlobalInvocationID.xy);
+    bool inside = all(lessThan(pix, textureSize(accum, 0)));
+
+    if (gl_LocalInvocationIndex == 0u) {
+        max_count = 0u;
+    }
+    barrier();
+
+    uint n = 0u;
+    if (inside) {
+        for (uint ei = imageLoad(head, pix).r; ei != 0u; ei = node_next(nodes[ei - 1u])) {
+            n++;
+        }
+    }
+
+    atomicMax(max_count, n);
+    barrier();
+
+    if (max_count == 0u) {
+        if (inside) {
+            vec4 tail_acc = texelFetch(accum, pix, 0);
+            float tail_transp = texelFetch(transp, pix, 0).r;
+
+            imageStore(result, pix,
+                       vec4(tail_acc.rgb / max(EPSILON, tail_acc.a), 1.0)
+                       * (1.0 - tail_transp));
+        }
+    } else if (gl_LocalInvocationIndex == 0u) {
+        const uint bounds[BINS] = BIN_BOUNDS;
+
+        uint bin = 0u;
+        while (bin < uint(BINS - 1) && max_count > bounds[bin]) {
+            bin++;
+        }
+
+        uint i = atomicAdd(dispatch[bin * 3u], 1u);
+        tiles[bin * bin_tiles + i] = gl_WorkGroupID.x | (gl_WorkGroupID.y << 16);
+    }
+}
@@ -0,0 +1,146 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <dake/gl/gl.hpp>
+
+#include "compute.hpp"
+#include "program_cache.hpp"
+#include "shader_source.hpp"
+
+
+bool ComputeProgram::parallel_compile;
+
+
+ComputeProgram *ComputeProgram::load(const char *fname,
+                                     const std::string &defines)
+{
+    ComputeProgram *prg = load_async(fname, defines);
+    if (prg && !prg->finish()) {
+        delete prg;
+        return nullptr;
+    }
+    return prg;
+}
+
+
+ComputeProgram *ComputeProgram::load_async(const char *fname,
+                                           const std::string &defines)
+{
+    std::string src;
+    if (!load_shader_source(fname, defines, src)) {
+        return nullptr;
+    }
+
+    GLuint prg = glCreateProgram();
+    if (program_cache && program_cache->load(src, prg)) {
+        return new ComputeProgram(prg, 0, fname, src);
+    }
+
+    GLuint sh = glCreateShader(GL_COMPUTE_SHADER);
+    const char *src_ptr = src.c_str();
+    glShaderSource(sh, 1, &src_ptr, nullptr);
+    glCompileShader(sh);
+
+    // Link right away, so the driver can do both in the background; the
+    // compile status is only checked in finish()
+    glAttachShader(prg, sh);
+    if (program_cache) {
+        program_cache->prepare(prg);
+    }
+    glLinkProgram(prg);
+
+    return new ComputeProgram(prg, sh, fname, src);
+}
+
+
+ComputeProgram::ComputeProgram(GLuint i, GLuint s, const char *fname,
+                               const std::string &src):
+    id(i),
+    sh(s),
+    pending(s != 0),
+    name(fname),
+    source(src)
+{
+}
+
+
+bool ComputeProgram::ready(void) const
+{
+    if (!pending || !parallel_compile) {
+        return true;
+    }
+
+    GLint done;
+    glGetProgramiv(id, GL_COMPLETION_STATUS_KHR, &done);
+    return done;
+}
+
+
+bool ComputeProgram::finish(void)
+{
+    if (!pending) {
+        return !failed;
+    }
+    pending = false;
+
+    GLint status, log_len;
+    glGetShaderiv(sh, GL_COMPILE_STATUS, &status);
+    if (!status) {
+        glGetShaderiv(sh, GL_INFO_LOG_LENGTH, &log_len);
+        std::vector<char> log(log_len + 1);
+        glGetShaderInfoLog(sh, log_len + 1, nullptr, log.data());
+        fprintf(stderr, "%s: Failed to compile:\n%s\n", name.c_str(),
+                log.data());
+        failed = true;
+        return false;
+    }
+
+    glGetProgramiv(id, GL_LINK_STATUS, &status);
+    if (!status) {
+        glGetProgramiv(id, GL_INFO_LOG_LENGTH, &log_len);
+        std::vector<char> log(log_len + 1);
+        glGetProgramInfoLog(id, log_len + 1, nullptr, log.data());
+        fprintf(stderr, "%s: Failed to link:\n%s\n", name.c_str(),
+                log.data());
+        failed = true;
+        return false;
+    }
+
+    glDeleteShader(sh);
+    sh = 0;
+
+    if (program_cache) {
+        program_cache->store(source, id);
+    }
+    source.clear();
+
+    return true;
+}
+
+
+ComputeProgram::~ComputeProgram(void)
+{
+    if (sh) {
+        glDeleteShader(sh);
+    }
+    glDeleteProgram(id);
+}
+
+
+void ComputeProgram::use(void)
+{
+    glUseProgram(id);
+}
+
+
+void ComputeProgram::uniform(const char *name, GLuint value)
+{
+    glProgramUniform1ui(id, glGetUniformLocation(id, name), value);
+}
+
+
+void ComputeProgram::uniform(const char *name, GLint value)
+{
+    glProgramUniform1i(id, glGetUniformLocation(id, name), value);
+}
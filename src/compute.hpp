@@ -0,0 +1,53 @@
+#ifndef COMPUTE_HPP
+#define COMPUTE_HPP
+
+#include <string>
+
+#include <dake/gl/gl.hpp>
+
+
+// A compute shader program; built directly instead of through dake::gl,
+// which does not support compute shaders
+class ComputeProgram {
+    public:
+        // Set if GL_KHR_parallel_shader_compile is available (and enabled),
+        // so load_async() really does not block
+        static bool parallel_compile;
+
+        // Returns nullptr (after printing the log) if compiling or linking
+        // fails.  @defines is inserted after the #version and #extension
+        // lines.
+        static ComputeProgram *load(const char *fname,
+                                    const std::string &defines = "");
+        // Like load(), but only starts compiling and linking; returns
+        // nullptr only if the file cannot be read.  finish() has to be
+        // called before the program is used.
+        static ComputeProgram *load_async(const char *fname,
+                                          const std::string &defines = "");
+        ~ComputeProgram(void);
+
+        // Whether finish() would not block
+        bool ready(void) const;
+        // Waits for the program to be built; returns false (after printing
+        // the log) if that failed
+        bool finish(void);
+
+        void use(void);
+
+        void uniform(const char *name, GLuint value);
+        void uniform(const char *name, GLint value);
+
+        GLuint glid(void) const { return id; }
+
+    private:
+        ComputeProgram(GLuint id, GLuint shader, const char *fname,
+                       const std::string &source);
+
+        GLuint id;
+        // Until finish() has been called (0 if loaded from the cache)
+        GLuint sh;
+        bool pending, failed = false;
+        std::string name, source;
+};
+
+#endif
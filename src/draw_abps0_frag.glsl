@@ -0,0 +1,21 @@
+#version 330 core
+#extension GL_ARB_shader_storage_buffer_object: require
+#extension GL_ARB_shading_language_420pack: require
+
+
+out vec4 out_col;
+
+uniform int width;
+
+layout (std430, binding = 1) buffer count_buffer {
+    uint counts[];
+};
+
+
+void main(void)
+{
+    ivec2 pix = ivec2(gl_FragCoord.xy);
+    atomicAdd(counts[pix.y * width + pix.x], 1u);
+
+    out_col = vec4(0.0);
+}
@@ -0,0 +1,42 @@
+#version 330 core
+#extension GL_ARB_shader_storage_buffer_object: require
+#extension GL_ARB_shading_language_420pack: require
+#extension GL_ARB_shading_language_packing: require
+
+
+in vec3 vf_col;
+
+out vec4 out_col;
+out float out_transp;
+
+uniform float alpha;
+uniform int width, node_count;
+
+// x: color, y: depth; every pixel's fragments are stored contiguously
+layout (std430, binding = 0) buffer node_buffer {
+    uvec2 nodes[];
+};
+
+// Exclusive prefix sum over the fragment counts, i.e. the index of every
+// pixel's first node; incremented for every node written
+layout (std430, binding = 2) buffer offset_buffer {
+    uint offsets[];
+};
+
+
+void main(void)
+{
+    ivec2 pix = ivec2(gl_FragCoord.xy);
+    uint i = atomicAdd(offsets[pix.y * width + pix.x], 1u);
+    vec4 col = vec4(vf_col, 1.0) * alpha;
+
+    if (i < uint(node_count)) {
+        nodes[i] = uvec2(packUnorm4x8(col), floatBitsToUint(gl_FragCoord.z));
+        discard;
+    }
+
+    // The pool is full, so this fragment goes into the tail (see
+    // draw_abuf0_frag.glsl)
+    out_col = col;
+    out_transp = 1.0 - alpha;
+}
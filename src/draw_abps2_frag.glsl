@@ -0,0 +1,91 @@
+#version 330 core
+#extension GL_ARB_shader_storage_buffer_object: require
+#extension GL_ARB_shading_language_420pack: require
+#extension GL_ARB_shading_language_packing: require
+
+
+out vec4 out_col;
+
+uniform sampler2D accum, transp;
+uniform int width, node_count;
+
+layout (std430, binding = 0) buffer node_buffer {
+    uvec2 nodes[];
+};
+
+layout (std430, binding = 1) buffer count_buffer {
+    uint counts[];
+};
+
+// Index of every pixel's last node + 1
+layout (std430, binding = 2) buffer offset_buffer {
+    uint offsets[];
+};
+
+
+#ifndef K
+#define K 32
+#endif
+
+#ifndef EPSILON
+#define EPSILON 0.0001
+#endif
+
+
+void main(void)
+{
+    ivec2 pix = ivec2(gl_FragCoord.xy);
+    uint end = offsets[pix.y * width + pix.x];
+    uint start = end - counts[pix.y * width + pix.x];
+    end = min(end, uint(node_count));
+
+    // See draw_abuf1_frag.glsl
+    vec4 tail_acc = texelFetch(accum, pix, 0);
+    float tail_transp = texelFetch(transp, pix, 0).r;
+
+    if (start >= end && tail_acc.a == 0.0) {
+        discard;
+    }
+
+    // Sorted back to front
+    int n = 0;
+    uvec2 fragments[K];
+    for (uint i = start; i < end; i++) {
+        uvec2 f = nodes[i];
+
+        if (n == K) {
+            uvec2 evict = f;
+            if (f.y < fragments[0].y) {
+                evict = fragments[0];
+                for (int j = 1; j < K; j++) {
+                    fragments[j - 1] = fragments[j];
+                }
+                n--;
+            }
+
+            vec4 fc = unpackUnorm4x8(evict.x);
+            tail_acc += fc;
+            tail_transp *= 1.0 - fc.a;
+
+            if (n == K) {
+                continue;
+            }
+        }
+
+        int j;
+        for (j = n; j > 0 && fragments[j - 1].y < f.y; j--) {
+            fragments[j] = fragments[j - 1];
+        }
+        fragments[j] = f;
+        n++;
+    }
+
+    vec4 color = vec4(tail_acc.rgb / max(EPSILON, tail_acc.a), 1.0)
+               * (1.0 - tail_transp);
+    for (int i = 0; i < n; i++) {
+        vec4 fc = unpackUnorm4x8(fragments[i].x);
+        color = fc + (1.0 - fc.a) * color;
+    }
+
+    out_col = color;
+}
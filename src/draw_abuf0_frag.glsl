@@ -1,34 +1,40 @@
 #version 330 core
 #extension GL_ARB_shader_image_load_store: require
 #extension GL_ARB_shader_atomic_counters: require
+#extension GL_ARB_shader_storage_buffer_object: require
 #extension GL_ARB_shading_language_packing: require
 
 
 in vec3 vf_col;
 
 out vec4 out_col;
+out float out_transp;
 
 layout (r32ui) uniform coherent uimage2D head;
-layout (rgba32ui) uniform uimage2D list;
 uniform float alpha;
+uniform int node_count;
 layout (offset = 0, binding = 0) uniform atomic_uint counter;
 
-
-#define LW 2048
-#define LH 2048
+// The nodes (see abuf_nodes.glsl, which the loader inserts) are linked by the
+// index of the next node + 1 (0 ends the list)
+layout (std430) buffer node_buffer {
+    NODE nodes[];
+};
 
 
 void main(void)
 {
-    uint i = atomicCounterIncrement(counter) + 1;
-
-    if (i < LW * LH) {
-        uint prev = imageAtomicExchange(head, ivec2(gl_FragCoord.xy), i);
-        imageStore(list, ivec2(i % LW, i / LW),
-                   uvec4(packUnorm4x8(vec4(vf_col, 1.0) * alpha),
-                         floatBitsToUint(gl_FragCoord.z),
-                         0, prev));
+    uint i = atomicCounterIncrement(counter);
+    vec4 col = vec4(vf_col, 1.0) * alpha;
+
+    if (i < uint(node_count)) {
+        uint prev = imageAtomicExchange(head, ivec2(gl_FragCoord.xy), i + 1u);
+        nodes[i] = make_node(col, gl_FragCoord.z, prev);
+        discard;
     }
 
-    out_col = vec4(0.0);
+    // The pool is full, so this fragment goes into the tail, which is
+    // accumulated like in draw_bamc0_frag.glsl
+    out_col = col;
+    out_transp = 1.0 - alpha;
 }
@@ -1,46 +1,80 @@
 #version 330 core
 #extension GL_ARB_shader_image_load_store: require
+#extension GL_ARB_shader_storage_buffer_object: require
 #extension GL_ARB_shading_language_packing: require
 
 
 out vec4 out_col;
 
 layout (r32ui) uniform uimage2D head;
-layout (rgba32ui) uniform uimage2D list;
+uniform sampler2D accum, transp;
 
+// NODE is defined by the loader (see abuf_nodes.glsl)
+layout (std430) buffer node_buffer {
+    NODE nodes[];
+};
 
-#define LW 2048
-#define LH 2048
 
+#ifndef K
 #define K 32
+#endif
+
+#ifndef EPSILON
+#define EPSILON 0.0001
+#endif
 
 
 void main(void)
 {
+    // The tail contains all fragments which did not fit into the pool and
+    // all which are not among the K front-most ones; it is blended as in
+    // draw_bamc1_frag.glsl and assumed to be behind all of the latter
+    vec4 tail_acc = texelFetch(accum, ivec2(gl_FragCoord.xy), 0);
+    float tail_transp = texelFetch(transp, ivec2(gl_FragCoord.xy), 0).r;
+
     uint ei = imageLoad(head, ivec2(gl_FragCoord.xy)).r;
 
-    if (ei == 0) {
+    if (ei == 0u && tail_acc.a == 0.0) {
         discard;
     }
 
+    // Sorted back to front
     int n = 0;
     uvec2 fragments[K];
-    while (ei != 0 && n < K) {
-        uvec4 element = imageLoad(list, ivec2(ei % LW, ei / LW));
-        fragments[n++] = element.xy;
-        ei = element.w;
-    }
+    while (ei != 0u) {
+        NODE element = nodes[ei - 1u];
+        uvec2 f = uvec2(node_color(element), floatBitsToUint(node_depth(element)));
+        ei = node_next(element);
+
+        if (n == K) {
+            uvec2 evict = f;
+            if (f.y < fragments[0].y) {
+                evict = fragments[0];
+                for (int j = 1; j < K; j++) {
+                    fragments[j - 1] = fragments[j];
+                }
+                n--;
+            }
+
+            vec4 fc = unpackUnorm4x8(evict.x);
+            tail_acc += fc;
+            tail_transp *= 1.0 - fc.a;
+
+            if (n == K) {
+                continue;
+            }
+        }
 
-    for (int i = 1; i < n; i++) {
-        uvec2 f = fragments[i];
         int j;
-        for (j = i; j > 0 && fragments[j - 1].y < f.y; j--) {
+        for (j = n; j > 0 && fragments[j - 1].y < f.y; j--) {
             fragments[j] = fragments[j - 1];
         }
         fragments[j] = f;
+        n++;
     }
 
-    vec4 color = vec4(0.0);
+    vec4 color = vec4(tail_acc.rgb / max(EPSILON, tail_acc.a), 1.0)
+               * (1.0 - tail_transp);
     for (int i = 0; i < n; i++) {
         vec4 fc = unpackUnorm4x8(fragments[i].x);
         color = fc + (1.0 - fc.a) * color;
@@ -1,35 +1,40 @@
 #version 330 core
 #extension GL_ARB_shader_image_load_store: require
+#extension GL_ARB_shader_storage_buffer_object: require
 #extension GL_ARB_shading_language_packing: require
 
 
 out vec4 out_col;
 
 layout (r32ui) uniform uimage2D head;
-layout (rgba32ui) uniform uimage2D list;
 uniform int layer;
 
+// NODE is defined by the loader (see abuf_nodes.glsl)
+layout (std430) buffer node_buffer {
+    NODE nodes[];
+};
 
-#define LW 2048
-#define LH 2048
 
+#ifndef K
 #define K 32
+#endif
 
 
 void main(void)
 {
     uint ei = imageLoad(head, ivec2(gl_FragCoord.xy)).r;
 
-    if (ei == 0) {
+    if (ei == 0u) {
         discard;
     }
 
     int n = 0;
     uvec2 fragments[K];
-    while (ei != 0 && n < K) {
-        uvec4 element = imageLoad(list, ivec2(ei % LW, ei / LW));
-        fragments[n++] = element.xy;
-        ei = element.w;
+    while (ei != 0u && n < K) {
+        NODE element = nodes[ei - 1u];
+        fragments[n++] = uvec2(node_color(element),
+                               floatBitsToUint(node_depth(element)));
+        ei = node_next(element);
     }
 
     if (layer >= n) {
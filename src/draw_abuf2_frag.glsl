@@ -0,0 +1,12 @@
+#version 150 core
+
+
+out vec4 out_col;
+
+uniform sampler2D result;
+
+
+void main(void)
+{
+    out_col = texelFetch(result, ivec2(gl_FragCoord.xy), 0);
+}
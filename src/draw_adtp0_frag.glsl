@@ -2,24 +2,80 @@
 #extension GL_ARB_shader_image_load_store: require
 
 
+// NODES (the number of nodes of the visibility function), LAYERS (NODES / 4,
+// rounded up), ALPHA_FORMAT and DEPTH_FORMAT are defined by the loader
+// (and TEMPORAL for the variant which composites with the previous frame's
+// visibility function while building the current one)
+
 out vec4 out_col;
 
-layout (rgba8_snorm) uniform coherent image2D alpha_tex;
-layout (rgba16_snorm) uniform coherent image2D depth_tex;
+layout (ALPHA_FORMAT) uniform coherent image2DArray alpha_tex;
+layout (DEPTH_FORMAT) uniform coherent image2DArray depth_tex;
 layout (r32ui) uniform coherent uimage2D lock_tex;
 uniform float alpha;
 
 
+#ifdef TEMPORAL
+in vec3 vf_col;
+in vec4 vf_prev_pos;
+
+out float out_transp;
+
+uniform sampler2DArray prev_alpha_tex, prev_depth_tex;
+
+
+// Resolution of the depth images
+#ifndef EPSILON
+#define EPSILON (1.0 / 65536.0)
+#endif
+
+
+float prev_visibility(void)
+{
+    vec3 pos = (vf_prev_pos.xyz / vf_prev_pos.w) / 2.0 + vec3(0.5);
+    ivec2 size = textureSize(prev_alpha_tex, 0).xy;
+    ivec2 coord = ivec2(pos.xy * vec2(size));
+
+    // Not on screen in the previous frame, so nothing is known about it
+    if (any(lessThan(coord, ivec2(0))) || any(greaterThanEqual(coord, size))) {
+        return 1.0;
+    }
+
+    float visibility = 1.0;
+    for (int l = 0; l < LAYERS; l++) {
+        vec4 av = texelFetch(prev_alpha_tex, ivec3(coord, l), 0);
+        vec4 dv = texelFetch(prev_depth_tex, ivec3(coord, l), 0);
+
+        for (int c = 0; c < 4 && l * 4 + c < NODES; c++) {
+            if (dv[c] >= pos.z - EPSILON) {
+                break;
+            }
+            visibility = av[c];
+        }
+    }
+
+    return visibility;
+}
+#endif
+
+
 void do_it(void)
 {
-    vec4 av, dv;
-    av = imageLoad(alpha_tex, ivec2(gl_FragCoord.xy));
-    dv = imageLoad(depth_tex, ivec2(gl_FragCoord.xy));
+    // Four nodes share a texel
+    float av[LAYERS * 4], dv[LAYERS * 4];
+    for (int l = 0; l < LAYERS; l++) {
+        vec4 a = imageLoad(alpha_tex, ivec3(gl_FragCoord.xy, l));
+        vec4 d = imageLoad(depth_tex, ivec3(gl_FragCoord.xy, l));
+        for (int c = 0; c < 4; c++) {
+            av[l * 4 + c] = a[c];
+            dv[l * 4 + c] = d[c];
+        }
+    }
 
-    float al[5], dl[5];
+    float al[NODES + 1], dl[NODES + 1];
     int i = 0, o, ii = -1;
-    for (o = 0; o < 5; o++) {
-        if (dv[i] > gl_FragCoord.z && ii < 0) {
+    for (o = 0; o < NODES + 1; o++) {
+        if (ii < 0 && (i == NODES || dv[i] > gl_FragCoord.z)) {
             ii = o;
             if (o == 0) {
                 al[o] = 1.0 - alpha;
@@ -40,7 +96,7 @@ void do_it(void)
 
     float smallest_w = 2.0;
     int smallest_w_i = 0;
-    for (i = 0; i < 4; i++) {
+    for (i = 0; i < NODES; i++) {
         float w = (al[i] - al[i + 1]) * (dl[i + 1] - dl[i]);
         if (w < smallest_w) {
             smallest_w = w;
@@ -49,18 +105,20 @@ void do_it(void)
     }
 
     al[smallest_w_i] = al[smallest_w_i + 1];
-    for (i = smallest_w_i + 1; i < 4; i++) {
+    for (i = smallest_w_i + 1; i < NODES; i++) {
         al[i] = al[i + 1];
         dl[i] = dl[i + 1];
     }
 
-    for (i = 0; i < 4; i++) {
-        av[i] = al[i];
-        dv[i] = dl[i];
+    for (int l = 0; l < LAYERS; l++) {
+        vec4 a, d;
+        for (int c = 0; c < 4; c++) {
+            a[c] = al[min(l * 4 + c, NODES)];
+            d[c] = dl[min(l * 4 + c, NODES)];
+        }
+        imageStore(alpha_tex, ivec3(gl_FragCoord.xy, l), a);
+        imageStore(depth_tex, ivec3(gl_FragCoord.xy, l), d);
     }
-
-    imageStore(alpha_tex, ivec2(gl_FragCoord.xy), av);
-    imageStore(depth_tex, ivec2(gl_FragCoord.xy), dv);
 }
 
 
@@ -75,5 +133,11 @@ void main(void)
         }
     }
 
+#ifdef TEMPORAL
+    // Accumulated like in blend_bamc()
+    out_col = vec4(vf_col, 1.0) * alpha * prev_visibility();
+    out_transp = 1.0 - alpha;
+#else
     out_col = vec4(0.0, 0.0, 0.0, alpha);
+#endif
 }
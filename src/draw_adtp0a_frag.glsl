@@ -0,0 +1,37 @@
+#version 330 core
+#extension GL_ARB_shader_image_load_store: require
+
+
+// Lock-free alternative to draw_adtp0_frag.glsl: Instead of merging every
+// fragment into the visibility function under a lock, only keeps the NODES
+// (defined by the loader) front-most fragments (packed as depth and alpha, so
+// they sort by depth) with an atomic insertion sort.  draw_adtp2_frag.glsl
+// then turns them into the visibility function.  Fragments behind those do
+// not contribute to it (they still darken the background, though).
+
+out vec4 out_col;
+
+layout (r32ui) uniform coherent uimage2DArray keys;
+uniform float alpha;
+
+
+uint my_pack(vec2 v)
+{
+    return uint(round(clamp(v.x, 0.0, 1.0) * 255.0))
+         | (uint(round(clamp(v.y, 0.0, 1.0) * 16777215.0)) << 8);
+}
+
+
+void main(void)
+{
+    uint cur_val = my_pack(vec2(alpha, gl_FragCoord.z));
+    for (int i = 0; i < NODES; i++) {
+        uint tex_val = imageAtomicMin(keys, ivec3(gl_FragCoord.xy, i), cur_val);
+        if (tex_val == 0xffffffffu) {
+            break;
+        }
+        cur_val = max(cur_val, tex_val);
+    }
+
+    out_col = vec4(0.0, 0.0, 0.0, alpha);
+}
@@ -1,28 +1,35 @@
 #version 150 core
 
 
+// NODES and LAYERS are defined by the loader (see draw_adtp0_frag.glsl)
+
 in vec3 vf_col;
 
 out vec4 out_col;
 
-uniform sampler2D alpha_tex, depth_tex;
+uniform sampler2DArray alpha_tex, depth_tex;
 uniform float alpha;
 
 
 // Resolution of depth_tex
+#ifndef EPSILON
 #define EPSILON (1.0 / 65536.0)
+#endif
 
 
 void main(void)
 {
-    vec4 av, dv;
-
-    av = texelFetch(alpha_tex, ivec2(gl_FragCoord.xy), 0);
-    dv = texelFetch(depth_tex, ivec2(gl_FragCoord.xy), 0);
-
     float visibility = 1.0;
-    for (int i = 0; i < 4 && dv[i] < gl_FragCoord.z - EPSILON; i++) {
-        visibility = av[i];
+    for (int l = 0; l < LAYERS; l++) {
+        vec4 av = texelFetch(alpha_tex, ivec3(gl_FragCoord.xy, l), 0);
+        vec4 dv = texelFetch(depth_tex, ivec3(gl_FragCoord.xy, l), 0);
+
+        for (int c = 0; c < 4 && l * 4 + c < NODES; c++) {
+            if (dv[c] >= gl_FragCoord.z - EPSILON) {
+                break;
+            }
+            visibility = av[c];
+        }
     }
 
     out_col = vec4(vf_col, visibility * alpha);
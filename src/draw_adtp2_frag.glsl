@@ -0,0 +1,40 @@
+#version 330 core
+#extension GL_ARB_shader_image_load_store: require
+
+
+// Builds the visibility function read by draw_adtp1_frag.glsl from the
+// fragments sorted by draw_adtp0a_frag.glsl (NODES, LAYERS, ALPHA_FORMAT and
+// DEPTH_FORMAT are defined by the loader)
+
+layout (r32ui) uniform readonly uimage2DArray keys;
+layout (ALPHA_FORMAT) uniform writeonly image2DArray alpha_tex;
+layout (DEPTH_FORMAT) uniform writeonly image2DArray depth_tex;
+
+
+vec2 my_unpack(uint x)
+{
+    return vec2(float(x & 0xffu) / 255.0,
+                float(x >> 8u) / 16777215.0);
+}
+
+
+void main(void)
+{
+    float vis = 1.0;
+    for (int l = 0; l < LAYERS; l++) {
+        vec4 av = vec4(vis), dv = vec4(1.0);
+
+        for (int c = 0; c < 4 && l * 4 + c < NODES; c++) {
+            uint key = imageLoad(keys, ivec3(gl_FragCoord.xy, l * 4 + c)).r;
+            if (key != 0xffffffffu) {
+                vec2 ad = my_unpack(key);
+                vis *= 1.0 - ad.x;
+                dv[c] = ad.y;
+            }
+            av[c] = vis;
+        }
+
+        imageStore(alpha_tex, ivec3(gl_FragCoord.xy, l), av);
+        imageStore(depth_tex, ivec3(gl_FragCoord.xy, l), dv);
+    }
+}
@@ -1,10 +1,31 @@
 #version 330 core
 
 
+// LAYERS is defined by the loader (see draw_baab0_frag.glsl), and PACKED if
+// the colors are part of the keys in abuffer (see draw_baab3_frag.glsl)
+
 out vec4 out_col;
 
+#ifdef PACKED
+uniform usampler2DArray abuffer;
+#else
 uniform sampler2DArray colors;
-uniform sampler2D accum;
+#endif
+uniform sampler2D accum, transp;
+
+
+#ifndef EPSILON
+#define EPSILON 0.0001
+#endif
+
+
+#ifdef PACKED
+vec4 unpack_color(uint key)
+{
+    vec4 col = vec4(uvec4(key >> 15, key >> 10, key >> 5, key) & 0x1fu) / 31.0;
+    return vec4(col.rgb * col.a, col.a);
+}
+#endif
 
 
 void main(void)
@@ -12,14 +33,23 @@ void main(void)
     vec3 color = vec3(0.0);
     float vis = 1.0;
 
-    for (int i = 0; i < 4; i++) {
+    for (int i = 0; i < LAYERS; i++) {
+#ifdef PACKED
+        uint key = texelFetch(abuffer, ivec3(gl_FragCoord.xy, i), 0).r;
+        vec4 entry = key == 0xffffffffu ? vec4(0.0) : unpack_color(key);
+#else
         vec4 entry = texelFetch(colors, ivec3(gl_FragCoord.xy, i), 0);
+#endif
         color += vis * entry.rgb;
         vis *= 1.0 - entry.a;
     }
 
+    // The tail is blended under the layers: Its average color covers what
+    // they leave visible of everything that is not visible in the end
     vec4 tail = texelFetch(accum, ivec2(gl_FragCoord.xy), 0);
-    color += vis * tail.rgb / max(0.001, tail.a);
+    float transp_tex = texelFetch(transp, ivec2(gl_FragCoord.xy), 0).r;
+    color += tail.rgb / max(EPSILON, tail.a) * max(vis - transp_tex, 0.0);
 
-    out_col = vec4(color, 1.0);
+    // Premultiplied
+    out_col = vec4(color, transp_tex);
 }
@@ -0,0 +1,49 @@
+#version 330 core
+#extension GL_ARB_shader_image_load_store: require
+
+
+// LAYERS is defined by the loader (see draw_baab0_frag.glsl)
+
+in vec3 vf_col;
+
+out vec4 out_col;
+out float out_transp;
+
+// Every key holds the depth (12 bit) above the color (RGBA, 5 bit each), so
+// sorting the keys sorts the fragments and their colors come along for free
+layout (r32ui) uniform coherent uimage2DArray abuffer;
+uniform float alpha;
+
+
+uint pack_key(void)
+{
+    uvec4 col = uvec4(round(clamp(vec4(vf_col, alpha), 0.0, 1.0) * 31.0));
+    uint depth = uint(clamp(gl_FragCoord.z, 0.0, 1.0) * 4095.0);
+
+    return (depth << 20) | (col.r << 15) | (col.g << 10) | (col.b << 5) | col.a;
+}
+
+
+void main(void)
+{
+    uint cur_val = pack_key();
+    for (int i = 0; i < LAYERS; i++) {
+        uint tex_val = imageAtomicMin(abuffer, ivec3(gl_FragCoord.xy, i), cur_val);
+        if (tex_val == 0xffffffffu) {
+            cur_val = tex_val;
+            break;
+        }
+        cur_val = max(cur_val, tex_val);
+    }
+
+    // Whatever falls out of the last layer is part of the tail, accumulated
+    // like in blend_bamc()
+    if (cur_val != 0xffffffffu) {
+        vec4 col = vec4(uvec4(cur_val >> 15, cur_val >> 10, cur_val >> 5, cur_val) & 0x1fu) / 31.0;
+        out_col = vec4(col.rgb, 1.0) * col.a;
+    } else {
+        out_col = vec4(0.0);
+    }
+
+    out_transp = 1.0 - alpha;
+}
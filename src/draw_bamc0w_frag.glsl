@@ -9,9 +9,21 @@ out float out_transp;
 uniform float alpha;
 
 
+// w(z) = alpha * max(WEIGHT_MIN, WEIGHT_SCALE * (1 - z)^WEIGHT_EXPONENT)
+#ifndef WEIGHT_SCALE
+#define WEIGHT_SCALE 3000.0
+#endif
+#ifndef WEIGHT_EXPONENT
+#define WEIGHT_EXPONENT 3.0
+#endif
+#ifndef WEIGHT_MIN
+#define WEIGHT_MIN 0.01
+#endif
+
+
 float weight(float depth, float alpha)
 {
-    return alpha * max(0.01, 3000.0 * pow(1.0 - depth, 3.0));
+    return alpha * max(WEIGHT_MIN, WEIGHT_SCALE * pow(1.0 - depth, WEIGHT_EXPONENT));
 }
 
 
@@ -6,7 +6,9 @@ out vec4 out_col;
 uniform sampler2D accum, count;
 
 
+#ifndef EPSILON
 #define EPSILON 0.0001
+#endif
 
 
 void main(void)
@@ -0,0 +1,13 @@
+#version 150 core
+
+
+out vec4 out_col;
+
+uniform sampler2D layer;
+
+
+void main(void)
+{
+    // Premultiplied, to be blended over the destination
+    out_col = texelFetch(layer, ivec2(gl_FragCoord.xy), 0);
+}
@@ -0,0 +1,17 @@
+#version 150 core
+
+
+out vec4 out_col;
+
+uniform sampler2D fb, depth;
+
+
+// See carry_undrawn()
+void main(void)
+{
+    if (texelFetch(depth, ivec2(gl_FragCoord.xy), 0).r == 0.0) {
+        discard;
+    }
+
+    out_col = texelFetch(fb, ivec2(gl_FragCoord.xy), 0);
+}
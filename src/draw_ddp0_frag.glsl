@@ -0,0 +1,14 @@
+#version 150 core
+
+
+out vec2 out_depth;
+out vec4 out_front, out_back;
+
+
+// Initializes the depth range for dual depth peeling (blended with GL_MAX)
+void main(void)
+{
+    out_depth = vec2(-gl_FragCoord.z, gl_FragCoord.z);
+    out_front = vec4(0.0);
+    out_back = vec4(0.0);
+}
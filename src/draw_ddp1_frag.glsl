@@ -0,0 +1,44 @@
+#version 150 core
+
+
+in vec3 vf_col;
+
+out vec2 out_depth;
+out vec4 out_front, out_back;
+
+// (-nearest, farthest) depth of the fragments not yet peeled
+uniform sampler2D depth;
+uniform float alpha;
+
+
+// Dual depth peeling: Peels the nearest and the farthest remaining layer at
+// once.  All outputs are blended with GL_MAX; fragments between those layers
+// only extend the depth range of the next pass.
+void main(void)
+{
+    vec2 range = texelFetch(depth, ivec2(gl_FragCoord.xy), 0).rg;
+    float nearest = -range.x, farthest = range.y;
+    float z = gl_FragCoord.z;
+
+    if (z < nearest || z > farthest) {
+        // Already peeled (discarding these lets an occlusion query tell
+        // whether anything was left)
+        discard;
+    }
+
+    out_depth = vec2(-1.0);
+    out_front = vec4(0.0);
+    out_back = vec4(0.0);
+
+    if (z > nearest && z < farthest) {
+        out_depth = vec2(-z, z);
+        return;
+    }
+
+    vec4 col = vec4(vf_col, 1.0) * alpha;
+    if (z == nearest) {
+        out_front = col;
+    } else {
+        out_back = col;
+    }
+}
@@ -4,18 +4,36 @@
 in vec3 vf_col;
 
 out vec4 out_col;
+out float out_depth;
 
-uniform sampler2D fb, depth;
+// Depth of the layer peeled in the previous pass, which is composited in this
+// one; 1.0 where there is nothing left
+uniform sampler2D depth;
 uniform float alpha;
+uniform bool composite;
 
 
+// Front to back depth peeling: Every pass composites the previous pass's
+// layer under the accumulated color (out_col) and peels the next layer, i.e.
+// finds its depth (out_depth, blended with GL_MIN).
 void main(void)
 {
-    if (texelFetch(depth, ivec2(gl_FragCoord.xy), 0).r <= gl_FragCoord.z) {
+    float z = gl_FragCoord.z;
+    float layer = texelFetch(depth, ivec2(gl_FragCoord.xy), 0).r;
+
+    if (z < layer) {
+        // Already composited
         discard;
     }
 
-    out_col = mix(texelFetch(fb, ivec2(gl_FragCoord.xy), 0),
-                  vec4(vf_col, 1.0),
-                  alpha);
+    out_col = vec4(0.0);
+    out_depth = 1.0;
+
+    if (z == layer) {
+        if (composite) {
+            out_col = vec4(vf_col, 1.0) * alpha;
+        }
+    } else {
+        out_depth = z;
+    }
 }
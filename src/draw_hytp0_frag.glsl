@@ -8,6 +8,12 @@ layout (r32ui) uniform coherent uimage2DArray abuffer;
 uniform float alpha;
 
 
+// Core fragments per pixel
+#ifndef LAYERS
+#define LAYERS 4
+#endif
+
+
 uint my_pack(vec2 v)
 {
     return uint(round(clamp(v.x, 0.0, 1.0) * 255.0))
@@ -28,7 +34,7 @@ void main(void)
     float tail_alpha = 1.0;
 
     uint cur_val = da;
-    for (int i = 0; i < 4; i++) {
+    for (int i = 0; i < LAYERS; i++) {
         // Yes, this works.
         uint tex_val = imageAtomicMin(abuffer, ivec3(gl_FragCoord.xy, i), cur_val);
         if (tex_val >= 0xffff0000u) {
@@ -8,6 +8,12 @@ layout (r32ui) uniform uimage2DArray abuffer;
 uniform sampler2D visibility;
 
 
+// Core fragments per pixel
+#ifndef LAYERS
+#define LAYERS 4
+#endif
+
+
 uint my_pack(vec2 v)
 {
     return uint(round(clamp(v.x, 0.0, 1.0) * 255.0))
@@ -24,7 +30,7 @@ vec2 my_unpack(uint x)
 void main(void)
 {
     float vis = 1.0;
-    for (int i = 0; i < 4; i++) {
+    for (int i = 0; i < LAYERS; i++) {
         vec2 da = my_unpack(imageLoad(abuffer, ivec3(gl_FragCoord.xy, i)).r);
         vis *= 1.0 - da.x;
         imageStore(abuffer, ivec3(gl_FragCoord.xy, i), uvec4(my_pack(vec2(vis, da.y))));
@@ -10,9 +10,17 @@ uniform sampler2D alpha_accum;
 uniform float alpha;
 
 
+// Core fragments per pixel
+#ifndef LAYERS
+#define LAYERS 4
+#endif
+
+
 // FIXME: Why isn't this 1.0 / 16777215.0?
 // (Because the actual depth complexity is that low?)
+#ifndef EPSILON
 #define EPSILON (100.0 / 16777215.0)
+#endif
 
 
 uint my_pack(vec2 v)
@@ -30,27 +38,27 @@ vec2 my_unpack(uint x)
 
 void main(void)
 {
-    vec2 da[4];
+    vec2 da[LAYERS];
     float trans;
-    da[0] = my_unpack(texelFetch(abuffer, ivec3(gl_FragCoord.xy, 0), 0).r);
-    da[1] = my_unpack(texelFetch(abuffer, ivec3(gl_FragCoord.xy, 1), 0).r);
-    da[2] = my_unpack(texelFetch(abuffer, ivec3(gl_FragCoord.xy, 2), 0).r);
-    da[3] = my_unpack(texelFetch(abuffer, ivec3(gl_FragCoord.xy, 3), 0).r);
+    for (int i = 0; i < LAYERS; i++) {
+        da[i] = my_unpack(texelFetch(abuffer, ivec3(gl_FragCoord.xy, i), 0).r);
+    }
 
     float comp_z_l = gl_FragCoord.z - EPSILON;
     float comp_z_g = gl_FragCoord.z + EPSILON;
 
-    if (comp_z_l > da[3].y) {
-        trans = da[3].x * alpha
+    if (comp_z_l > da[LAYERS - 1].y) {
+        trans = da[LAYERS - 1].x * alpha
               / max(alpha, texelFetch(alpha_accum, ivec2(gl_FragCoord.xy), 0).r);
-    } else if (comp_z_g < da[1].y) {
-        trans = da[0].x;
-    } else if (comp_z_g < da[2].y) {
-        trans = da[1].x;
-    } else if (comp_z_g < da[3].y) {
-        trans = da[2].x;
     } else {
-        trans = da[3].x;
+        // Visibility in front of the first core fragment behind this one
+        trans = da[LAYERS - 1].x;
+        for (int i = 1; i < LAYERS; i++) {
+            if (comp_z_g < da[i].y) {
+                trans = da[i - 1].x;
+                break;
+            }
+        }
     }
 
     out_col = vec4(vf_col, trans);
@@ -0,0 +1,75 @@
+#version 330 core
+#extension GL_ARB_shader_image_load_store: require
+
+
+in vec3 vf_col;
+
+out vec4 out_col;
+out float out_transp;
+
+// Keys (alpha and depth, like in draw_hytp0_frag.glsl) and colors of the core
+// fragments, sorted front to back
+layout (r32ui) uniform coherent uimage2DArray abuffer;
+layout (rgba8) uniform coherent image2DArray colors;
+layout (r32ui) uniform coherent uimage2D lock_tex;
+uniform float alpha;
+
+
+// Core fragments per pixel
+#ifndef LAYERS
+#define LAYERS 4
+#endif
+
+
+uint my_pack(vec2 v)
+{
+    return uint(round(clamp(v.x, 0.0, 1.0) * 255.0))
+         | (uint(round(clamp(v.y, 0.0, 1.0) * 16777215.0)) << 8);
+}
+
+vec2 my_unpack(uint x)
+{
+    return vec2(float(x & 0xffu) / 255.0,
+                float(x >> 8) / 16777215.0);
+}
+
+
+// Inserts this fragment into the core and returns the (premultiplied) color
+// of the fragment that falls out of it, which belongs to the tail
+vec4 do_it(void)
+{
+    uint cur_key = my_pack(vec2(alpha, gl_FragCoord.z));
+    vec4 cur_col = vec4(vf_col, 1.0) * alpha;
+
+    for (int i = 0; i < LAYERS; i++) {
+        uint key = imageLoad(abuffer, ivec3(gl_FragCoord.xy, i)).r;
+        if (cur_key < key) {
+            vec4 col = imageLoad(colors, ivec3(gl_FragCoord.xy, i));
+            imageStore(abuffer, ivec3(gl_FragCoord.xy, i), uvec4(cur_key));
+            imageStore(colors, ivec3(gl_FragCoord.xy, i), cur_col);
+            cur_key = key;
+            cur_col = col;
+        }
+    }
+
+    // Empty entries have an alpha (and color) of 0
+    return cur_col;
+}
+
+
+void main(void)
+{
+    vec4 tail_col;
+    for (;;) {
+        if (imageAtomicExchange(lock_tex, ivec2(gl_FragCoord.xy), 1u) == 0u) {
+            tail_col = do_it();
+            memoryBarrier();
+            imageAtomicExchange(lock_tex, ivec2(gl_FragCoord.xy), 0u);
+            break;
+        }
+    }
+
+    // Accumulated like in blend_bamc()
+    out_col = tail_col;
+    out_transp = 1.0 - alpha;
+}
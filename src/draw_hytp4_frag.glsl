@@ -0,0 +1,49 @@
+#version 330 core
+
+
+out vec4 out_col;
+
+uniform usampler2DArray abuffer;
+uniform sampler2DArray colors;
+uniform sampler2D accum, transp;
+
+
+// Core fragments per pixel
+#ifndef LAYERS
+#define LAYERS 4
+#endif
+
+
+#ifndef EPSILON
+#define EPSILON 0.0001
+#endif
+
+
+vec2 my_unpack(uint x)
+{
+    return vec2(float(x & 0xffu) / 255.0,
+                float(x >> 8) / 16777215.0);
+}
+
+
+void main(void)
+{
+    // Core: Front to back
+    vec3 col = vec3(0.0);
+    float vis = 1.0;
+    for (int i = 0; i < LAYERS; i++) {
+        float a = my_unpack(texelFetch(abuffer, ivec3(gl_FragCoord.xy, i), 0).r).x;
+        col += texelFetch(colors, ivec3(gl_FragCoord.xy, i), 0).rgb * vis;
+        vis *= 1.0 - a;
+    }
+
+    // Tail: Its average color, covering what the core leaves visible of
+    // everything that is not visible in the end
+    vec4 acc_tex = texelFetch(accum, ivec2(gl_FragCoord.xy), 0);
+    float transp_tex = texelFetch(transp, ivec2(gl_FragCoord.xy), 0).r;
+
+    col += acc_tex.rgb / max(EPSILON, acc_tex.a) * max(vis - transp_tex, 0.0);
+
+    // Premultiplied
+    out_col = vec4(col, transp_tex);
+}
@@ -0,0 +1,22 @@
+#version 150 core
+
+
+// First pass of moment-based OIT with four power moments: Accumulates the
+// absorbance (-ln(1 - alpha)) of all fragments and its first four power
+// moments over the depth (mapped to [-1, 1]).
+
+out float out_absorbance;
+out vec4 out_moments;
+
+uniform float alpha;
+
+
+void main(void)
+{
+    float z = 2.0 * gl_FragCoord.z - 1.0;
+    float z2 = z * z;
+    float absorbance = -log(1.0 - alpha);
+
+    out_absorbance = absorbance;
+    out_moments = absorbance * vec4(z, z2, z2 * z, z2 * z2);
+}
@@ -0,0 +1,24 @@
+#version 150 core
+
+
+// First pass of moment-based OIT with eight power moments (see
+// draw_mboit0_frag.glsl)
+
+out float out_absorbance;
+out vec4 out_moments, out_moments_high;
+
+uniform float alpha;
+
+
+void main(void)
+{
+    float z = 2.0 * gl_FragCoord.z - 1.0;
+    float z2 = z * z;
+    float absorbance = -log(1.0 - alpha);
+
+    vec4 low = vec4(z, z2, z2 * z, z2 * z2);
+
+    out_absorbance = absorbance;
+    out_moments = absorbance * low;
+    out_moments_high = absorbance * low * low.w;
+}
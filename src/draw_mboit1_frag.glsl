@@ -0,0 +1,86 @@
+#version 150 core
+
+
+in vec3 vf_col;
+
+out vec4 out_col;
+
+uniform sampler2D absorbance, moments;
+uniform float alpha;
+
+
+// Mixed into the normalized moments to keep their Hankel matrix positive
+// definite despite the limited precision, and the moments of a (symmetric)
+// distribution to mix in
+#ifndef BIAS
+#define BIAS 5e-7
+#endif
+#define BIAS_MOMENTS vec4(0.0, 0.375, 0.0, 0.375)
+
+// How far to move from the lower bound of the absorbance in front of a
+// fragment towards its upper bound
+#define OVERESTIMATION 0.25
+
+
+// Factorization B = L * D * L^T of the Hankel matrix of (1, b)
+float l21, d1, d2;
+
+// Returns y = L^-1 * (1, x, x^2) and K(x, x) = y^T * D^-1 * y
+vec3 kernel_solve(vec4 b, float x, out float k)
+{
+    vec3 y = vec3(1.0, x - b.x, 0.0);
+    y.z = x * x - b.y - l21 * y.y;
+
+    k = 1.0 + y.y * y.y / d1 + y.z * y.z / d2;
+    return y;
+}
+
+
+// Fraction of the total absorbance in front of depth @z, reconstructed from
+// the normalized power moments @b by the bounds of the Hamburger moment
+// problem (Peters and Klein, "Moment Shadow Mapping"; Münstermann et al.,
+// "Moment-Based Order-Independent Transparency")
+float absorbance_in_front(vec4 b, float z)
+{
+    b = mix(b, BIAS_MOMENTS, BIAS);
+
+    d1 = b.y - b.x * b.x;
+    l21 = (b.z - b.x * b.y) / d1;
+    d2 = b.w - b.y * b.y - l21 * l21 * d1;
+
+    // c = B^-1 * (1, z, z^2); its polynomial's roots are the other two
+    // support points of the canonical representation which has one in z
+    float k0;
+    vec3 y = kernel_solve(b, z, k0);
+    vec3 c;
+    c.z = y.z / d2;
+    c.y = y.y / d1 - l21 * c.z;
+    c.x = 1.0 - b.x * c.y - b.y * c.z;
+
+    float disc = sqrt(max(0.0, c.y * c.y - 4.0 * c.x * c.z));
+    float q = -0.5 * (c.y + (c.y < 0.0 ? -disc : disc));
+    vec2 roots = vec2(q / c.z, c.x / q);
+
+    // The weights of the support points are 1 / K(x, x)
+    float lower = 0.0, k;
+    for (int i = 0; i < 2; i++) {
+        if (roots[i] < z) {
+            kernel_solve(b, roots[i], k);
+            lower += 1.0 / k;
+        }
+    }
+
+    return clamp(lower + OVERESTIMATION / k0, 0.0, 1.0);
+}
+
+
+void main(void)
+{
+    float total = texelFetch(absorbance, ivec2(gl_FragCoord.xy), 0).r;
+    vec4 b = texelFetch(moments, ivec2(gl_FragCoord.xy), 0) / total;
+
+    float z = 2.0 * gl_FragCoord.z - 1.0;
+    float transmittance = exp(-total * absorbance_in_front(b, z));
+
+    out_col = vec4(vf_col, 1.0) * alpha * transmittance;
+}
@@ -0,0 +1,171 @@
+#version 150 core
+
+
+in vec3 vf_col;
+
+out vec4 out_col;
+
+uniform sampler2D absorbance, moments, moments_high;
+uniform float alpha;
+
+
+// Number of support points besides the fragment's depth (half the number of
+// moments) and the size of the Hankel matrix
+#define N 4
+#define M (N + 1)
+
+// See draw_mboit1_frag.glsl.  The higher moments of depths which only span
+// part of [-1, 1] are much smaller than the lower ones, so a bias that is
+// too strong drowns them; tunable with -D BIAS for scenes with a different
+// depth range.
+#ifndef BIAS
+#define BIAS 5e-7
+#endif
+const float bias_moments[2 * N] = float[](0.0, 0.75, 0.0, 0.676666667,
+                                          0.0, 0.63, 0.0, 0.600303030);
+
+#define OVERESTIMATION 0.25
+
+#define LAGUERRE_STEPS 8
+
+
+// Factorization B = L * D * L^T of the Hankel matrix of the normalized
+// moments (L is unit lower triangular, stored row-major)
+float l[M * M], d[M];
+
+
+void factorize(float b[2 * N + 1])
+{
+    for (int j = 0; j < M; j++) {
+        d[j] = b[2 * j];
+        for (int k = 0; k < j; k++) {
+            d[j] -= l[j * M + k] * l[j * M + k] * d[k];
+        }
+
+        for (int i = j + 1; i < M; i++) {
+            float s = b[i + j];
+            for (int k = 0; k < j; k++) {
+                s -= l[i * M + k] * l[j * M + k] * d[k];
+            }
+            l[i * M + j] = s / d[j];
+        }
+    }
+}
+
+
+// Solves L * y = (1, x, ..., x^N) and returns K(x, x) = y^T * D^-1 * y
+float kernel_solve(float x, out float y[M])
+{
+    float k = 0.0, xp = 1.0;
+    for (int i = 0; i < M; i++) {
+        y[i] = xp;
+        for (int j = 0; j < i; j++) {
+            y[i] -= l[i * M + j] * y[j];
+        }
+        k += y[i] * y[i] / d[i];
+        xp *= x;
+    }
+    return k;
+}
+
+
+// Finds the smallest root of the polynomial with the coefficients @c (of
+// degree @n, lowest first) with Laguerre's method, which converges
+// monotonically for polynomials with only real roots when starting below all
+// of them
+float smallest_root(float c[N + 1], int n)
+{
+    float bound = 0.0;
+    for (int i = 0; i < n; i++) {
+        bound = max(bound, abs(c[i] / c[n]));
+    }
+
+    float x = -1.0 - bound;
+    for (int step = 0; step < LAGUERRE_STEPS; step++) {
+        float p = c[n], dp = 0.0, ddp = 0.0;
+        for (int i = n - 1; i >= 0; i--) {
+            ddp = ddp * x + 2.0 * dp;
+            dp = dp * x + p;
+            p = p * x + c[i];
+        }
+
+        if (p == 0.0) {
+            break;
+        }
+
+        float g = dp / p, h = g * g - ddp / p;
+        float fn = float(n);
+        float s = sqrt(max(0.0, (fn - 1.0) * (fn * h - g * g)));
+        // Below all roots, p'/p is negative
+        x -= fn / (g - s);
+    }
+
+    return x;
+}
+
+
+// See draw_mboit1_frag.glsl
+float absorbance_in_front(float b[2 * N + 1], float z)
+{
+    for (int i = 1; i <= 2 * N; i++) {
+        b[i] = mix(b[i], bias_moments[i - 1], BIAS);
+    }
+
+    factorize(b);
+
+    float y[M];
+    float k0 = kernel_solve(z, y);
+
+    float c[N + 1];
+    for (int i = M - 1; i >= 0; i--) {
+        c[i] = y[i] / d[i];
+        for (int j = i + 1; j < M; j++) {
+            c[i] -= l[j * M + i] * c[j];
+        }
+    }
+
+    // Take the roots off one by one, the last two in closed form
+    float roots[N];
+    for (int n = N; n > 2; n--) {
+        float r = smallest_root(c, n);
+        roots[n - 1] = r;
+
+        // Divide by (x - r)
+        float carry = c[n];
+        for (int i = n - 1; i >= 0; i--) {
+            float ci = c[i];
+            c[i] = carry;
+            carry = ci + carry * r;
+        }
+    }
+
+    float disc = sqrt(max(0.0, c[1] * c[1] - 4.0 * c[0] * c[2]));
+    float q = -0.5 * (c[1] + (c[1] < 0.0 ? -disc : disc));
+    roots[0] = q / c[2];
+    roots[1] = c[0] / q;
+
+    float lower = 0.0;
+    for (int i = 0; i < N; i++) {
+        if (roots[i] < z) {
+            lower += 1.0 / kernel_solve(roots[i], y);
+        }
+    }
+
+    return clamp(lower + OVERESTIMATION / k0, 0.0, 1.0);
+}
+
+
+void main(void)
+{
+    float total = texelFetch(absorbance, ivec2(gl_FragCoord.xy), 0).r;
+    vec4 low = texelFetch(moments, ivec2(gl_FragCoord.xy), 0) / total;
+    vec4 high = texelFetch(moments_high, ivec2(gl_FragCoord.xy), 0) / total;
+
+    float b[2 * N + 1] = float[](1.0, low.x, low.y, low.z, low.w,
+                                 high.x, high.y, high.z, high.w);
+
+    float z = 2.0 * gl_FragCoord.z - 1.0;
+    float transmittance = exp(-total * absorbance_in_front(b, z));
+
+    out_col = vec4(vf_col, 1.0) * alpha * transmittance;
+}
@@ -0,0 +1,21 @@
+#version 150 core
+
+
+out vec4 out_col;
+
+uniform sampler2D accum, absorbance;
+
+
+#ifndef EPSILON
+#define EPSILON 0.0001
+#endif
+
+
+void main(void)
+{
+    vec4 acc_tex = texelFetch(accum, ivec2(gl_FragCoord.xy), 0);
+    float total = texelFetch(absorbance, ivec2(gl_FragCoord.xy), 0).r;
+
+    // The transmittance-weighted average color covers all but exp(-total)
+    out_col = vec4(acc_tex.rgb / max(EPSILON, acc_tex.a), exp(-total));
+}
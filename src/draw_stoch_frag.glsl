@@ -0,0 +1,55 @@
+#version 330 core
+#extension GL_ARB_sample_shading: require
+
+
+in vec3 vf_col;
+
+out vec4 out_col;
+
+uniform float alpha;
+
+
+// PCG (O'Neill), one step of the LCG and the output permutation
+uint pcg(inout uint state)
+{
+    state = state * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+float random(inout uint state)
+{
+    return float(pcg(state) >> 8) / 16777216.0;
+}
+
+
+// Covers a random subset of alpha * gl_NumSamples of the samples (rounded
+// randomly), so that on average, the fragment covers as much of the pixel as
+// it is opaque.  The subset is seeded per fragment, so overlapping fragments
+// cover independent subsets.
+void main(void)
+{
+    uint state = uint(gl_FragCoord.x) + (uint(gl_FragCoord.y) << 16);
+    pcg(state);
+    state ^= uint(gl_PrimitiveID);
+    pcg(state);
+    state ^= floatBitsToUint(gl_FragCoord.z);
+
+    int need = int(alpha * float(gl_NumSamples) + random(state));
+
+    // Selection sampling: Every subset of that size is equally likely
+    uint mask = 0u;
+    for (int i = 0; i < gl_NumSamples; i++) {
+        if (random(state) * float(gl_NumSamples - i) < float(need)) {
+            mask |= 1u << uint(i);
+            need--;
+        }
+    }
+
+    if (mask == 0u) {
+        discard;
+    }
+
+    gl_SampleMask[0] = int(mask);
+    out_col = vec4(vf_col, 1.0);
+}
@@ -0,0 +1,21 @@
+#version 150 core
+
+
+in vec3 in_pos, in_col, in_nrm;
+
+out vec3 vf_pos, vf_col;
+out vec4 vf_prev_pos;
+
+uniform mat4 mat_mvp, mat_prev_mvp;
+
+
+// Like draw_xf_vert.glsl, but also yields the (clip space) position in the
+// previous frame
+void main(void)
+{
+    vec4 pos = mat_mvp * vec4(in_pos, 1.0);
+    gl_Position = pos;
+    vf_pos = (pos.xyz / pos.w) / 2.0 + vec3(0.5);
+    vf_prev_pos = mat_prev_mvp * vec4(in_pos, 1.0);
+    vf_col = in_col;
+}
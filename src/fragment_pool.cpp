@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include <dake/gl/gl.hpp>
+
+#include "fragment_pool.hpp"
+
+
+// Allocate this much more than the peak seen
+#define HEADROOM 1.25
+// Only shrink if the pool has been more than twice as large as needed over
+// this many frames
+#define SHRINK_WINDOW 120
+
+
+FragmentPool::FragmentPool(size_t initial_capacity, size_t ns,
+                           size_t max_capacity):
+    node_size(ns),
+    nodes(0),
+    min_nodes(initial_capacity)
+{
+    GLint64 max_block_size;
+    glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &max_block_size);
+    max_nodes = std::min(static_cast<size_t>(max_block_size) / node_size,
+                         max_capacity);
+
+    glGenBuffers(1, &node_buffer);
+
+    glGenBuffers(1, &counter_buffer);
+    glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, counter_buffer);
+    glBufferStorage(GL_ATOMIC_COUNTER_BUFFER, 4, nullptr, 0);
+
+    glGenBuffers(1, &readback_buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, readback_buffer);
+    glBufferStorage(GL_COPY_WRITE_BUFFER, READBACK_SLOTS * 4, nullptr,
+                    GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT
+                    | GL_MAP_COHERENT_BIT);
+    readback_map = static_cast<const volatile uint32_t *>(
+        glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, READBACK_SLOTS * 4,
+                         GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT
+                         | GL_MAP_COHERENT_BIT));
+
+    for (Slot &s: slots) {
+        s.fence = nullptr;
+        s.capacity = 0;
+    }
+
+    reset_stats();
+    resize(std::min(min_nodes, max_nodes));
+}
+
+
+FragmentPool::~FragmentPool(void)
+{
+    for (Slot &s: slots) {
+        if (s.fence) {
+            glDeleteSync(s.fence);
+        }
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, readback_buffer);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+
+    glDeleteBuffers(1, &readback_buffer);
+    glDeleteBuffers(1, &counter_buffer);
+    glDeleteBuffers(1, &node_buffer);
+}
+
+
+void FragmentPool::reset_stats(void)
+{
+    st.frames = 0;
+    st.overflow_frames = 0;
+    st.overflow_fragments = 0;
+    st.peak = 0;
+}
+
+
+void FragmentPool::resize(size_t new_capacity)
+{
+    if (new_capacity == nodes) {
+        return;
+    }
+
+    nodes = new_capacity;
+
+    // The contents do not need to be preserved
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, node_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, nodes * node_size, nullptr,
+                 GL_DYNAMIC_COPY);
+}
+
+
+void FragmentPool::collect(bool block)
+{
+    // Slots are used in order, so stop at the first one that is not ready
+    uint64_t first = frame_index > READBACK_SLOTS ? frame_index - READBACK_SLOTS : 0;
+
+    for (uint64_t i = first; i < frame_index; i++) {
+        Slot &s = slots[i % READBACK_SLOTS];
+        if (!s.fence) {
+            continue;
+        }
+
+        GLenum status = glClientWaitSync(s.fence,
+                                         block ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                                         block ? GL_TIMEOUT_IGNORED : 0);
+        if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED) {
+            break;
+        }
+
+        glDeleteSync(s.fence);
+        s.fence = nullptr;
+
+        size_t count = readback_map[i % READBACK_SLOTS];
+
+        st.frames++;
+        st.peak = std::max(st.peak, count);
+        if (count > s.capacity) {
+            st.overflow_frames++;
+            st.overflow_fragments += count - s.capacity;
+        }
+
+        window_peak = std::max(window_peak, count);
+        window_frames++;
+    }
+}
+
+
+void FragmentPool::begin_frame(void)
+{
+    collect(false);
+
+    // Grow as soon as the pool comes close to being full; shrink only once
+    // it has been far too large for a whole window
+    size_t target = std::max(min_nodes, static_cast<size_t>(window_peak * HEADROOM));
+    target = std::min(target, max_nodes);
+
+    if (window_peak * HEADROOM > nodes * .9 && target > nodes) {
+        resize(target);
+    } else if (window_frames >= SHRINK_WINDOW) {
+        if (target < nodes / 2) {
+            resize(target);
+        }
+
+        window_peak = 0;
+        window_frames = 0;
+    }
+
+    bind();
+
+    glClearBufferData(GL_ATOMIC_COUNTER_BUFFER, GL_R32UI, GL_RED_INTEGER,
+                      GL_UNSIGNED_INT, nullptr);
+}
+
+
+void FragmentPool::bind(void)
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, node_buffer);
+    glBindBufferRange(GL_ATOMIC_COUNTER_BUFFER, 0, counter_buffer, 0, 4);
+}
+
+
+void FragmentPool::end_frame(GLuint count_buffer)
+{
+    Slot &s = slots[frame_index % READBACK_SLOTS];
+
+    if (s.fence) {
+        // Too late, drop that result
+        glDeleteSync(s.fence);
+    }
+
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    glBindBuffer(GL_COPY_READ_BUFFER, count_buffer ? count_buffer : counter_buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, readback_buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0,
+                        (frame_index % READBACK_SLOTS) * 4, 4);
+
+    s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    s.capacity = nodes;
+
+    frame_index++;
+}
+
+
+void FragmentPool::flush(void)
+{
+    collect(true);
+}
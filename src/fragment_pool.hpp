@@ -0,0 +1,86 @@
+#ifndef FRAGMENT_POOL_HPP
+#define FRAGMENT_POOL_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <dake/gl/gl.hpp>
+
+
+// Node pool for the A-buffers: A shader storage buffer with one node per
+// fragment, plus an atomic counter which can be used to allocate them.
+//
+// The fragment count (by default, the counter) is copied into a persistently
+// mapped ring buffer after every geometry pass and read a few frames later,
+// once its fence has been signaled.  Based on these counts, the pool grows to
+// fit the peak plus some headroom, and shrinks again if it has been far too
+// large for a while.  Fragments that do not fit into the pool are not lost,
+// but have to be handled by the shaders (they can compare the counter to
+// capacity()).
+class FragmentPool {
+    public:
+        static const int READBACK_SLOTS = 4;
+
+        struct Stats {
+            uint64_t frames;
+            // Frames where not all fragments fit into the pool
+            uint64_t overflow_frames;
+            // Fragments that did not fit into the pool
+            uint64_t overflow_fragments;
+            // Most fragments in a single frame
+            size_t peak;
+        };
+
+        // The pool never grows beyond @max_capacity nodes (or what fits into
+        // a shader storage block)
+        FragmentPool(size_t initial_capacity, size_t node_size,
+                     size_t max_capacity = SIZE_MAX);
+        ~FragmentPool(void);
+
+        // Resizes the pool (if necessary), resets the counter and calls
+        // bind()
+        void begin_frame(void);
+        // Queues the read back of the fragment count (the first uint in
+        // @count_buffer, or the counter if 0); to be called once that count
+        // is final
+        void end_frame(GLuint count_buffer = 0);
+
+        // Binds both buffers to binding point 0 of their respective targets
+        void bind(void);
+
+        // Blocks until all outstanding counts have been collected
+        void flush(void);
+
+        size_t capacity(void) const { return nodes; }
+        size_t size_bytes(void) const { return nodes * node_size; }
+        // The counter and the read back ring
+        size_t overhead_bytes(void) const { return 4 + READBACK_SLOTS * 4; }
+
+        // Statistics since the last reset_stats()
+        const Stats &stats(void) const { return st; }
+        void reset_stats(void);
+
+    private:
+        struct Slot {
+            GLsync fence;
+            size_t capacity;
+        };
+
+        GLuint node_buffer, counter_buffer, readback_buffer;
+        const volatile uint32_t *readback_map;
+
+        size_t node_size, nodes, min_nodes, max_nodes;
+        Slot slots[READBACK_SLOTS];
+        uint64_t frame_index = 0;
+
+        // Peak over the current shrink window
+        size_t window_peak = 0;
+        unsigned window_frames = 0;
+
+        Stats st;
+
+        void collect(bool block);
+        void resize(size_t new_capacity);
+};
+
+#endif
@@ -0,0 +1,82 @@
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <dake/gl/gl.hpp>
+
+#include "gpu_memory.hpp"
+
+
+size_t format_bytes(GLenum format)
+{
+    switch (format) {
+        case GL_RED:
+        case GL_R8:
+        case GL_R8_SNORM:
+            return 1;
+
+        case GL_RG8_SNORM:
+        case GL_R16F:
+            return 2;
+
+        case GL_RGB16F:
+            return 6;
+
+        case GL_RG32F:
+        case GL_RGBA16F:
+        case GL_RGBA16_SNORM:
+            return 8;
+
+        case GL_RGBA32F:
+            return 16;
+
+        default:
+            return 4;
+    }
+}
+
+
+void MemoryReport::add(const std::string &name, size_t bytes)
+{
+    entries.emplace_back(name, bytes);
+}
+
+
+void MemoryReport::add_texture(const std::string &name, GLenum format,
+                               int width, int height, int layers)
+{
+    add(name, format_bytes(format) * width * height * layers);
+}
+
+
+void MemoryReport::add_framebuffer(const std::string &name,
+                                   const std::vector<GLenum> &formats,
+                                   int width, int height)
+{
+    size_t bytes = 4; // depth
+    for (GLenum format: formats) {
+        bytes += format_bytes(format);
+    }
+
+    add(name, bytes * width * height);
+}
+
+
+size_t MemoryReport::total(void) const
+{
+    size_t sum = 0;
+    for (const auto &e: entries) {
+        sum += e.second;
+    }
+    return sum;
+}
+
+
+void MemoryReport::print(FILE *fp, const char *title) const
+{
+    fprintf(fp, "%s: %.1f MB\n", title, total() / 1048576.);
+    for (const auto &e: entries) {
+        fprintf(fp, "  %-32s %8.1f MB\n", e.first.c_str(), e.second / 1048576.);
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef GPU_MEMORY_HPP
+#define GPU_MEMORY_HPP
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <dake/gl/gl.hpp>
+
+
+// Bytes per texel of an internal format (unknown formats are assumed to take
+// four bytes, as do the 24 bit depth formats)
+size_t format_bytes(GLenum format);
+
+
+// Lists the GPU memory held by the resources a technique uses.  Sizes are
+// computed from the formats requested, so drivers may actually use more
+// (padding, compression metadata, etc.).
+class MemoryReport {
+    public:
+        void add(const std::string &name, size_t bytes);
+        void add_texture(const std::string &name, GLenum format, int width,
+                         int height, int layers = 1);
+        // A dake framebuffer with the given color attachment formats and a
+        // depth attachment
+        void add_framebuffer(const std::string &name,
+                             const std::vector<GLenum> &formats, int width,
+                             int height);
+
+        size_t total(void) const;
+        bool empty(void) const { return entries.empty(); }
+
+        void print(FILE *fp, const char *title) const;
+
+    private:
+        std::vector<std::pair<std::string, size_t>> entries;
+};
+
+#endif
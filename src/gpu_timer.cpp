@@ -0,0 +1,266 @@
+#include <algorithm>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <dake/gl/gl.hpp>
+
+#include "gpu_timer.hpp"
+
+
+GPUTimer *gpu_timer;
+
+
+GPUTimer::GPUTimer(bool rt):
+    record_trace(rt)
+{
+    for (Frame &f: frames) {
+        f.label = nullptr;
+        f.index = 0;
+        f.pending = false;
+        f.queries_used = 0;
+    }
+}
+
+
+GPUTimer::~GPUTimer(void)
+{
+    for (Frame &f: frames) {
+        if (!f.query_pool.empty()) {
+            glDeleteQueries(f.query_pool.size(), f.query_pool.data());
+        }
+    }
+}
+
+
+GLuint GPUTimer::get_query(void)
+{
+    if (cur->queries_used >= cur->query_pool.size()) {
+        size_t old_size = cur->query_pool.size();
+        size_t new_size = old_size ? old_size * 2 : 32;
+
+        cur->query_pool.resize(new_size);
+        glGenQueries(new_size - old_size, &cur->query_pool[old_size]);
+    }
+
+    return cur->query_pool[cur->queries_used++];
+}
+
+
+bool GPUTimer::collect(Frame &f, bool block)
+{
+    if (!f.pending) {
+        return true;
+    }
+
+    // The frame event is the first to begin and the last to end, so once its
+    // end is available, everything else is, too
+    GLint available = 0;
+    glGetQueryObjectiv(f.events[0].queries[1], GL_QUERY_RESULT_AVAILABLE,
+                       &available);
+    if (!available && !block) {
+        return false;
+    }
+
+    for (const Event &ev: f.events) {
+        GLuint64 start, end;
+        glGetQueryObjectui64v(ev.queries[0], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(ev.queries[1], GL_QUERY_RESULT, &end);
+
+        if (!base_ts) {
+            base_ts = start;
+        }
+
+        if (record_trace) {
+            trace.push_back(TraceEvent{ev.depth ? ev.name : f.label, f.index,
+                                       ev.depth, start, end});
+        }
+
+        auto acc = summary_acc.find(ev.path);
+        if (acc == summary_acc.end()) {
+            summary_order.push_back(ev.path);
+            acc = summary_acc.insert(std::make_pair(ev.path,
+                                                    Accumulator{0.0, 0})).first;
+        }
+        acc->second.total_ns += end - start;
+        acc->second.count++;
+    }
+
+    f.pending = false;
+    return true;
+}
+
+
+void GPUTimer::begin_frame(const char *label)
+{
+    cur = &frames[frame_index % FRAME_SLOTS];
+
+    if (!collect(*cur, false)) {
+        // We do not wait for the GPU, so just reuse the queries
+        cur->pending = false;
+        dropped++;
+    }
+
+    cur->label = label;
+    cur->index = frame_index++;
+    cur->events.clear();
+    cur->queries_used = 0;
+
+    stack.clear();
+    begin("frame");
+}
+
+
+void GPUTimer::end_frame(void)
+{
+    if (!cur) {
+        return;
+    }
+
+    while (!stack.empty()) {
+        end(stack.back());
+    }
+
+    cur->pending = true;
+    cur = nullptr;
+}
+
+
+int GPUTimer::begin(const char *name)
+{
+    if (!cur) {
+        return -1;
+    }
+
+    Event ev;
+    ev.name = name;
+    ev.depth = stack.size();
+    ev.path = stack.empty() ? std::string(name)
+                            : cur->events[stack.back()].path + "/" + name;
+    ev.queries[0] = get_query();
+    ev.queries[1] = get_query();
+
+    glQueryCounter(ev.queries[0], GL_TIMESTAMP);
+
+    cur->events.push_back(ev);
+    stack.push_back(cur->events.size() - 1);
+
+    return cur->events.size() - 1;
+}
+
+
+void GPUTimer::end(int event)
+{
+    if (!cur || event < 0) {
+        return;
+    }
+
+    if (std::find(stack.begin(), stack.end(), event) == stack.end()) {
+        // Already closed
+        return;
+    }
+
+    // Implicitly close everything nested inside of this event
+    while (!stack.empty()) {
+        int top = stack.back();
+        stack.pop_back();
+
+        glQueryCounter(cur->events[top].queries[1], GL_TIMESTAMP);
+
+        if (top == event) {
+            break;
+        }
+    }
+}
+
+
+void GPUTimer::flush(void)
+{
+    end_frame();
+
+    uint64_t first = frame_index > FRAME_SLOTS ? frame_index - FRAME_SLOTS : 0;
+    for (uint64_t i = first; i < frame_index; i++) {
+        collect(frames[i % FRAME_SLOTS], true);
+    }
+}
+
+
+bool GPUTimer::write_trace(const char *fname)
+{
+    FILE *fp = fopen(fname, "w");
+    if (!fp) {
+        perror(fname);
+        return false;
+    }
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    bool first = true;
+    for (const TraceEvent &ev: trace) {
+        fprintf(fp, "%s{\"name\":\"%s\",\"cat\":\"gpu\",\"ph\":\"X\","
+                    "\"pid\":0,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f,"
+                    "\"args\":{\"frame\":%" PRIu64 "}}",
+                first ? "" : ",\n", ev.name,
+                (ev.start - base_ts) / 1000., (ev.end - ev.start) / 1000.,
+                ev.frame);
+        first = false;
+    }
+
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+
+    return true;
+}
+
+
+void GPUTimer::summary(char *buf, size_t size)
+{
+    size_t len = 0;
+    buf[0] = 0;
+
+    for (const std::string &path: summary_order) {
+        Accumulator &acc = summary_acc[path];
+        if (!acc.count || len >= size) {
+            continue;
+        }
+
+        // Only show the innermost component, the nesting is obvious from
+        // the order
+        size_t slash = path.rfind('/');
+        const char *name = path.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+
+        int ret = snprintf(buf + len, size - len, "%s%s %.2f", len ? ", " : "",
+                           name, acc.total_ns / acc.count / 1e6);
+        if (ret > 0) {
+            len += ret;
+        }
+
+        acc.total_ns = 0.0;
+        acc.count = 0;
+    }
+}
+
+
+GPUScope::GPUScope(const char *name)
+{
+    event = gpu_timer ? gpu_timer->begin(name) : -1;
+}
+
+
+GPUScope::~GPUScope(void)
+{
+    if (gpu_timer) {
+        gpu_timer->end(event);
+    }
+}
+
+
+void GPUScope::next(const char *name)
+{
+    if (gpu_timer) {
+        gpu_timer->end(event);
+        event = gpu_timer->begin(name);
+    }
+}
@@ -0,0 +1,109 @@
+#ifndef GPU_TIMER_HPP
+#define GPU_TIMER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <dake/gl/gl.hpp>
+
+
+// Measures the GPU time spent in (possibly nested) passes using GL_TIMESTAMP
+// queries.  Results are read back FRAME_SLOTS - 1 frames later without ever
+// waiting for the GPU; if they still are not available by then, that frame
+// is dropped.
+class GPUTimer {
+    public:
+        static const int FRAME_SLOTS = 4;
+
+        // Unless @record_trace is set, only the summary is kept
+        GPUTimer(bool record_trace);
+        ~GPUTimer(void);
+
+        // @label is used as the name of the frame in the trace and must
+        // remain valid until the trace has been written
+        void begin_frame(const char *label);
+        void end_frame(void);
+
+        // @name must remain valid until the trace has been written (i.e.,
+        // should be a string literal).  Returns -1 outside of a frame.
+        int begin(const char *name);
+        void end(int event);
+
+        // Blocks until all outstanding results have been collected
+        void flush(void);
+
+        // Writes all results collected so far in Chrome's trace_event format
+        bool write_trace(const char *fname);
+
+        // Average time per pass (in ms) since the last call to this function
+        void summary(char *buf, size_t size);
+
+        unsigned dropped_frames(void) const { return dropped; }
+
+    private:
+        struct Event {
+            const char *name;
+            std::string path;
+            int depth;
+            GLuint queries[2];
+        };
+
+        struct Frame {
+            const char *label;
+            uint64_t index;
+            bool pending;
+            std::vector<Event> events;
+            std::vector<GLuint> query_pool;
+            size_t queries_used;
+        };
+
+        struct TraceEvent {
+            const char *name;
+            uint64_t frame;
+            int depth;
+            uint64_t start, end;
+        };
+
+        struct Accumulator {
+            double total_ns;
+            unsigned count;
+        };
+
+        Frame frames[FRAME_SLOTS];
+        bool record_trace;
+        Frame *cur = nullptr;
+        uint64_t frame_index = 0;
+        unsigned dropped = 0;
+
+        std::vector<int> stack;
+        std::vector<TraceEvent> trace;
+        std::vector<std::string> summary_order;
+        std::map<std::string, Accumulator> summary_acc;
+        uint64_t base_ts = 0;
+
+        GLuint get_query(void);
+        bool collect(Frame &f, bool block);
+};
+
+
+// The global timer instance; nullptr if GPU timing is disabled
+extern GPUTimer *gpu_timer;
+
+
+// Measures everything from construction to destruction (or to the next call
+// to next(), which then starts a new pass on the same level)
+class GPUScope {
+    public:
+        GPUScope(const char *name);
+        ~GPUScope(void);
+
+        void next(const char *name);
+
+    private:
+        int event;
+};
+
+#endif
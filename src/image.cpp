@@ -0,0 +1,150 @@
+#include <cmath>
+#include <csetjmp>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <png.h>
+
+#include "image.hpp"
+
+
+bool save_png(const char *fname, const uint8_t *rgba, int width, int height)
+{
+    FILE *fp = fopen(fname, "wb");
+    if (!fp) {
+        perror(fname);
+        return false;
+    }
+
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr,
+                                              nullptr, nullptr);
+    png_infop info = png ? png_create_info_struct(png) : nullptr;
+    if (!info) {
+        png_destroy_write_struct(&png, nullptr);
+        fclose(fp);
+        return false;
+    }
+
+    std::vector<png_const_bytep> rows(height);
+    for (int y = 0; y < height; y++) {
+        rows[y] = rgba + static_cast<size_t>(height - 1 - y) * width * 4;
+    }
+
+    if (setjmp(png_jmpbuf(png))) {
+        fprintf(stderr, "%s: Failed to write PNG\n", fname);
+        png_destroy_write_struct(&png, &info);
+        fclose(fp);
+        return false;
+    }
+
+    png_init_io(png, fp);
+    png_set_IHDR(png, info, width, height, 8, PNG_COLOR_TYPE_RGB_ALPHA,
+                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+                 PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png, info);
+    png_write_rows(png, const_cast<png_bytepp>(rows.data()), height);
+    png_write_end(png, nullptr);
+
+    png_destroy_write_struct(&png, &info);
+    fclose(fp);
+
+    return true;
+}
+
+
+bool load_png(const char *fname, std::vector<uint8_t> &rgba, int width,
+              int height)
+{
+    FILE *fp = fopen(fname, "rb");
+    if (!fp) {
+        return false;
+    }
+
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr,
+                                             nullptr, nullptr);
+    png_infop info = png ? png_create_info_struct(png) : nullptr;
+    if (!info) {
+        png_destroy_read_struct(&png, nullptr, nullptr);
+        fclose(fp);
+        return false;
+    }
+
+    std::vector<png_bytep> rows(height);
+
+    if (setjmp(png_jmpbuf(png))) {
+        fprintf(stderr, "%s: Failed to read PNG\n", fname);
+        png_destroy_read_struct(&png, &info, nullptr);
+        fclose(fp);
+        return false;
+    }
+
+    png_init_io(png, fp);
+    png_read_info(png, info);
+
+    if (static_cast<int>(png_get_image_width(png, info)) != width ||
+        static_cast<int>(png_get_image_height(png, info)) != height)
+    {
+        fprintf(stderr, "%s: Expected a size of %ix%i, got %ix%i\n", fname,
+                width, height, static_cast<int>(png_get_image_width(png, info)),
+                static_cast<int>(png_get_image_height(png, info)));
+        png_destroy_read_struct(&png, &info, nullptr);
+        fclose(fp);
+        return false;
+    }
+
+    // Convert everything to RGBA8
+    png_set_expand(png);
+    png_set_strip_16(png);
+    png_set_gray_to_rgb(png);
+    png_set_add_alpha(png, 0xff, PNG_FILLER_AFTER);
+    png_set_interlace_handling(png);
+    png_read_update_info(png, info);
+
+    rgba.resize(static_cast<size_t>(width) * height * 4);
+    for (int y = 0; y < height; y++) {
+        rows[y] = rgba.data() + static_cast<size_t>(height - 1 - y) * width * 4;
+    }
+
+    png_read_image(png, rows.data());
+    png_read_end(png, nullptr);
+
+    png_destroy_read_struct(&png, &info, nullptr);
+    fclose(fp);
+
+    return true;
+}
+
+
+void ImageError::add(const uint8_t *rgba, const uint8_t *ref, size_t pixels)
+{
+    // Per image, the sum fits easily into 64 bits
+    uint64_t sum = 0;
+
+    for (size_t i = 0; i < pixels * 4; i += 4) {
+        for (int c = 0; c < 3; c++) {
+            int diff = abs(static_cast<int>(rgba[i + c]) - ref[i + c]);
+            sum += diff * diff;
+            if (diff > max) {
+                max = diff;
+            }
+        }
+    }
+
+    squared_sum += sum;
+    values += pixels * 3;
+}
+
+
+double ImageError::rmse(void) const
+{
+    return values ? sqrt(squared_sum / values) : 0.0;
+}
+
+
+double ImageError::psnr(void) const
+{
+    return 20.0 * log10(255.0 / rmse());
+}
@@ -0,0 +1,33 @@
+#ifndef IMAGE_HPP
+#define IMAGE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// @rgba is RGBA8 with the rows stored bottom-up (as glReadPixels() returns
+// them)
+bool save_png(const char *fname, const uint8_t *rgba, int width, int height);
+
+// Loads any PNG into @rgba in the same layout; fails if it is not exactly
+// @width x @height
+bool load_png(const char *fname, std::vector<uint8_t> &rgba, int width,
+              int height);
+
+
+// Difference between RGBA8 images and their references, accumulated over any
+// number of images (alpha is ignored); all values are in 8 bit units
+struct ImageError {
+    double squared_sum = 0.0;
+    size_t values = 0;
+    int max = 0;
+
+    void add(const uint8_t *rgba, const uint8_t *ref, size_t pixels);
+
+    double rmse(void) const;
+    // Infinite for identical images
+    double psnr(void) const;
+};
+
+#endif
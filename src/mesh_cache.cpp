@@ -0,0 +1,356 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <dake/gl/gl.hpp>
+#include <dake/gl/obj.hpp>
+#include <dake/gl/vertex_array.hpp>
+#include <dake/math.hpp>
+
+#include "mesh_cache.hpp"
+#include "obj_loader.hpp"
+#include "vertex_cache.hpp"
+
+
+using namespace dake::gl;
+using namespace dake::math;
+
+
+static_assert(sizeof(vec3) == 3 * sizeof(float),
+              "vec3 must be three tightly packed floats");
+
+
+struct FileHeader {
+    char magic[4];
+    uint32_t gradient;
+    uint64_t obj_size;
+    int64_t obj_mtime;
+    float lower_left[3], upper_right[3];
+    uint32_t section_count;
+    uint32_t reserved;
+};
+
+// The section's data starts at @offset: positions, normals and colors
+// (@vertex_count vec3s each), followed by the indices in optimized, in
+// reversed and in the OBJ's triangle order (@index_count uint32_ts each)
+struct SectionHeader {
+    uint64_t vertex_count;
+    uint64_t index_count;
+    uint64_t offset;
+};
+
+static const char MAGIC[4] = {'T', 'P', 'M', '3'};
+
+
+static size_t section_size(size_t vertex_count, size_t index_count)
+{
+    return 3 * vertex_count * sizeof(vec3) + 3 * index_count * sizeof(uint32_t);
+}
+
+
+vertex_array *Mesh::Section::make_vertex_array(bool reversed)
+{
+    vertex_array *va = new vertex_array;
+    va->set_elements(index_count);
+
+    const vec3 *arrays[3] = {positions, normals, colors};
+    for (int i = 0; i < 3; i++) {
+        va->attrib(i)->format(3);
+        va->attrib(i)->data(arrays[i], vertex_count * sizeof(vec3));
+    }
+
+    // The element buffer binding is part of the VAO's state
+    va->bind();
+    if (!index_buffers[reversed]) {
+        glGenBuffers(1, &index_buffers[reversed]);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffers[reversed]);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_count * sizeof(uint32_t),
+                     indices[reversed], GL_STATIC_DRAW);
+    } else {
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffers[reversed]);
+    }
+    glBindVertexArray(0);
+
+    return va;
+}
+
+
+void Mesh::Section::make_soup(bool reversed, vec3 **pos, vec3 **nrm,
+                              vec3 **col) const
+{
+    *pos = new vec3[index_count];
+    *nrm = new vec3[index_count];
+    *col = new vec3[index_count];
+
+    for (size_t i = 0; i < index_count; i++) {
+        // Reversing keeps the order of the vertices within each triangle
+        size_t j = reversed ? index_count - i / 3 * 3 - 3 + i % 3 : i;
+        uint32_t v = obj_indices[j];
+        (*pos)[i] = positions[v];
+        (*nrm)[i] = normals[v];
+        (*col)[i] = colors[v];
+    }
+}
+
+
+Mesh *Mesh::load(const char *obj_name, bool gradient)
+{
+    struct stat st;
+    if (stat(obj_name, &st)) {
+        perror(obj_name);
+        return nullptr;
+    }
+
+    Mesh *mesh = new Mesh;
+    std::string fname = std::string(obj_name) + ".mesh";
+    if (!mesh->map(fname, gradient, st.st_size, st.st_mtime)) {
+        if (!mesh->build(obj_name, gradient, st.st_size, st.st_mtime)) {
+            delete mesh;
+            return nullptr;
+        }
+
+        // Write to a temporary file first so no other instance ever sees a
+        // partial file; failing to write it just means we will have to parse
+        // the OBJ again next time
+        std::string tmp_fname = fname + ".tmp";
+        FILE *fp = fopen(tmp_fname.c_str(), "wb");
+        if (!fp) {
+            perror(tmp_fname.c_str());
+        } else {
+            bool ok = fwrite(mesh->image.data(), 1, mesh->image.size(), fp)
+                      == mesh->image.size();
+            ok = !fclose(fp) && ok;
+
+            if (!ok || rename(tmp_fname.c_str(), fname.c_str())) {
+                perror(fname.c_str());
+                remove(tmp_fname.c_str());
+            }
+        }
+    }
+
+    return mesh;
+}
+
+
+Mesh::~Mesh(void)
+{
+    for (Section &sec: sections) {
+        glDeleteBuffers(2, sec.index_buffers);
+    }
+
+    if (mapping) {
+        munmap(mapping, size);
+    }
+}
+
+
+bool Mesh::map(const std::string &fname, bool gradient, size_t obj_size,
+               long long obj_mtime)
+{
+    int fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) || static_cast<size_t>(st.st_size) < sizeof(FileHeader)) {
+        close(fd);
+        return false;
+    }
+
+    size = st.st_size;
+    mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        return false;
+    }
+    base = static_cast<const char *>(mapping);
+
+    const FileHeader *hdr = reinterpret_cast<const FileHeader *>(base);
+    if (memcmp(hdr->magic, MAGIC, sizeof(MAGIC)) ||
+        hdr->gradient != gradient || hdr->obj_size != obj_size ||
+        hdr->obj_mtime != obj_mtime || !parse())
+    {
+        // Stale or corrupt, will be replaced
+        munmap(mapping, size);
+        mapping = nullptr;
+        base = nullptr;
+        sections.clear();
+        return false;
+    }
+
+    return true;
+}
+
+
+bool Mesh::parse(void)
+{
+    const FileHeader *hdr = reinterpret_cast<const FileHeader *>(base);
+    lower_left = vec3(hdr->lower_left[0], hdr->lower_left[1],
+                      hdr->lower_left[2]);
+    upper_right = vec3(hdr->upper_right[0], hdr->upper_right[1],
+                       hdr->upper_right[2]);
+
+    const SectionHeader *shdr =
+        reinterpret_cast<const SectionHeader *>(hdr + 1);
+    if (hdr->section_count > (size - sizeof(*hdr)) / sizeof(*shdr)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < hdr->section_count; i++) {
+        uint64_t vertices = shdr[i].vertex_count;
+        uint64_t index_count = shdr[i].index_count, offset = shdr[i].offset;
+        if (offset % alignof(vec3) || offset > size || index_count % 3 ||
+            vertices > (size - offset) / sizeof(vec3) ||
+            index_count > (size - offset) / sizeof(uint32_t) ||
+            section_size(vertices, index_count) > size - offset)
+        {
+            return false;
+        }
+
+        const vec3 *arrays = reinterpret_cast<const vec3 *>(base + offset);
+        const uint32_t *idx =
+            reinterpret_cast<const uint32_t *>(arrays + 3 * vertices);
+        for (size_t j = 0; j < 3 * index_count; j++) {
+            if (idx[j] >= vertices) {
+                return false;
+            }
+        }
+
+        Section sec;
+        sec.vertex_count = vertices;
+        sec.index_count = index_count;
+        sec.positions = arrays;
+        sec.normals = arrays + vertices;
+        sec.colors = arrays + 2 * vertices;
+        sec.indices[0] = idx;
+        sec.indices[1] = idx + index_count;
+        sec.obj_indices = idx + 2 * index_count;
+        sections.push_back(sec);
+    }
+
+    return true;
+}
+
+
+bool Mesh::build(const char *obj_name, bool gradient, size_t obj_size,
+                 long long obj_mtime)
+{
+    obj entity;
+    if (!load_obj_parallel(obj_name, &entity)) {
+        return false;
+    }
+
+    // Weld and optimize first, the file layout depends on the results
+    struct Prepared {
+        std::vector<vec3> positions, normals, colors;
+        std::vector<uint32_t> indices, obj_indices;
+    };
+    std::vector<Prepared> prepared(entity.sections.size());
+
+    size_t offset = sizeof(FileHeader)
+                  + entity.sections.size() * sizeof(SectionHeader);
+    size_t total = offset;
+    for (size_t s = 0; s < entity.sections.size(); s++) {
+        const obj_section &sec = entity.sections[s];
+        Prepared &p = prepared[s];
+
+        size_t l = sec.positions.size();
+        assert(!(l % 3) && l == sec.normals.size());
+
+        std::vector<vec3> soup_colors(l);
+        for (size_t i = 0; i < l; i++) {
+            if (gradient) {
+                float green = (sec.positions[i].z() - entity.lower_left.z())
+                            / (entity.upper_right.z() - entity.lower_left.z());
+                soup_colors[i] = vec3(1.f, green, 0.f);
+            } else {
+                soup_colors[i] = sec.material.diffuse;
+            }
+        }
+
+        std::vector<uint32_t> unique, order;
+        weld_vertices(sec.positions.data(), sec.normals.data(),
+                      soup_colors.data(), l, &p.indices, &unique);
+        p.obj_indices = p.indices;
+
+        optimize_vertex_cache(p.indices.data(), l, unique.size());
+        order_vertices(p.indices.data(), l, unique.size(), &order);
+
+        // Renumber the OBJ order's indices the same way
+        std::vector<uint32_t> new_index(unique.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            new_index[order[i]] = i;
+        }
+        for (uint32_t &i: p.obj_indices) {
+            i = new_index[i];
+        }
+
+        for (uint32_t v: order) {
+            uint32_t soup_index = unique[v];
+            p.positions.push_back(sec.positions[soup_index]);
+            p.normals.push_back(sec.normals[soup_index]);
+            p.colors.push_back(soup_colors[soup_index]);
+        }
+
+        total += section_size(order.size(), l);
+    }
+
+    image.resize(total);
+    char *img = image.data();
+
+    FileHeader *hdr = reinterpret_cast<FileHeader *>(img);
+    memcpy(hdr->magic, MAGIC, sizeof(MAGIC));
+    hdr->gradient = gradient;
+    hdr->obj_size = obj_size;
+    hdr->obj_mtime = obj_mtime;
+    for (int i = 0; i < 3; i++) {
+        hdr->lower_left[i] = entity.lower_left[i];
+        hdr->upper_right[i] = entity.upper_right[i];
+    }
+    hdr->section_count = entity.sections.size();
+    hdr->reserved = 0;
+
+    SectionHeader *shdr = reinterpret_cast<SectionHeader *>(hdr + 1);
+    for (const Prepared &p: prepared) {
+        size_t v = p.positions.size(), l = p.indices.size();
+
+        shdr->vertex_count = v;
+        shdr->index_count = l;
+        shdr->offset = offset;
+        shdr++;
+
+        vec3 *arrays = reinterpret_cast<vec3 *>(img + offset);
+        std::copy(p.positions.begin(), p.positions.end(), arrays);
+        std::copy(p.normals.begin(), p.normals.end(), arrays + v);
+        std::copy(p.colors.begin(), p.colors.end(), arrays + 2 * v);
+
+        uint32_t *idx = reinterpret_cast<uint32_t *>(arrays + 3 * v);
+        uint32_t *ridx = idx + l;
+        std::copy(p.indices.begin(), p.indices.end(), idx);
+        std::copy(p.obj_indices.begin(), p.obj_indices.end(), idx + 2 * l);
+
+        // Inverted triangle order (keeping the order of the vertices within
+        // each triangle)
+        for (size_t i = 0; i < l; i += 3) {
+            for (int j = 0; j < 3; j++) {
+                ridx[l - i - 3 + j] = idx[i + j];
+            }
+        }
+
+        offset += section_size(v, l);
+    }
+
+    base = img;
+    size = total;
+    return parse();
+}
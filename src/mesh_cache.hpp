@@ -0,0 +1,77 @@
+#ifndef MESH_CACHE_HPP
+#define MESH_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <dake/gl/gl.hpp>
+#include <dake/gl/vertex_array.hpp>
+#include <dake/math.hpp>
+
+
+// A mesh as the demo draws it: per section the positions, normals and colors
+// of its vertices (identical ones welded) and an index list of its triangles,
+// reordered for the post-transform vertex cache, plus the same list with the
+// triangle order reversed and one in the OBJ's original order.  All of this
+// is kept in a binary file next to the OBJ (<entity.obj>.mesh), which is
+// written on first load and afterwards simply mapped into memory, so neither
+// parsing nor any per-vertex processing is needed on startup.  The file is
+// rebuilt if the OBJ's size or modification time or the color mode changes.
+class Mesh {
+    public:
+        struct Section {
+            size_t vertex_count, index_count;
+            const dake::math::vec3 *positions, *normals, *colors;
+            // Index 0 is the optimized triangle order, 1 the reversed one
+            const uint32_t *indices[2];
+            // The same triangles in the OBJ's order (before optimizing)
+            const uint32_t *obj_indices;
+
+            // Attribute 0 is the position, 1 the normal, 2 the color; the
+            // element buffer holds indices[reversed] (it is owned by the
+            // mesh and shared by all vertex arrays using the same order)
+            dake::gl::vertex_array *make_vertex_array(bool reversed);
+
+            GLuint index_buffers[2] = {0, 0};
+
+            // Expands the section into a triangle soup in the OBJ's triangle
+            // order (reversed if requested), i.e. as it was drawn before the
+            // vertices were welded, for comparison; the arrays are allocated
+            // with new[]
+            void make_soup(bool reversed, dake::math::vec3 **positions,
+                           dake::math::vec3 **normals,
+                           dake::math::vec3 **colors) const;
+        };
+
+        // @gradient: Color every vertex by its Z coordinate (red to yellow)
+        // instead of using the material's diffuse color.  Returns nullptr
+        // (after printing the reason) if the OBJ cannot be loaded.
+        static Mesh *load(const char *obj_name, bool gradient);
+        ~Mesh(void);
+
+        dake::math::vec3 lower_left, upper_right;
+        std::vector<Section> sections;
+
+        // Whether the mesh has been mapped from an existing cache file
+        bool cached(void) const { return mapping; }
+
+    private:
+        Mesh(void) {}
+
+        // Either a mapping of the cache file or a buffer holding the same
+        // contents (if it has just been built)
+        const char *base = nullptr;
+        size_t size = 0;
+        void *mapping = nullptr;
+        std::vector<char> image;
+
+        bool map(const std::string &fname, bool gradient, size_t obj_size,
+                 long long obj_mtime);
+        bool build(const char *obj_name, bool gradient, size_t obj_size,
+                   long long obj_mtime);
+        bool parse(void);
+};
+
+#endif
@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+
+#include <dake/gl/gl.hpp>
+#include <dake/gl/texture.hpp>
+
+#include "gpu_memory.hpp"
+#include "multisample.hpp"
+
+
+MultisampleFramebuffer::MultisampleFramebuffer(int w, int h, int samples,
+                                               GLenum color_format):
+    width(w),
+    height(h)
+{
+    GLint max_samples;
+    glGetIntegerv(GL_MAX_SAMPLES, &max_samples);
+    sample_count = std::min(samples, static_cast<int>(max_samples));
+
+    color_bytes = format_bytes(color_format);
+
+    glGenRenderbuffers(1, &color_rb);
+    glBindRenderbuffer(GL_RENDERBUFFER, color_rb);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, sample_count,
+                                     color_format, width, height);
+
+    glGenRenderbuffers(1, &depth_rb);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth_rb);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, sample_count,
+                                     GL_DEPTH_COMPONENT24, width, height);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                              GL_RENDERBUFFER, color_rb);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                              GL_RENDERBUFFER, depth_rb);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "Multisampled framebuffer with %i samples is "
+                        "incomplete\n", sample_count);
+    }
+
+    resolved_tex.format(color_format, width, height);
+
+    glGenFramebuffers(1, &resolve_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, resolve_fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_2D, resolved_tex.glid(), 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+
+MultisampleFramebuffer::~MultisampleFramebuffer(void)
+{
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteFramebuffers(1, &resolve_fbo);
+    glDeleteRenderbuffers(1, &color_rb);
+    glDeleteRenderbuffers(1, &depth_rb);
+}
+
+
+void MultisampleFramebuffer::bind(void)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, width, height);
+}
+
+
+void MultisampleFramebuffer::resolve(void)
+{
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolve_fbo);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height,
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+}
+
+
+size_t MultisampleFramebuffer::size_bytes(void) const
+{
+    // 24 bit depth is stored in 32 bits
+    return static_cast<size_t>(width) * height
+         * (sample_count * (color_bytes + 4) + color_bytes);
+}
@@ -0,0 +1,39 @@
+#ifndef MULTISAMPLE_HPP
+#define MULTISAMPLE_HPP
+
+#include <cstddef>
+
+#include <dake/gl/gl.hpp>
+#include <dake/gl/texture.hpp>
+
+
+// A multisampled framebuffer with one color and a depth attachment; resolve()
+// averages the samples into a texture which can then be composited.
+class MultisampleFramebuffer {
+    public:
+        // Uses at most @samples samples (as many as supported)
+        MultisampleFramebuffer(int width, int height, int samples,
+                               GLenum color_format);
+        ~MultisampleFramebuffer(void);
+
+        void bind(void);
+
+        // Leaves the framebuffer bindings changed
+        void resolve(void);
+
+        dake::gl::texture &resolved(void) { return resolved_tex; }
+
+        int samples(void) const { return sample_count; }
+
+        // Including the resolved texture
+        size_t size_bytes(void) const;
+
+    private:
+        int width, height, sample_count;
+        size_t color_bytes;
+        GLuint fbo, resolve_fbo;
+        GLuint color_rb, depth_rb;
+        dake::gl::texture resolved_tex;
+};
+
+#endif
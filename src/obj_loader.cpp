@@ -0,0 +1,603 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <dake/gl/obj.hpp>
+#include <dake/math.hpp>
+
+#include "obj_loader.hpp"
+
+
+using namespace dake::gl;
+using namespace dake::math;
+
+
+// Chunks smaller than this are not worth a thread of their own
+static const size_t MIN_CHUNK_SIZE = 256 * 1024;
+
+
+struct Chunk {
+    const char *begin, *end;
+
+    std::vector<vec3> positions, normals;
+    std::vector<vec2> tex_coords;
+
+    // Three entries per triangle corner: position, texture coordinate and
+    // normal index (zero-based, -1 if not given)
+    std::vector<int32_t> corners;
+    // Entries of corners that were given as negative (relative) indices; they
+    // are relative to this chunk's own vertex lists until the number of
+    // vertices in the preceding chunks is known
+    std::vector<size_t> relative;
+
+    // usemtl statements (triangle index at which they occur, material name)
+    std::vector<std::pair<size_t, std::string>> materials;
+    std::vector<std::string> mtllibs;
+
+    vec3 lower_left, upper_right;
+
+    // Where parsing failed (nullptr if it did not)
+    const char *error = nullptr;
+
+    // Index of the first vertex of each kind in the merged lists
+    size_t base[3];
+};
+
+// A range of triangles of one chunk using the same material
+struct Run {
+    int chunk;
+    size_t first, count;
+    size_t section, offset;
+};
+
+
+// Runs @fn(0) to @fn(n - 1) on n threads (including the calling one)
+static void parallel(int n, const std::function<void(int)> &fn)
+{
+    std::vector<std::thread> workers;
+    for (int i = 1; i < n; i++) {
+        workers.emplace_back(fn, i);
+    }
+    fn(0);
+    for (std::thread &t: workers) {
+        t.join();
+    }
+}
+
+
+static inline bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static inline const char *skip_space(const char *p, const char *end)
+{
+    while (p < end && is_space(*p)) {
+        p++;
+    }
+    return p;
+}
+
+
+// Parses a decimal floating point number (no inf/nan, no hex); returns
+// nullptr if there is none.  Up to 18 significant digits are taken into
+// account, and scaling is exact for exponents up to 22, which covers anything
+// an exporter writes.
+static const char *parse_float(const char *p, const char *end, float *out)
+{
+    static const double pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+        1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    p = skip_space(p, end);
+
+    bool neg = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        neg = *p++ == '-';
+    }
+
+    uint64_t mant = 0;
+    int exp = 0, digits = 0;
+    for (; p < end && is_digit(*p); p++, digits++) {
+        if (mant < 100000000000000000ull) {
+            mant = mant * 10 + (*p - '0');
+        } else {
+            exp++;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && is_digit(*p); p++, digits++) {
+            if (mant < 100000000000000000ull) {
+                mant = mant * 10 + (*p - '0');
+                exp--;
+            }
+        }
+    }
+    if (!digits) {
+        return nullptr;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char *q = p + 1;
+        bool exp_neg = false;
+        if (q < end && (*q == '-' || *q == '+')) {
+            exp_neg = *q++ == '-';
+        }
+        if (q < end && is_digit(*q)) {
+            int e = 0;
+            for (; q < end && is_digit(*q); q++) {
+                e = std::min(e * 10 + (*q - '0'), 10000);
+            }
+            exp += exp_neg ? -e : e;
+            p = q;
+        }
+    }
+
+    double val = mant;
+    while (exp > 22) {
+        val *= 1e22;
+        exp -= 22;
+    }
+    while (exp < -22) {
+        val /= 1e22;
+        exp += 22;
+    }
+    val = exp < 0 ? val / pow10[-exp] : val * pow10[exp];
+
+    *out = neg ? -val : val;
+    return p;
+}
+
+
+static const char *parse_int(const char *p, const char *end, int64_t *out)
+{
+    bool neg = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        neg = *p++ == '-';
+    }
+    if (p >= end || !is_digit(*p)) {
+        return nullptr;
+    }
+
+    int64_t val = 0;
+    for (; p < end && is_digit(*p); p++) {
+        val = std::min<int64_t>(val * 10 + (*p - '0'), INT32_MAX);
+    }
+
+    *out = neg ? -val : val;
+    return p;
+}
+
+
+// Parses one face corner (v, v/vt, v//vn or v/vt/vn) into @idx (the OBJ
+// indices, 0 if not given)
+static const char *parse_corner(const char *p, const char *end, int64_t idx[3])
+{
+    idx[0] = idx[1] = idx[2] = 0;
+
+    p = parse_int(p, end, &idx[0]);
+    if (!p || !idx[0]) {
+        return nullptr;
+    }
+    for (int i = 1; i < 3 && p < end && *p == '/'; i++) {
+        p++;
+        if (p < end && *p != '/' && !is_space(*p)) {
+            p = parse_int(p, end, &idx[i]);
+            if (!p || !idx[i]) {
+                return nullptr;
+            }
+        }
+    }
+
+    return p;
+}
+
+
+static std::string parse_name(const char *p, const char *end)
+{
+    p = skip_space(p, end);
+    const char *e = p;
+    while (e < end && *e != '\n') {
+        e++;
+    }
+    while (e > p && is_space(e[-1])) {
+        e--;
+    }
+    return std::string(p, e);
+}
+
+
+static void parse_chunk(Chunk *c)
+{
+    c->lower_left = vec3(HUGE_VALF, HUGE_VALF, HUGE_VALF);
+    c->upper_right = vec3(-HUGE_VALF, -HUGE_VALF, -HUGE_VALF);
+
+    // The current polygon's corners (three entries each, as in Chunk), and
+    // which of these entries are relative
+    std::vector<int64_t> polygon;
+    std::vector<char> polygon_rel;
+
+    const char *p = c->begin, *end = c->end;
+    while (p < end) {
+        const char *line = p;
+        const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (!eol) {
+            eol = end;
+        }
+
+        p = skip_space(p, eol);
+        bool ok = true;
+
+        if (eol - p >= 2 && p[0] == 'v' && is_space(p[1])) {
+            vec3 v;
+            ok = (p = parse_float(p + 1, eol, &v.x())) &&
+                 (p = parse_float(p, eol, &v.y())) &&
+                 (p = parse_float(p, eol, &v.z()));
+            if (ok) {
+                c->positions.push_back(v);
+                for (int i = 0; i < 3; i++) {
+                    c->lower_left[i] = std::min(c->lower_left[i], v[i]);
+                    c->upper_right[i] = std::max(c->upper_right[i], v[i]);
+                }
+            }
+        } else if (eol - p >= 3 && p[0] == 'v' && p[1] == 'n' && is_space(p[2])) {
+            vec3 n;
+            ok = (p = parse_float(p + 2, eol, &n.x())) &&
+                 (p = parse_float(p, eol, &n.y())) &&
+                 (p = parse_float(p, eol, &n.z()));
+            if (ok) {
+                c->normals.push_back(n);
+            }
+        } else if (eol - p >= 3 && p[0] == 'v' && p[1] == 't' && is_space(p[2])) {
+            vec2 t;
+            ok = (p = parse_float(p + 2, eol, &t.x())) &&
+                 (p = parse_float(p, eol, &t.y()));
+            if (ok) {
+                c->tex_coords.push_back(t);
+            }
+        } else if (eol - p >= 2 && p[0] == 'f' && is_space(p[1])) {
+            polygon.clear();
+            polygon_rel.clear();
+            p = skip_space(p + 1, eol);
+            while (ok && p < eol) {
+                int64_t idx[3];
+                ok = (p = parse_corner(p, eol, idx)) && (p == eol || is_space(*p));
+                if (!ok) {
+                    break;
+                }
+
+                size_t counts[3] = {
+                    c->positions.size(), c->tex_coords.size(), c->normals.size()
+                };
+                for (int i = 0; i < 3; i++) {
+                    // Negative indices are relative to the vertices read so
+                    // far (in this chunk, for now)
+                    polygon.push_back(idx[i] < 0 ? static_cast<int64_t>(counts[i]) + idx[i]
+                                               : idx[i] - 1);
+                    polygon_rel.push_back(idx[i] < 0);
+                }
+                p = skip_space(p, eol);
+            }
+
+            size_t n = polygon.size() / 3;
+            ok = ok && n >= 3;
+            // Triangle fan
+            for (size_t i = 1; ok && i + 1 < n; i++) {
+                for (size_t k: {size_t(0), i, i + 1}) {
+                    for (size_t j = k * 3; j < k * 3 + 3; j++) {
+                        if (polygon_rel[j]) {
+                            c->relative.push_back(c->corners.size());
+                        }
+                        c->corners.push_back(polygon[j]);
+                    }
+                }
+            }
+        } else if (eol - p >= 7 && !strncmp(p, "usemtl", 6) && is_space(p[6])) {
+            c->materials.emplace_back(c->corners.size() / 9,
+                                      parse_name(p + 6, eol));
+        } else if (eol - p >= 7 && !strncmp(p, "mtllib", 6) && is_space(p[6])) {
+            c->mtllibs.push_back(parse_name(p + 6, eol));
+        }
+        // Everything else (comments, o, g, s, ...) is ignored
+
+        if (!ok) {
+            c->error = line;
+            return;
+        }
+
+        p = eol + 1;
+    }
+}
+
+
+static void load_mtllib(const std::string &fname,
+                        std::vector<obj_material> *materials)
+{
+    FILE *fp = fopen(fname.c_str(), "r");
+    if (!fp) {
+        perror(fname.c_str());
+        return;
+    }
+
+    char line[1024];
+    while (fgets(line, sizeof(line), fp)) {
+        const char *p = skip_space(line, line + strlen(line));
+        vec3 v;
+
+        if (!strncmp(p, "newmtl", 6) && is_space(p[6])) {
+            materials->emplace_back();
+            materials->back().name = parse_name(p + 6, p + strlen(p));
+            materials->back().ambient = vec3(0.f, 0.f, 0.f);
+            materials->back().diffuse = vec3(1.f, 1.f, 1.f);
+            materials->back().specular = vec3(0.f, 0.f, 0.f);
+        } else if (materials->empty() || p[0] != 'K' || !is_space(p[2])) {
+            continue;
+        } else if (sscanf(p + 2, "%f %f %f", &v.x(), &v.y(), &v.z()) == 3) {
+            switch (p[1]) {
+                case 'a': materials->back().ambient = v; break;
+                case 'd': materials->back().diffuse = v; break;
+                case 's': materials->back().specular = v; break;
+            }
+        }
+    }
+
+    fclose(fp);
+}
+
+
+bool load_obj_parallel(const char *fname, obj *out, int threads)
+{
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0) {
+        perror(fname);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st)) {
+        perror(fname);
+        close(fd);
+        return false;
+    }
+
+    size_t size = st.st_size;
+    void *mapping = size ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0)
+                         : nullptr;
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        perror(fname);
+        return false;
+    }
+    madvise(mapping, size, MADV_SEQUENTIAL);
+
+    const char *data = static_cast<const char *>(mapping);
+
+    if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = std::max<size_t>(1, std::min<size_t>(threads, size / MIN_CHUNK_SIZE));
+
+    // Split at line boundaries
+    std::vector<Chunk> chunks(threads);
+    const char *begin = data;
+    for (int i = 0; i < threads; i++) {
+        const char *end = data + size * (i + 1) / threads;
+        if (end < begin) {
+            end = begin;
+        }
+        const char *eol = static_cast<const char *>(
+            memchr(end, '\n', data + size - end));
+        end = (i == threads - 1 || !eol) ? data + size : eol + 1;
+
+        chunks[i].begin = begin;
+        chunks[i].end = end;
+        begin = end;
+    }
+
+    parallel(threads, [&](int i) { parse_chunk(&chunks[i]); });
+
+    for (const Chunk &c: chunks) {
+        if (c.error) {
+            size_t line = std::count(data, c.error, '\n') + 1;
+            fprintf(stderr, "%s:%zu: Malformed record\n", fname, line);
+            munmap(mapping, size);
+            return false;
+        }
+    }
+
+    // Merge the vertex lists
+    std::vector<vec3> positions, normals;
+    std::vector<vec2> tex_coords;
+    size_t total[3] = {0, 0, 0};
+    for (Chunk &c: chunks) {
+        size_t counts[3] = {
+            c.positions.size(), c.tex_coords.size(), c.normals.size()
+        };
+        for (int i = 0; i < 3; i++) {
+            c.base[i] = total[i];
+            total[i] += counts[i];
+        }
+    }
+    positions.resize(total[0]);
+    tex_coords.resize(total[1]);
+    normals.resize(total[2]);
+
+    std::vector<char> index_error(threads);
+    parallel(threads, [&](int t) {
+        Chunk &c = chunks[t];
+        std::copy(c.positions.begin(), c.positions.end(),
+                  positions.begin() + c.base[0]);
+        std::copy(c.tex_coords.begin(), c.tex_coords.end(),
+                  tex_coords.begin() + c.base[1]);
+        std::copy(c.normals.begin(), c.normals.end(),
+                  normals.begin() + c.base[2]);
+        std::vector<vec3>().swap(c.positions);
+        std::vector<vec2>().swap(c.tex_coords);
+        std::vector<vec3>().swap(c.normals);
+
+        for (size_t i: c.relative) {
+            c.corners[i] += c.base[i % 3];
+        }
+        for (size_t i = 0; i < c.corners.size(); i++) {
+            if (c.corners[i] >= static_cast<int64_t>(total[i % 3]) ||
+                (c.corners[i] < 0 && (!(i % 3) || c.corners[i] != -1)))
+            {
+                index_error[t] = true;
+                break;
+            }
+        }
+    });
+
+    munmap(mapping, size);
+
+    if (std::count(index_error.begin(), index_error.end(), true)) {
+        fprintf(stderr, "%s: Face refers to a nonexistent vertex\n", fname);
+        return false;
+    }
+
+    // Materials
+    std::vector<obj_material> materials;
+    std::string dir(fname);
+    size_t slash = dir.rfind('/');
+    dir = slash == std::string::npos ? std::string() : dir.substr(0, slash + 1);
+    for (const Chunk &c: chunks) {
+        for (const std::string &lib: c.mtllibs) {
+            load_mtllib(lib[0] == '/' ? lib : dir + lib, &materials);
+        }
+    }
+
+    obj_material default_material;
+    default_material.ambient = vec3(0.f, 0.f, 0.f);
+    default_material.diffuse = vec3(1.f, 1.f, 1.f);
+    default_material.specular = vec3(0.f, 0.f, 0.f);
+
+    // Split the triangles into runs of the same material, and assign those to
+    // sections (a new one whenever the material changes)
+    out->sections.clear();
+    std::vector<Run> runs;
+    std::vector<size_t> section_sizes;
+    std::string cur_material;
+    bool have_material = false;
+
+    auto add_run = [&](int chunk, size_t first, size_t last) {
+        if (first >= last) {
+            return;
+        }
+        if (section_sizes.empty() || out->sections.back().material.name != cur_material) {
+            out->sections.emplace_back();
+            out->sections.back().material = default_material;
+            out->sections.back().material.name = cur_material;
+            if (have_material) {
+                bool found = false;
+                for (const obj_material &m: materials) {
+                    if (m.name == cur_material) {
+                        out->sections.back().material = m;
+                        found = true;
+                        break;
+                    }
+                }
+                if (!found) {
+                    fprintf(stderr, "%s: Unknown material \"%s\"\n", fname,
+                            cur_material.c_str());
+                }
+            }
+            section_sizes.push_back(0);
+        }
+        runs.push_back(Run{chunk, first, last - first, section_sizes.size() - 1,
+                           section_sizes.back()});
+        section_sizes.back() += (last - first) * 3;
+    };
+
+    for (int i = 0; i < threads; i++) {
+        const Chunk &c = chunks[i];
+        size_t first = 0;
+        for (const std::pair<size_t, std::string> &m: c.materials) {
+            add_run(i, first, m.first);
+            first = m.first;
+            cur_material = m.second;
+            have_material = true;
+        }
+        add_run(i, first, c.corners.size() / 9);
+    }
+
+    bool have_tex_coords = !tex_coords.empty();
+    for (size_t i = 0; i < out->sections.size(); i++) {
+        out->sections[i].positions.resize(section_sizes[i]);
+        out->sections[i].normals.resize(section_sizes[i]);
+        if (have_tex_coords) {
+            out->sections[i].tex_coords.resize(section_sizes[i]);
+        }
+    }
+
+    // Every chunk fills in its own runs
+    parallel(threads, [&](int t) {
+        const Chunk &c = chunks[t];
+        for (const Run &r: runs) {
+            if (r.chunk != t) {
+                continue;
+            }
+
+            obj_section &sec = out->sections[r.section];
+            for (size_t tri = 0; tri < r.count; tri++) {
+                const int32_t *corners = &c.corners[(r.first + tri) * 9];
+                size_t o = r.offset + tri * 3;
+
+                for (int k = 0; k < 3; k++) {
+                    sec.positions[o + k] = positions[corners[k * 3]];
+                    if (have_tex_coords) {
+                        sec.tex_coords[o + k] = corners[k * 3 + 1] >= 0
+                                              ? tex_coords[corners[k * 3 + 1]]
+                                              : vec2(0.f, 0.f);
+                    }
+                }
+
+                if (corners[2] >= 0 && corners[5] >= 0 && corners[8] >= 0) {
+                    for (int k = 0; k < 3; k++) {
+                        sec.normals[o + k] = normals[corners[k * 3 + 2]];
+                    }
+                } else {
+                    const vec3 &a = sec.positions[o];
+                    vec3 e1 = sec.positions[o + 1] - a;
+                    vec3 e2 = sec.positions[o + 2] - a;
+                    vec3 n(e1.y() * e2.z() - e1.z() * e2.y(),
+                           e1.z() * e2.x() - e1.x() * e2.z(),
+                           e1.x() * e2.y() - e1.y() * e2.x());
+                    if (n.length() > 0.f) {
+                        n = n.normalized();
+                    }
+                    for (int k = 0; k < 3; k++) {
+                        sec.normals[o + k] = n;
+                    }
+                }
+            }
+        }
+    });
+
+    out->lower_left = vec3(HUGE_VALF, HUGE_VALF, HUGE_VALF);
+    out->upper_right = vec3(-HUGE_VALF, -HUGE_VALF, -HUGE_VALF);
+    for (const Chunk &c: chunks) {
+        for (int i = 0; i < 3; i++) {
+            out->lower_left[i] = std::min(out->lower_left[i], c.lower_left[i]);
+            out->upper_right[i] = std::max(out->upper_right[i], c.upper_right[i]);
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,22 @@
+#ifndef OBJ_LOADER_HPP
+#define OBJ_LOADER_HPP
+
+#include <dake/gl/obj.hpp>
+
+
+// Loads a Wavefront OBJ into the same structures dake::gl::load_obj()
+// produces (a triangle soup, with a new section wherever the faces switch to
+// another material, so a material used again later gets another section),
+// but parses the file on several threads: It is mapped into memory and split
+// at line boundaries into one chunk per thread, each chunk's v/vt/vn/f
+// records are parsed independently, and the results are then merged (again
+// in parallel).  Polygons are triangulated as fans; triangles without normals
+// get their face normal.  Materials are read from the mtllib files (Ka, Kd,
+// Ks).
+//
+// @threads == 0 means one per hardware thread.  Returns false (after printing
+// the reason) if the file cannot be read or is malformed.
+bool load_obj_parallel(const char *fname, dake::gl::obj *out,
+                       int threads = 0);
+
+#endif
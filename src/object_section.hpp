@@ -0,0 +1,36 @@
+#ifndef OBJECT_SECTION_HPP
+#define OBJECT_SECTION_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <dake/gl/gl.hpp>
+#include <dake/gl/vertex_array.hpp>
+#include <dake/math.hpp>
+
+
+struct ObjectSection {
+    dake::gl::vertex_array *va;
+    dake::math::mat4 rel_mv;
+
+    // The data uploaded to va, kept around for the CPU reference renderer
+    const dake::math::vec3 *positions = nullptr, *colors = nullptr;
+    size_t vertex_count = 0;
+
+    // If non-null, the section is drawn indexed (va then has an element
+    // buffer with these indices)
+    const uint32_t *indices = nullptr;
+    size_t index_count = 0;
+
+    void draw(GLenum mode) const
+    {
+        if (indices) {
+            va->bind();
+            glDrawElements(mode, index_count, GL_UNSIGNED_INT, nullptr);
+        } else {
+            va->draw(mode);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,39 @@
+#include <dake/gl/gl.hpp>
+
+#include "peel_query.hpp"
+
+
+PeelQuery::PeelQuery(void)
+{
+    glGenQueries(2, queries);
+}
+
+
+PeelQuery::~PeelQuery(void)
+{
+    glDeleteQueries(2, queries);
+}
+
+
+void PeelQuery::begin(int pass)
+{
+    glBeginQuery(GL_ANY_SAMPLES_PASSED, queries[pass % 2]);
+}
+
+
+void PeelQuery::end(void)
+{
+    glEndQuery(GL_ANY_SAMPLES_PASSED);
+}
+
+
+bool PeelQuery::more_layers(int pass)
+{
+    if (pass < 1) {
+        return true;
+    }
+
+    GLuint any_samples;
+    glGetQueryObjectuiv(queries[(pass - 1) % 2], GL_QUERY_RESULT, &any_samples);
+    return any_samples;
+}
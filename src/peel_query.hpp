@@ -0,0 +1,28 @@
+#ifndef PEEL_QUERY_HPP
+#define PEEL_QUERY_HPP
+
+#include <dake/gl/gl.hpp>
+
+
+// Ends depth peeling once there is nothing left to peel.  Every peel pass is
+// wrapped in an occlusion query (begin()/end()); the result of a pass is only
+// read after the next one has been issued, so the GPU always has something to
+// work on while we wait.  Since a pass which did not draw anything leaves the
+// result unchanged, so does any pass after it.
+class PeelQuery {
+    public:
+        PeelQuery(void);
+        ~PeelQuery(void);
+
+        void begin(int pass);
+        void end(void);
+
+        // To be called after end() for @pass; returns false if the pass
+        // before it did not draw any samples (i.e., peeling can stop)
+        bool more_layers(int pass);
+
+    private:
+        GLuint queries[2];
+};
+
+#endif
@@ -0,0 +1,72 @@
+#include <vector>
+
+#include <dake/gl/gl.hpp>
+#include <dake/gl/texture.hpp>
+
+#include "ping_pong.hpp"
+
+
+using namespace dake::gl;
+
+
+PingPongFramebuffer::PingPongFramebuffer(int w, int h,
+                                         const std::vector<GLenum> &shared_formats,
+                                         const std::vector<GLenum> &separate_formats):
+    width(w),
+    height(h)
+{
+    for (GLenum format: shared_formats) {
+        shared_textures.push_back(new texture);
+        shared_textures.back()->format(format, width, height);
+    }
+
+    glGenFramebuffers(2, fbos);
+
+    for (int i = 0; i < 2; i++) {
+        for (GLenum format: separate_formats) {
+            separate_textures[i].push_back(new texture);
+            separate_textures[i].back()->format(format, width, height);
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbos[i]);
+
+        std::vector<GLenum> draw_buffers;
+        for (texture *tex: shared_textures) {
+            GLenum attachment = GL_COLOR_ATTACHMENT0 + draw_buffers.size();
+            glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D,
+                                   tex->glid(), 0);
+            draw_buffers.push_back(attachment);
+        }
+        for (texture *tex: separate_textures[i]) {
+            GLenum attachment = GL_COLOR_ATTACHMENT0 + draw_buffers.size();
+            glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D,
+                                   tex->glid(), 0);
+            draw_buffers.push_back(attachment);
+        }
+        glDrawBuffers(draw_buffers.size(), draw_buffers.data());
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+
+PingPongFramebuffer::~PingPongFramebuffer(void)
+{
+    glDeleteFramebuffers(2, fbos);
+
+    for (texture *tex: shared_textures) {
+        delete tex;
+    }
+    for (int i = 0; i < 2; i++) {
+        for (texture *tex: separate_textures[i]) {
+            delete tex;
+        }
+    }
+}
+
+
+void PingPongFramebuffer::bind(int index)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, fbos[index]);
+    glViewport(0, 0, width, height);
+}
@@ -0,0 +1,41 @@
+#ifndef PING_PONG_HPP
+#define PING_PONG_HPP
+
+#include <vector>
+
+#include <dake/gl/gl.hpp>
+#include <dake/gl/texture.hpp>
+
+
+// Two framebuffers which share some of their color attachments, while each
+// has its own set of the others.  Rendering a pass into one framebuffer while
+// reading the other's separate attachments then carries the shared ones on to
+// the next pass by just rebinding, instead of copying anything.
+//
+// The shared attachments come first in the draw buffers, then the separate
+// ones.
+class PingPongFramebuffer {
+    public:
+        PingPongFramebuffer(int width, int height,
+                            const std::vector<GLenum> &shared_formats,
+                            const std::vector<GLenum> &separate_formats);
+        ~PingPongFramebuffer(void);
+
+        // Binds framebuffer @index (0 or 1) with all of its attachments as
+        // draw buffers
+        void bind(int index);
+
+        dake::gl::texture &shared(int attachment)
+        { return *shared_textures[attachment]; }
+
+        dake::gl::texture &separate(int index, int attachment)
+        { return *separate_textures[index][attachment]; }
+
+    private:
+        int width, height;
+        GLuint fbos[2];
+        std::vector<dake::gl::texture *> shared_textures;
+        std::vector<dake::gl::texture *> separate_textures[2];
+};
+
+#endif
@@ -0,0 +1,113 @@
+#include <cstddef>
+#include <vector>
+
+#include <dake/gl/gl.hpp>
+
+#include "compute.hpp"
+#include "prefix_sum.hpp"
+
+
+PrefixSum *PrefixSum::create(size_t max_count)
+{
+    ComputeProgram *scan = ComputeProgram::load_async("scan0_comp.glsl");
+    ComputeProgram *add = ComputeProgram::load_async("scan1_comp.glsl");
+
+    if (!scan || !add) {
+        delete scan;
+        delete add;
+        return nullptr;
+    }
+
+    return new PrefixSum(scan, add, max_count);
+}
+
+
+PrefixSum::PrefixSum(ComputeProgram *scan, ComputeProgram *add,
+                     size_t max_count):
+    scan_prg(scan),
+    add_prg(add)
+{
+    size_t count = max_count;
+    do {
+        count = (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+        GLuint buf;
+        glGenBuffers(1, &buf);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buf);
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER, count * 4, nullptr, 0);
+
+        level_buffers.push_back(buf);
+    } while (count > 1);
+}
+
+
+size_t PrefixSum::size_bytes(size_t max_count)
+{
+    size_t bytes = 0, count = max_count;
+    do {
+        count = (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        bytes += count * 4;
+    } while (count > 1);
+    return bytes;
+}
+
+
+bool PrefixSum::finish(void)
+{
+    bool ok = scan_prg->finish();
+    return add_prg->finish() && ok;
+}
+
+
+PrefixSum::~PrefixSum(void)
+{
+    glDeleteBuffers(level_buffers.size(), level_buffers.data());
+
+    delete scan_prg;
+    delete add_prg;
+}
+
+
+void PrefixSum::run(GLuint input, GLuint output, size_t count)
+{
+    // Scan every level, until a single block is left
+    std::vector<size_t> level_counts;
+
+    scan_prg->use();
+    for (size_t level = 0; level < level_buffers.size(); level++) {
+        GLuint in = level ? level_buffers[level - 1] : input;
+        GLuint out = level ? level_buffers[level - 1] : output;
+        size_t groups = (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, in);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, out);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, level_buffers[level]);
+
+        scan_prg->uniform("count", static_cast<GLuint>(count));
+        glDispatchCompute(groups, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        level_counts.push_back(count);
+        count = groups;
+
+        if (groups == 1) {
+            break;
+        }
+    }
+
+    top_level = level_counts.size() - 1;
+
+    // Add the scanned block totals back onto the blocks, top-down
+    add_prg->use();
+    for (size_t level = top_level; level-- > 0;) {
+        GLuint out = level ? level_buffers[level - 1] : output;
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, out);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, level_buffers[level]);
+
+        add_prg->uniform("count", static_cast<GLuint>(level_counts[level]));
+        glDispatchCompute((level_counts[level] + BLOCK_SIZE - 1) / BLOCK_SIZE,
+                          1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef PREFIX_SUM_HPP
+#define PREFIX_SUM_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include <dake/gl/gl.hpp>
+
+#include "compute.hpp"
+
+
+// Exclusive prefix sum over uint shader storage buffers.  Every work group
+// scans a block of 1024 values in shared memory; the block totals are then
+// scanned recursively and added back onto the blocks.
+//
+// Uses the shader storage buffer bindings 0 to 2.
+class PrefixSum {
+    public:
+        static const size_t BLOCK_SIZE = 1024;
+
+        // Returns nullptr if the shaders cannot be read; they are built in
+        // the background, and finish() has to succeed before run() can be
+        // used
+        static PrefixSum *create(size_t max_count);
+        ~PrefixSum(void);
+
+        // Whether finish() would not block
+        bool ready(void) const { return scan_prg->ready() && add_prg->ready(); }
+        // Returns false if the shaders could not be built
+        bool finish(void);
+
+        // @input and @output may be the same buffer
+        void run(GLuint input, GLuint output, size_t count);
+
+        // Buffer containing the total of the last run as its first value
+        GLuint total_buffer(void) const { return level_buffers[top_level]; }
+
+        // GPU memory held by the block totals for @max_count values
+        static size_t size_bytes(size_t max_count);
+
+    private:
+        PrefixSum(ComputeProgram *scan, ComputeProgram *add, size_t max_count);
+
+        ComputeProgram *scan_prg, *add_prg;
+        // Block totals of every level; the last one only holds the total
+        std::vector<GLuint> level_buffers;
+        size_t top_level = 0;
+};
+
+#endif
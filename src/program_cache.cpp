@@ -0,0 +1,175 @@
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+#include <dake/gl/gl.hpp>
+
+#include "program_cache.hpp"
+
+
+ProgramCache *program_cache;
+
+
+struct FileHeader {
+    char magic[4];
+    uint32_t key_size;
+    uint32_t binary_format;
+    uint32_t binary_size;
+};
+
+static const char MAGIC[4] = {'T', 'P', 'B', '1'};
+
+
+// 64 bit FNV-1a
+static uint64_t hash(const std::string &str)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (unsigned char c: str) {
+        h = (h ^ c) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+
+ProgramCache *ProgramCache::create(const char *dir)
+{
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    if (formats <= 0) {
+        fprintf(stderr, "Program cache: No binary formats supported\n");
+        return nullptr;
+    }
+
+    if (mkdir(dir, 0777) && errno != EEXIST) {
+        perror(dir);
+        return nullptr;
+    }
+
+    std::string driver = reinterpret_cast<const char *>(glGetString(GL_RENDERER));
+    driver += '\n';
+    driver += reinterpret_cast<const char *>(glGetString(GL_VERSION));
+    driver += '\n';
+
+    return new ProgramCache(dir, driver);
+}
+
+
+ProgramCache::ProgramCache(const char *d, const std::string &drv):
+    dir(d),
+    driver(drv)
+{
+}
+
+
+std::string ProgramCache::path(const std::string &key) const
+{
+    char name[24];
+    snprintf(name, sizeof(name), "%016llx.bin",
+             static_cast<unsigned long long>(hash(key)));
+    return dir + "/" + name;
+}
+
+
+bool ProgramCache::load(const std::string &sources, GLuint prg)
+{
+    std::string key = driver + sources;
+    std::string fname = path(key);
+
+    FILE *fp = fopen(fname.c_str(), "rb");
+    if (!fp) {
+        misses++;
+        return false;
+    }
+
+    FileHeader hdr;
+    std::vector<char> file_key;
+    std::vector<uint8_t> binary;
+
+    // The sizes in the header must add up to the file's actual size, so a
+    // truncated or corrupt entry cannot make us allocate arbitrary amounts
+    struct stat st;
+    bool ok = !fstat(fileno(fp), &st)
+           && fread(&hdr, sizeof(hdr), 1, fp) == 1
+           && !memcmp(hdr.magic, MAGIC, sizeof(MAGIC))
+           && hdr.key_size == key.size()
+           && static_cast<uint64_t>(st.st_size) ==
+              sizeof(hdr) + static_cast<uint64_t>(hdr.key_size) + hdr.binary_size;
+    if (ok) {
+        file_key.resize(hdr.key_size);
+        binary.resize(hdr.binary_size);
+        ok = fread(file_key.data(), 1, hdr.key_size, fp) == hdr.key_size
+          && fread(binary.data(), 1, hdr.binary_size, fp) == hdr.binary_size
+          && !key.compare(0, key.size(), file_key.data(), file_key.size());
+    }
+    fclose(fp);
+
+    if (ok) {
+        glProgramBinary(prg, hdr.binary_format, binary.data(),
+                        hdr.binary_size);
+
+        GLint status;
+        glGetProgramiv(prg, GL_LINK_STATUS, &status);
+        ok = status;
+    }
+
+    if (!ok) {
+        // Stale (e.g., after a driver update) or corrupt, will be replaced
+        remove(fname.c_str());
+        misses++;
+        return false;
+    }
+
+    hits++;
+    return true;
+}
+
+
+void ProgramCache::prepare(GLuint prg)
+{
+    glProgramParameteri(prg, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+
+void ProgramCache::store(const std::string &sources, GLuint prg)
+{
+    GLint size = 0;
+    glGetProgramiv(prg, GL_PROGRAM_BINARY_LENGTH, &size);
+    if (size <= 0) {
+        return;
+    }
+
+    FileHeader hdr;
+    memcpy(hdr.magic, MAGIC, sizeof(MAGIC));
+
+    std::vector<uint8_t> binary(size);
+    GLenum format;
+    glGetProgramBinary(prg, size, nullptr, &format, binary.data());
+    hdr.binary_format = format;
+    hdr.binary_size = size;
+
+    std::string key = driver + sources;
+    hdr.key_size = key.size();
+
+    // Write to a temporary file first so no other instance ever sees a
+    // partial entry
+    std::string fname = path(key), tmp_fname = fname + ".tmp";
+    FILE *fp = fopen(tmp_fname.c_str(), "wb");
+    if (!fp) {
+        perror(tmp_fname.c_str());
+        return;
+    }
+
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1
+           && fwrite(key.data(), 1, key.size(), fp) == key.size()
+           && fwrite(binary.data(), 1, size, fp) == static_cast<size_t>(size);
+    ok = !fclose(fp) && ok;
+
+    if (!ok || rename(tmp_fname.c_str(), fname.c_str())) {
+        perror(fname.c_str());
+        remove(tmp_fname.c_str());
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef PROGRAM_CACHE_HPP
+#define PROGRAM_CACHE_HPP
+
+#include <string>
+
+#include <dake/gl/gl.hpp>
+
+
+// Keeps linked program binaries (GL_ARB_get_program_binary) in a directory,
+// one file per program, named after a hash of everything that went into it:
+// the sources of all of its shaders (with their defines) and the driver's
+// renderer and version strings.  Entries whose key does not match or which
+// the driver rejects are rebuilt and replaced.
+class ProgramCache {
+    public:
+        // Returns nullptr if the driver does not support any binary formats
+        // or if @dir cannot be created
+        static ProgramCache *create(const char *dir);
+
+        // Tries to load the program built from @sources into @prg (a program
+        // object without any shaders attached).  If this fails, the program
+        // has to be built; call prepare() on it before linking and store()
+        // afterwards.
+        bool load(const std::string &sources, GLuint prg);
+        void prepare(GLuint prg);
+        void store(const std::string &sources, GLuint prg);
+
+        unsigned loaded(void) const { return hits; }
+        unsigned built(void) const { return misses; }
+
+    private:
+        ProgramCache(const char *dir, const std::string &driver);
+
+        std::string dir, driver;
+        unsigned hits = 0, misses = 0;
+
+        std::string path(const std::string &key) const;
+};
+
+
+// The global cache instance; nullptr if disabled
+extern ProgramCache *program_cache;
+
+#endif
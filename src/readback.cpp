@@ -0,0 +1,93 @@
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <dake/gl/gl.hpp>
+
+#include "readback.hpp"
+
+
+FrameReadback::FrameReadback(int w, int h, int slot_count):
+    width(w),
+    height(h),
+    slots(slot_count)
+{
+    for (Slot &s: slots) {
+        glGenBuffers(1, &s.pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<size_t>(width) * height * 4,
+                     nullptr, GL_STREAM_READ);
+
+        s.fence = nullptr;
+        s.tag = -1;
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+
+FrameReadback::~FrameReadback(void)
+{
+    for (Slot &s: slots) {
+        if (s.fence) {
+            glDeleteSync(s.fence);
+        }
+        glDeleteBuffers(1, &s.pbo);
+    }
+}
+
+
+bool FrameReadback::request(int tag)
+{
+    if (pending >= slots.size()) {
+        dropped++;
+        return false;
+    }
+
+    Slot &s = slots[(first + pending++) % slots.size()];
+    s.tag = tag;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    return true;
+}
+
+
+void FrameReadback::collect(const std::function<void(int, const uint8_t *)> &fn,
+                            bool block)
+{
+    while (pending) {
+        Slot &s = slots[first];
+
+        // When blocking, flush so the fence is guaranteed to be signaled
+        // eventually (otherwise, the buffer swap takes care of that)
+        GLenum status = glClientWaitSync(s.fence,
+                                         block ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                                         block ? GL_TIMEOUT_IGNORED : 0);
+        if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED) {
+            return;
+        }
+
+        glDeleteSync(s.fence);
+        s.fence = nullptr;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo);
+        const void *data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                                            static_cast<size_t>(width) * height * 4,
+                                            GL_MAP_READ_BIT);
+        if (data) {
+            fn(s.tag, static_cast<const uint8_t *>(data));
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        first = (first + 1) % slots.size();
+        pending--;
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef READBACK_HPP
+#define READBACK_HPP
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <dake/gl/gl.hpp>
+
+
+// Reads frames back through a ring of pixel buffer objects.  Every read is
+// followed by a fence, and a buffer is only mapped once its fence has been
+// signaled, so the pipeline never stalls; if all buffers are still in flight
+// when another frame is requested, that frame is dropped instead.
+class FrameReadback {
+    public:
+        FrameReadback(int width, int height, int slots = 4);
+        ~FrameReadback(void);
+
+        // Starts reading back the color buffer the current read framebuffer
+        // refers to; @tag is passed on to collect()'s callback.  Returns
+        // false if the frame had to be dropped.
+        bool request(int tag);
+
+        // Calls @fn with the (bottom-up RGBA8) data of every finished read
+        // back, in request order.  If @block is set, waits for all of them.
+        void collect(const std::function<void(int tag, const uint8_t *rgba)> &fn,
+                     bool block);
+
+        unsigned dropped_frames(void) const { return dropped; }
+
+    private:
+        struct Slot {
+            GLuint pbo;
+            GLsync fence;
+            int tag;
+        };
+
+        int width, height;
+        std::vector<Slot> slots;
+        size_t first = 0, pending = 0;
+        unsigned dropped = 0;
+};
+
+#endif
@@ -0,0 +1,531 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <dake/gl/gl.hpp>
+#include <dake/math.hpp>
+
+#include "object_section.hpp"
+#include "reference.hpp"
+
+
+using namespace dake::math;
+
+
+// Subpixel precision of the fixed point window coordinates
+#define SUBPIXEL_BITS 4
+#define SUBPIXEL_ONE  (1 << SUBPIXEL_BITS)
+#define SUBPIXEL_HALF (SUBPIXEL_ONE / 2)
+
+
+namespace {
+
+struct XVertex {
+    float x, y, z, inv_w;
+    // Divided by w for perspective correct interpolation
+    float r, g, b;
+    bool valid;
+};
+
+struct Edge {
+    int64_t e0, step_x, step_y;
+};
+
+}
+
+
+static int64_t floor_div(int64_t a, int64_t b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+
+static void attrib_plane(float *plane, double v0, double v1, double v2,
+                         double dx1, double dy1, double dx2, double dy2,
+                         double det)
+{
+    plane[0] = v0;
+    plane[1] = ((v1 - v0) * dy2 - (v2 - v0) * dy1) / det;
+    plane[2] = ((v2 - v0) * dx1 - (v1 - v0) * dx2) / det;
+}
+
+
+ReferenceRenderer::ReferenceRenderer(int w, int h, int threads):
+    width(w),
+    height(h),
+    tiles_x((w + TILE_SIZE - 1) / TILE_SIZE),
+    tiles_y((h + TILE_SIZE - 1) / TILE_SIZE),
+    bins(tiles_x * tiles_y)
+{
+    if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // The calling thread is worker 0
+    for (int i = 1; i < threads; i++) {
+        workers.emplace_back(&ReferenceRenderer::worker, this, i);
+    }
+}
+
+
+ReferenceRenderer::~ReferenceRenderer(void)
+{
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        quit = true;
+    }
+    wake_cond.notify_all();
+
+    for (std::thread &t: workers) {
+        t.join();
+    }
+}
+
+
+void ReferenceRenderer::worker(int index)
+{
+    uint64_t seen = 0;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lk(lock);
+            wake_cond.wait(lk, [&] { return quit || generation != seen; });
+            if (quit) {
+                return;
+            }
+
+            seen = generation;
+            busy_workers++;
+        }
+
+        int j;
+        while ((j = next_job++) < job_count) {
+            job(j, index);
+        }
+
+        {
+            std::lock_guard<std::mutex> lk(lock);
+            busy_workers--;
+            finished_workers++;
+        }
+        done_cond.notify_all();
+    }
+}
+
+
+void ReferenceRenderer::run(int count, const std::function<void(int, int)> &fn)
+{
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        job = fn;
+        job_count = count;
+        next_job = 0;
+        finished_workers = 0;
+        generation++;
+    }
+    wake_cond.notify_all();
+
+    int j;
+    while ((j = next_job++) < count) {
+        fn(j, 0);
+    }
+
+    // Wait until every worker has seen this job, so none of them can still
+    // be looking at it when the next one is set up
+    std::unique_lock<std::mutex> lk(lock);
+    done_cond.wait(lk, [&] {
+        return !busy_workers &&
+               finished_workers == static_cast<int>(workers.size());
+    });
+}
+
+
+void ReferenceRenderer::setup(const std::vector<ObjectSection> &sections,
+                              const mat4 &mv, const mat4 &proj,
+                              GLenum draw_mode, bool cull_backfaces)
+{
+    std::vector<XVertex> xv;
+
+    triangles.clear();
+    for (std::vector<uint32_t> &bin: bins) {
+        bin.clear();
+    }
+
+    for (const ObjectSection &sec: sections) {
+        mat4 mvp = proj * sec.rel_mv * mv;
+
+        xv.resize(sec.vertex_count);
+        for (size_t i = 0; i < sec.vertex_count; i++) {
+            vec4 c = mvp * vec4(sec.positions[i], 1.f);
+
+            // We do not clip, so anything behind the camera (or ridiculously
+            // far outside of the screen) is dropped
+            xv[i].valid = c.w() > 0.f;
+            if (!xv[i].valid) {
+                continue;
+            }
+
+            float inv_w = 1.f / c.w();
+            xv[i].x = (c.x() * inv_w * .5f + .5f) * width;
+            xv[i].y = (c.y() * inv_w * .5f + .5f) * height;
+            xv[i].z = c.z() * inv_w * .5f + .5f;
+            xv[i].inv_w = inv_w;
+            xv[i].r = sec.colors[i].x() * inv_w;
+            xv[i].g = sec.colors[i].y() * inv_w;
+            xv[i].b = sec.colors[i].z() * inv_w;
+
+            xv[i].valid = fabsf(xv[i].x) < 1e6f && fabsf(xv[i].y) < 1e6f;
+        }
+
+        size_t elements = sec.indices ? sec.index_count : sec.vertex_count;
+        size_t tri_count = draw_mode == GL_TRIANGLE_STRIP
+                         ? (elements >= 3 ? elements - 2 : 0)
+                         : elements / 3;
+
+        auto vertex = [&](size_t i) {
+            return &xv[sec.indices ? sec.indices[i] : i];
+        };
+
+        for (size_t t = 0; t < tri_count; t++) {
+            const XVertex *v[3];
+            if (draw_mode == GL_TRIANGLE_STRIP) {
+                // Every other triangle has its winding flipped
+                v[0] = vertex(t + (t & 1));
+                v[1] = vertex(t + !(t & 1));
+                v[2] = vertex(t + 2);
+            } else {
+                v[0] = vertex(t * 3 + 0);
+                v[1] = vertex(t * 3 + 1);
+                v[2] = vertex(t * 3 + 2);
+            }
+
+            if (!v[0]->valid || !v[1]->valid || !v[2]->valid) {
+                continue;
+            }
+
+            Triangle tri;
+            for (int i = 0; i < 3; i++) {
+                tri.x[i] = llroundf(v[i]->x * SUBPIXEL_ONE);
+                tri.y[i] = llroundf(v[i]->y * SUBPIXEL_ONE);
+            }
+
+            int64_t area2 = (tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0])
+                          - (tri.x[2] - tri.x[0]) * (tri.y[1] - tri.y[0]);
+            if (!area2) {
+                continue;
+            }
+
+            // Window coordinates have y pointing upwards, so counter-
+            // clockwise (front-facing) means a positive area
+            if (area2 < 0) {
+                if (cull_backfaces) {
+                    continue;
+                }
+                std::swap(v[1], v[2]);
+                std::swap(tri.x[1], tri.x[2]);
+                std::swap(tri.y[1], tri.y[2]);
+            }
+
+            int64_t min_x = std::min(tri.x[0], std::min(tri.x[1], tri.x[2]));
+            int64_t max_x = std::max(tri.x[0], std::max(tri.x[1], tri.x[2]));
+            int64_t min_y = std::min(tri.y[0], std::min(tri.y[1], tri.y[2]));
+            int64_t max_y = std::max(tri.y[0], std::max(tri.y[1], tri.y[2]));
+
+            // Pixels whose centers lie within the bounding box
+            tri.min_x = std::max<int64_t>(0, -floor_div(-(min_x - SUBPIXEL_HALF), SUBPIXEL_ONE));
+            tri.min_y = std::max<int64_t>(0, -floor_div(-(min_y - SUBPIXEL_HALF), SUBPIXEL_ONE));
+            tri.max_x = std::min<int64_t>(width - 1, floor_div(max_x - SUBPIXEL_HALF, SUBPIXEL_ONE));
+            tri.max_y = std::min<int64_t>(height - 1, floor_div(max_y - SUBPIXEL_HALF, SUBPIXEL_ONE));
+            if (tri.min_x > tri.max_x || tri.min_y > tri.max_y) {
+                continue;
+            }
+
+            double fx[3], fy[3];
+            for (int i = 0; i < 3; i++) {
+                fx[i] = static_cast<double>(tri.x[i]) / SUBPIXEL_ONE;
+                fy[i] = static_cast<double>(tri.y[i]) / SUBPIXEL_ONE;
+            }
+            double dx1 = fx[1] - fx[0], dy1 = fy[1] - fy[0];
+            double dx2 = fx[2] - fx[0], dy2 = fy[2] - fy[0];
+            double det = dx1 * dy2 - dx2 * dy1;
+
+            tri.fx0 = fx[0];
+            tri.fy0 = fy[0];
+            attrib_plane(tri.z, v[0]->z, v[1]->z, v[2]->z, dx1, dy1, dx2, dy2, det);
+            attrib_plane(tri.inv_w, v[0]->inv_w, v[1]->inv_w, v[2]->inv_w, dx1, dy1, dx2, dy2, det);
+            attrib_plane(tri.r, v[0]->r, v[1]->r, v[2]->r, dx1, dy1, dx2, dy2, det);
+            attrib_plane(tri.g, v[0]->g, v[1]->g, v[2]->g, dx1, dy1, dx2, dy2, det);
+            attrib_plane(tri.b, v[0]->b, v[1]->b, v[2]->b, dx1, dy1, dx2, dy2, det);
+
+            uint32_t index = triangles.size();
+            triangles.push_back(tri);
+
+            for (int ty = tri.min_y / TILE_SIZE; ty <= tri.max_y / TILE_SIZE; ty++) {
+                for (int tx = tri.min_x / TILE_SIZE; tx <= tri.max_x / TILE_SIZE; tx++) {
+                    bins[ty * tiles_x + tx].push_back(index);
+                }
+            }
+        }
+    }
+}
+
+
+static inline void emit_fragment(const ReferenceRenderer::Triangle &tri,
+                                 int px, int py, int tile_x0, int tile_y0,
+                                 std::vector<ReferenceRenderer::Fragment> &frags)
+{
+    float fx = px + .5f - tri.fx0, fy = py + .5f - tri.fy0;
+
+    float z = tri.z[0] + tri.z[1] * fx + tri.z[2] * fy;
+    if (z < 0.f || z > 1.f) {
+        return;
+    }
+
+    float w = 1.f / (tri.inv_w[0] + tri.inv_w[1] * fx + tri.inv_w[2] * fy);
+
+    ReferenceRenderer::Fragment f;
+    f.pixel = (py - tile_y0) * ReferenceRenderer::TILE_SIZE + (px - tile_x0);
+    f.depth = z;
+    f.r = (tri.r[0] + tri.r[1] * fx + tri.r[2] * fy) * w;
+    f.g = (tri.g[0] + tri.g[1] * fx + tri.g[2] * fy) * w;
+    f.b = (tri.b[0] + tri.b[1] * fx + tri.b[2] * fy) * w;
+    frags.push_back(f);
+}
+
+
+void ReferenceRenderer::render_tile(int tile, std::vector<Fragment> &frags,
+                                    std::vector<uint32_t> &offsets,
+                                    std::vector<Fragment> &sorted,
+                                    uint8_t *out, const uint8_t *background,
+                                    float alpha)
+{
+    int tile_x0 = (tile % tiles_x) * TILE_SIZE;
+    int tile_y0 = (tile / tiles_x) * TILE_SIZE;
+    int tile_x1 = std::min(width, tile_x0 + TILE_SIZE) - 1;
+    int tile_y1 = std::min(height, tile_y0 + TILE_SIZE) - 1;
+
+    frags.clear();
+
+    for (uint32_t index: bins[tile]) {
+        const Triangle &tri = triangles[index];
+
+        int x0 = std::max(tri.min_x, tile_x0), x1 = std::min(tri.max_x, tile_x1);
+        int y0 = std::max(tri.min_y, tile_y0), y1 = std::min(tri.max_y, tile_y1);
+        if (x0 > x1 || y0 > y1) {
+            continue;
+        }
+
+        // SIMD lanes may run over the right end of the area
+        int nx = ((x1 - x0 + 1) + 3) & ~3, ny = y1 - y0 + 1;
+
+        Edge edges[3];
+        bool reject = false, narrow = true;
+        for (int i = 0; i < 3; i++) {
+            int j = (i + 1) % 3;
+
+            int64_t a = -(tri.y[j] - tri.y[i]);
+            int64_t b = tri.x[j] - tri.x[i];
+
+            // Top-left rule: Pixel centers exactly on an edge belong to the
+            // triangle only for left edges (going down) and top edges
+            // (horizontal, going left), so that shared edges are never hit
+            // twice.  Elsewhere, E >= 0 becomes E > 0, i.e. E - 1 >= 0.
+            int64_t bias = (a > 0 || (a == 0 && b < 0)) ? 0 : -1;
+
+            Edge &e = edges[i];
+            e.e0 = a * (x0 * SUBPIXEL_ONE + SUBPIXEL_HALF - tri.x[i])
+                 + b * (y0 * SUBPIXEL_ONE + SUBPIXEL_HALF - tri.y[i])
+                 + bias;
+            e.step_x = a * SUBPIXEL_ONE;
+            e.step_y = b * SUBPIXEL_ONE;
+
+            int64_t e_min = e.e0 + std::min<int64_t>(0, e.step_x * (nx - 1))
+                                 + std::min<int64_t>(0, e.step_y * (ny - 1));
+            int64_t e_max = e.e0 + std::max<int64_t>(0, e.step_x * (nx - 1))
+                                 + std::max<int64_t>(0, e.step_y * (ny - 1));
+
+            if (e_max < 0) {
+                reject = true;
+                break;
+            } else if (e_min >= 0) {
+                // Everything inside of this edge
+                e.e0 = e.step_x = e.step_y = 0;
+            } else if (e_min < INT32_MIN / 2 || e_max > INT32_MAX / 2) {
+                narrow = false;
+            }
+        }
+
+        if (reject) {
+            continue;
+        }
+
+        if (!narrow) {
+            for (int y = 0; y < ny; y++) {
+                for (int x = 0; x <= x1 - x0; x++) {
+                    bool inside = true;
+                    for (const Edge &e: edges) {
+                        inside &= e.e0 + e.step_x * x + e.step_y * y >= 0;
+                    }
+                    if (inside) {
+                        emit_fragment(tri, x0 + x, y0 + y, tile_x0, tile_y0, frags);
+                    }
+                }
+            }
+            continue;
+        }
+
+        // All edge function values in this area fit into 32 bits
+#ifdef __SSE2__
+        __m128i minus_one = _mm_set1_epi32(-1);
+        __m128i row[3], step4[3], step_y[3];
+        for (int i = 0; i < 3; i++) {
+            int32_t e0 = edges[i].e0, sx = edges[i].step_x;
+            row[i] = _mm_setr_epi32(e0, e0 + sx, e0 + 2 * sx, e0 + 3 * sx);
+            step4[i] = _mm_set1_epi32(4 * sx);
+            step_y[i] = _mm_set1_epi32(edges[i].step_y);
+        }
+
+        for (int y = 0; y < ny; y++) {
+            __m128i e[3] = { row[0], row[1], row[2] };
+
+            for (int x = 0; x < nx; x += 4) {
+                __m128i in = _mm_and_si128(_mm_cmpgt_epi32(e[0], minus_one),
+                             _mm_and_si128(_mm_cmpgt_epi32(e[1], minus_one),
+                                           _mm_cmpgt_epi32(e[2], minus_one)));
+                int mask = _mm_movemask_ps(_mm_castsi128_ps(in));
+
+                while (mask) {
+                    int lane = __builtin_ctz(mask);
+                    mask &= mask - 1;
+
+                    if (x0 + x + lane <= x1) {
+                        emit_fragment(tri, x0 + x + lane, y0 + y, tile_x0, tile_y0, frags);
+                    }
+                }
+
+                for (int i = 0; i < 3; i++) {
+                    e[i] = _mm_add_epi32(e[i], step4[i]);
+                }
+            }
+
+            for (int i = 0; i < 3; i++) {
+                row[i] = _mm_add_epi32(row[i], step_y[i]);
+            }
+        }
+#else
+        for (int y = 0; y < ny; y++) {
+            int32_t e[3];
+            for (int i = 0; i < 3; i++) {
+                e[i] = edges[i].e0 + edges[i].step_y * y;
+            }
+
+            for (int x = 0; x <= x1 - x0; x++) {
+                if ((e[0] | e[1] | e[2]) >= 0) {
+                    emit_fragment(tri, x0 + x, y0 + y, tile_x0, tile_y0, frags);
+                }
+                for (int i = 0; i < 3; i++) {
+                    e[i] += edges[i].step_x;
+                }
+            }
+        }
+#endif
+    }
+
+    fragment_count += frags.size();
+
+    // Counting sort by pixel
+    std::fill(offsets.begin(), offsets.end(), 0);
+    for (const Fragment &f: frags) {
+        offsets[f.pixel + 1]++;
+    }
+    for (size_t i = 1; i < offsets.size(); i++) {
+        offsets[i] += offsets[i - 1];
+    }
+
+    sorted.resize(frags.size());
+    {
+        std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+        for (const Fragment &f: frags) {
+            sorted[cursor[f.pixel]++] = f;
+        }
+    }
+
+    for (int y = tile_y0; y <= tile_y1; y++) {
+        for (int x = tile_x0; x <= tile_x1; x++) {
+            size_t o = (static_cast<size_t>(y) * width + x) * 4;
+            uint32_t p = (y - tile_y0) * TILE_SIZE + (x - tile_x0);
+
+            Fragment *first = sorted.data() + offsets[p];
+            Fragment *last  = sorted.data() + offsets[p + 1];
+
+            if (first == last) {
+                for (int i = 0; i < 4; i++) {
+                    out[o + i] = background[o + i];
+                }
+                continue;
+            }
+
+            // Back to front; these lists are short, so insertion sort is fine
+            for (Fragment *f = first + 1; f < last; f++) {
+                Fragment cur = *f;
+                Fragment *g = f;
+                for (; g > first && (g - 1)->depth < cur.depth; g--) {
+                    *g = *(g - 1);
+                }
+                *g = cur;
+            }
+
+            float r = background[o + 0] / 255.f;
+            float g = background[o + 1] / 255.f;
+            float b = background[o + 2] / 255.f;
+
+            for (Fragment *f = first; f < last; f++) {
+                r = f->r * alpha + (1.f - alpha) * r;
+                g = f->g * alpha + (1.f - alpha) * g;
+                b = f->b * alpha + (1.f - alpha) * b;
+            }
+
+            out[o + 0] = lroundf(std::min(std::max(r, 0.f), 1.f) * 255.f);
+            out[o + 1] = lroundf(std::min(std::max(g, 0.f), 1.f) * 255.f);
+            out[o + 2] = lroundf(std::min(std::max(b, 0.f), 1.f) * 255.f);
+            out[o + 3] = 255;
+        }
+    }
+}
+
+
+size_t ReferenceRenderer::render(uint8_t *out, const uint8_t *background,
+                                 const std::vector<ObjectSection> &sections,
+                                 const mat4 &mv, const mat4 &proj,
+                                 float alpha, GLenum draw_mode,
+                                 bool cull_backfaces)
+{
+    setup(sections, mv, proj, draw_mode, cull_backfaces);
+
+    int threads = workers.size() + 1;
+    std::vector<std::vector<Fragment>> frags(threads), sorted(threads);
+    std::vector<std::vector<uint32_t>> offsets(threads);
+    for (std::vector<uint32_t> &o: offsets) {
+        o.resize(TILE_SIZE * TILE_SIZE + 1);
+    }
+
+    fragment_count = 0;
+
+    run(tiles_x * tiles_y, [&](int tile, int thread) {
+        render_tile(tile, frags[thread], offsets[thread], sorted[thread],
+                    out, background, alpha);
+    });
+
+    return fragment_count;
+}
@@ -0,0 +1,86 @@
+#ifndef REFERENCE_HPP
+#define REFERENCE_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <dake/gl/gl.hpp>
+#include <dake/math.hpp>
+
+#include "object_section.hpp"
+
+
+// Renders the exact result of compositing all fragments in depth order (i.e.,
+// an unbounded A-buffer) on the CPU, to be used as the ground truth for all
+// the approximate modes.  Rasterization follows GL's rules (pixel centers,
+// top-left fill convention, 4 bits of subpixel precision) and uses the same
+// transformation as draw_xf_vert.glsl.
+class ReferenceRenderer {
+    public:
+        // @threads == 0 means one per hardware thread
+        ReferenceRenderer(int width, int height, int threads = 0);
+        ~ReferenceRenderer(void);
+
+        // @background and @out are RGBA8 with the rows stored bottom-up (as
+        // glReadPixels() returns them); @draw_mode must be GL_TRIANGLES or
+        // GL_TRIANGLE_STRIP.  Returns the number of fragments generated.
+        size_t render(uint8_t *out, const uint8_t *background,
+                      const std::vector<ObjectSection> &sections,
+                      const dake::math::mat4 &mv, const dake::math::mat4 &proj,
+                      float alpha, GLenum draw_mode, bool cull_backfaces);
+
+        static const int TILE_SIZE = 64;
+
+        struct Triangle {
+            // Fixed point window coordinates (4 bits subpixel precision)
+            int64_t x[3], y[3];
+            // Pixel bounding box (inclusive)
+            int min_x, min_y, max_x, max_y;
+
+            // Attribute planes relative to vertex 0 (in pixels):
+            // v(x, y) = v0 + dx * (x - fx0) + dy * (y - fy0)
+            float fx0, fy0;
+            float z[3], inv_w[3], r[3], g[3], b[3];
+        };
+
+        struct Fragment {
+            uint32_t pixel;
+            float depth;
+            float r, g, b;
+        };
+
+    private:
+        int width, height, tiles_x, tiles_y;
+
+        std::vector<Triangle> triangles;
+        std::vector<std::vector<uint32_t>> bins;
+        std::atomic<size_t> fragment_count;
+
+        std::vector<std::thread> workers;
+        std::mutex lock;
+        std::condition_variable wake_cond, done_cond;
+        std::function<void(int, int)> job;
+        std::atomic<int> next_job;
+        int job_count = 0, busy_workers = 0, finished_workers = 0;
+        uint64_t generation = 0;
+        bool quit = false;
+
+        void worker(int index);
+        void run(int count, const std::function<void(int, int)> &fn);
+
+        void setup(const std::vector<ObjectSection> &sections,
+                   const dake::math::mat4 &mv, const dake::math::mat4 &proj,
+                   GLenum draw_mode, bool cull_backfaces);
+        void render_tile(int tile, std::vector<Fragment> &frags,
+                         std::vector<uint32_t> &offsets,
+                         std::vector<Fragment> &sorted, uint8_t *out,
+                         const uint8_t *background, float alpha);
+};
+
+#endif
@@ -0,0 +1,231 @@
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <dake/gl/gl.hpp>
+#include <dake/gl/texture.hpp>
+#include <dake/math.hpp>
+
+#include "program_cache.hpp"
+#include "render_program.hpp"
+#include "shader_source.hpp"
+
+
+using namespace dake::gl;
+using namespace dake::math;
+
+
+bool RenderProgram::parallel_compile;
+
+// Most programs share their vertex shader
+static ShaderCache shaders;
+
+
+RenderProgram::RenderProgram(const char *vsh_fname, const char *fsh_fname,
+                             const std::string &defines):
+    vsh_name(vsh_fname),
+    fsh_name(fsh_fname)
+{
+    failed = !load_shader_source(vsh_fname, "", vsh_source) ||
+             !load_shader_source(fsh_fname, defines, fsh_source);
+}
+
+
+RenderProgram::~RenderProgram(void)
+{
+    if (id) {
+        glDeleteProgram(id);
+    }
+}
+
+
+void RenderProgram::bind_attrib(const char *name, GLuint index)
+{
+    attribs.emplace_back(name, index);
+}
+
+
+void RenderProgram::bind_frag(const char *name, GLuint index)
+{
+    frags.emplace_back(name, index);
+}
+
+
+std::string RenderProgram::cache_key(void) const
+{
+    std::string key = vsh_source + '\n' + fsh_source + '\n';
+    for (const auto &a: attribs) {
+        key += "attrib " + a.first + " " + std::to_string(a.second) + "\n";
+    }
+    for (const auto &f: frags) {
+        key += "frag " + f.first + " " + std::to_string(f.second) + "\n";
+    }
+    return key;
+}
+
+
+void RenderProgram::build(void)
+{
+    if (started) {
+        return;
+    }
+    started = true;
+
+    if (failed) {
+        return;
+    }
+
+    id = glCreateProgram();
+    if (program_cache && program_cache->load(cache_key(), id)) {
+        vsh_source.clear();
+        fsh_source.clear();
+        return;
+    }
+
+    vsh = shaders.get(GL_VERTEX_SHADER, vsh_source);
+    fsh = shaders.get(GL_FRAGMENT_SHADER, fsh_source);
+
+    // Link right away, so the driver can do both in the background; the
+    // compile status is only checked in finish()
+    glAttachShader(id, vsh);
+    glAttachShader(id, fsh);
+    for (const auto &a: attribs) {
+        glBindAttribLocation(id, a.second, a.first.c_str());
+    }
+    for (const auto &f: frags) {
+        glBindFragDataLocation(id, f.second, f.first.c_str());
+    }
+    if (program_cache) {
+        program_cache->prepare(id);
+    }
+    glLinkProgram(id);
+
+    pending = true;
+}
+
+
+bool RenderProgram::ready(void)
+{
+    build();
+    if (!pending || !parallel_compile) {
+        return true;
+    }
+
+    GLint done;
+    glGetProgramiv(id, GL_COMPLETION_STATUS_KHR, &done);
+    return done;
+}
+
+
+bool RenderProgram::check_shader(GLuint sh, const std::string &fname)
+{
+    GLint status, log_len;
+    glGetShaderiv(sh, GL_COMPILE_STATUS, &status);
+    if (status) {
+        return true;
+    }
+
+    glGetShaderiv(sh, GL_INFO_LOG_LENGTH, &log_len);
+    std::vector<char> log(log_len + 1);
+    glGetShaderInfoLog(sh, log_len + 1, nullptr, log.data());
+    fprintf(stderr, "%s: Failed to compile:\n%s\n", fname.c_str(), log.data());
+    return false;
+}
+
+
+bool RenderProgram::finish(void)
+{
+    build();
+    if (!pending) {
+        return !failed;
+    }
+    pending = false;
+
+    if (!check_shader(vsh, vsh_name) || !check_shader(fsh, fsh_name)) {
+        failed = true;
+        return false;
+    }
+
+    GLint status, log_len;
+    glGetProgramiv(id, GL_LINK_STATUS, &status);
+    if (!status) {
+        glGetProgramiv(id, GL_INFO_LOG_LENGTH, &log_len);
+        std::vector<char> log(log_len + 1);
+        glGetProgramInfoLog(id, log_len + 1, nullptr, log.data());
+        fprintf(stderr, "%s: Failed to link:\n%s\n", fsh_name.c_str(),
+                log.data());
+        failed = true;
+        return false;
+    }
+
+    // The shaders stay in the shader cache for other programs
+    glDetachShader(id, vsh);
+    glDetachShader(id, fsh);
+    vsh = fsh = 0;
+
+    if (program_cache) {
+        program_cache->store(cache_key(), id);
+    }
+    vsh_source.clear();
+    fsh_source.clear();
+
+    return true;
+}
+
+
+void RenderProgram::use(void)
+{
+    glUseProgram(id);
+}
+
+
+template<> RenderProgram::Uniform<float> &
+    RenderProgram::Uniform<float>::operator=(const float &value)
+{
+    glUniform1f(location, value);
+    return *this;
+}
+
+
+template<> RenderProgram::Uniform<int32_t> &
+    RenderProgram::Uniform<int32_t>::operator=(const int32_t &value)
+{
+    glUniform1i(location, value);
+    return *this;
+}
+
+
+template<> RenderProgram::Uniform<mat3> &
+    RenderProgram::Uniform<mat3>::operator=(const mat3 &value)
+{
+    glUniformMatrix3fv(location, 1, GL_FALSE, value.data());
+    return *this;
+}
+
+
+template<> RenderProgram::Uniform<mat4> &
+    RenderProgram::Uniform<mat4>::operator=(const mat4 &value)
+{
+    glUniformMatrix4fv(location, 1, GL_FALSE, value.data());
+    return *this;
+}
+
+
+template<> RenderProgram::Uniform<texture> &
+    RenderProgram::Uniform<texture>::operator=(const texture &value)
+{
+    value.bind();
+    glUniform1i(location, value.tmu());
+    return *this;
+}
+
+
+template<> RenderProgram::Uniform<array_texture> &
+    RenderProgram::Uniform<array_texture>::operator=(
+        const array_texture &value)
+{
+    value.bind();
+    glUniform1i(location, value.tmu());
+    return *this;
+}
@@ -0,0 +1,93 @@
+#ifndef RENDER_PROGRAM_HPP
+#define RENDER_PROGRAM_HPP
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <dake/gl/gl.hpp>
+#include <dake/gl/texture.hpp>
+#include <dake/math.hpp>
+
+
+// A program of a vertex and a fragment shader; built directly instead of
+// through dake::gl (like ComputeProgram), so it can be loaded from the
+// program cache and linked in the background
+class RenderProgram {
+    public:
+        // Set if GL_KHR_parallel_shader_compile is available (and enabled),
+        // so build() really does not block
+        static bool parallel_compile;
+
+        // Reads the sources; @defines is inserted into the fragment shader
+        // after its #version and #extension lines.  If a file cannot be
+        // read, finish() fails.
+        RenderProgram(const char *vsh_fname, const char *fsh_fname,
+                      const std::string &defines = "");
+        ~RenderProgram(void);
+
+        // Only allowed before build()
+        void bind_attrib(const char *name, GLuint index);
+        void bind_frag(const char *name, GLuint index);
+
+        // Loads the program from the cache or starts compiling and linking
+        // it.  ready() and finish() call it if that has not happened yet.
+        void build(void);
+        // Whether finish() would not block
+        bool ready(void);
+        // Waits for the program to be built; returns false (after printing
+        // the log) if that failed.  Has to be called before the program is
+        // used.
+        bool finish(void);
+
+        void use(void);
+
+        template<typename T> class Uniform {
+            public:
+                Uniform(GLint loc): location(loc) {}
+                Uniform &operator=(const T &value);
+
+            private:
+                GLint location;
+        };
+
+        // Sets the uniform in the program currently in use (textures are
+        // bound to their TMU)
+        template<typename T> Uniform<T> uniform(const char *name)
+        { return Uniform<T>(glGetUniformLocation(id, name)); }
+
+        GLuint glid(void) const { return id; }
+
+    private:
+        GLuint id = 0;
+        // Until finish() has been called (0 if loaded from the cache)
+        GLuint vsh = 0, fsh = 0;
+        bool started = false, pending = false, failed = false;
+        std::string vsh_name, fsh_name, vsh_source, fsh_source;
+        std::vector<std::pair<std::string, GLuint>> attribs, frags;
+
+        // Everything that goes into the program binary
+        std::string cache_key(void) const;
+        bool check_shader(GLuint sh, const std::string &fname);
+};
+
+
+template<> RenderProgram::Uniform<float> &
+    RenderProgram::Uniform<float>::operator=(const float &value);
+template<> RenderProgram::Uniform<int32_t> &
+    RenderProgram::Uniform<int32_t>::operator=(const int32_t &value);
+template<> RenderProgram::Uniform<dake::math::mat3> &
+    RenderProgram::Uniform<dake::math::mat3>::operator=(
+        const dake::math::mat3 &value);
+template<> RenderProgram::Uniform<dake::math::mat4> &
+    RenderProgram::Uniform<dake::math::mat4>::operator=(
+        const dake::math::mat4 &value);
+template<> RenderProgram::Uniform<dake::gl::texture> &
+    RenderProgram::Uniform<dake::gl::texture>::operator=(
+        const dake::gl::texture &value);
+template<> RenderProgram::Uniform<dake::gl::array_texture> &
+    RenderProgram::Uniform<dake::gl::array_texture>::operator=(
+        const dake::gl::array_texture &value);
+
+#endif
@@ -0,0 +1,192 @@
+#version 330 core
+#extension GL_ARB_compute_shader: require
+#extension GL_ARB_shader_image_load_store: require
+#extension GL_ARB_shader_storage_buffer_object: require
+#extension GL_ARB_shading_language_420pack: require
+#extension GL_ARB_shading_language_packing: require
+
+
+// Resolves the linked list A-buffer (see draw_abuf1_frag.glsl) one 8x8 tile
+// per work group: All of the tile's fragments are loaded into shared memory
+// and sorted together with a bitonic sort, using keys which sort by pixel
+// first and by depth (back to front) second.
+//
+// The tiles are taken from one bin of classify_abuf_comp.glsl; K (the longest
+// list in that bin) is defined by the loader.  Tiles of the last bin may
+// exceed K or their shared memory, those fall back to the bounded per-pixel
+// sort.
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (r32ui, binding = 0) uniform readonly uimage2D head;
+layout (rgba8, binding = 1) uniform writeonly image2D result;
+uniform sampler2D accum, transp;
+
+// NODE is defined by the loader (see abuf_nodes.glsl)
+layout (std430, binding = 0) buffer node_buffer {
+    NODE nodes[];
+};
+
+layout (std430, binding = 1) buffer tile_buffer {
+    uint tiles[];
+};
+
+uniform uint tile_offset;
+
+
+#define PIXELS 64u
+#if K > 32
+#define TILE_FRAGMENTS 2048u
+#else
+#define TILE_FRAGMENTS (PIXELS * uint(K))
+#endif
+
+// The lower 26 bits of a key are the inverted depth, the upper six the pixel
+#define DEPTH_BITS 26
+#define DEPTH_MAX 0x3ffffffu
+
+#ifndef EPSILON
+#define EPSILON 0.0001
+#endif
+
+
+shared uint counts[PIXELS];
+// x: key, y: color
+shared uvec2 fragments[TILE_FRAGMENTS];
+
+
+void main(void)
+{
+    uint tile = tiles[tile_offset + gl_WorkGroupID.x];
+    ivec2 pix = ivec2(tile & 0xffffu, tile >> 16) * 8
+              + ivec2(gl_LocalInvocationID.xy);
+    uint local = gl_LocalInvocationIndex;
+    bool inside = all(lessThan(pix, textureSize(accum, 0)));
+
+    // See draw_abuf1_frag.glsl
+    vec4 tail_acc = vec4(0.0);
+    float tail_transp = 1.0;
+    uint first = 0u;
+
+    if (inside) {
+        tail_acc = texelFetch(accum, pix, 0);
+        tail_transp = texelFetch(transp, pix, 0).r;
+        first = imageLoad(head, pix).r;
+    }
+
+    uint n = 0u;
+    for (uint ei = first; ei != 0u; ei = node_next(nodes[ei - 1u])) {
+        n++;
+    }
+
+    counts[local] = n;
+    barrier();
+
+    uint offset = 0u, total = 0u;
+    for (uint i = 0u; i < PIXELS; i++) {
+        offset += i < local ? counts[i] : 0u;
+        total += counts[i];
+    }
+
+    vec4 color = vec4(tail_acc.rgb / max(EPSILON, tail_acc.a), 1.0)
+               * (1.0 - tail_transp);
+
+#if K > 32
+    if (total <= TILE_FRAGMENTS) {
+#else
+    {
+#endif
+        uint i = offset;
+        for (uint ei = first; ei != 0u; i++) {
+            NODE element = nodes[ei - 1u];
+            ei = node_next(element);
+
+            // Never 0, so no key can be all ones (that is the padding)
+            uint depth = uint(node_depth(element) * float(DEPTH_MAX - 1u)) + 1u;
+            fragments[i] = uvec2((local << DEPTH_BITS) | (DEPTH_MAX - depth),
+                                 node_color(element));
+        }
+
+        uint sort_size = 1u;
+        while (sort_size < total) {
+            sort_size <<= 1;
+        }
+
+        for (uint j = total + local; j < sort_size; j += PIXELS) {
+            fragments[j] = uvec2(0xffffffffu, 0u);
+        }
+
+        for (uint k = 2u; k <= sort_size; k <<= 1) {
+            for (uint j = k >> 1; j > 0u; j >>= 1) {
+                barrier();
+
+                for (uint a = local; a < sort_size; a += PIXELS) {
+                    uint b = a ^ j;
+                    if (b > a) {
+                        uvec2 fa = fragments[a], fb = fragments[b];
+                        bool ascending = (a & k) == 0u;
+                        if ((fa.x > fb.x) == ascending) {
+                            fragments[a] = fb;
+                            fragments[b] = fa;
+                        }
+                    }
+                }
+            }
+        }
+        barrier();
+
+        for (uint i = offset; i < offset + n; i++) {
+            vec4 fc = unpackUnorm4x8(fragments[i].y);
+            color = fc + (1.0 - fc.a) * color;
+        }
+    }
+#if K > 32
+    else {
+        // Same as draw_abuf1_frag.glsl
+        int m = 0;
+        uvec2 sorted[K];
+        for (uint ei = first; ei != 0u;) {
+            NODE element = nodes[ei - 1u];
+            uvec2 f = uvec2(node_color(element),
+                            floatBitsToUint(node_depth(element)));
+            ei = node_next(element);
+
+            if (m == K) {
+                uvec2 evict = f;
+                if (f.y < sorted[0].y) {
+                    evict = sorted[0];
+                    for (int j = 1; j < K; j++) {
+                        sorted[j - 1] = sorted[j];
+                    }
+                    m--;
+                }
+
+                vec4 fc = unpackUnorm4x8(evict.x);
+                tail_acc += fc;
+                tail_transp *= 1.0 - fc.a;
+
+                if (m == K) {
+                    continue;
+                }
+            }
+
+            int j;
+            for (j = m; j > 0 && sorted[j - 1].y < f.y; j--) {
+                sorted[j] = sorted[j - 1];
+            }
+            sorted[j] = f;
+            m++;
+        }
+
+        color = vec4(tail_acc.rgb / max(EPSILON, tail_acc.a), 1.0)
+              * (1.0 - tail_transp);
+        for (int i = 0; i < m; i++) {
+            vec4 fc = unpackUnorm4x8(sorted[i].x);
+            color = fc + (1.0 - fc.a) * color;
+        }
+    }
+#endif
+
+    if (inside) {
+        imageStore(result, pix, color);
+    }
+}
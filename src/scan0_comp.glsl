@@ -0,0 +1,78 @@
+#version 330 core
+#extension GL_ARB_compute_shader: require
+#extension GL_ARB_shader_storage_buffer_object: require
+#extension GL_ARB_shading_language_420pack: require
+
+
+// Exclusive prefix sum over one block of 2 * 512 values (Blelloch); the
+// block's total goes to sums[]
+layout (local_size_x = 512) in;
+
+layout (std430, binding = 0) buffer input_buffer {
+    uint values[];
+};
+
+layout (std430, binding = 1) buffer output_buffer {
+    uint prefix[];
+};
+
+layout (std430, binding = 2) buffer sums_buffer {
+    uint sums[];
+};
+
+uniform uint count;
+
+
+#define N 1024u
+
+
+shared uint temp[N];
+
+
+void main(void)
+{
+    uint t = gl_LocalInvocationID.x;
+    uint a = gl_WorkGroupID.x * N + t;
+    uint b = a + N / 2u;
+
+    temp[t]          = a < count ? values[a] : 0u;
+    temp[t + N / 2u] = b < count ? values[b] : 0u;
+
+    // Up-sweep: Build the sums of all power-of-two sized subtrees in place
+    uint offset = 1u;
+    for (uint d = N / 2u; d > 0u; d >>= 1) {
+        barrier();
+        if (t < d) {
+            uint ai = offset * (2u * t + 1u) - 1u;
+            uint bi = offset * (2u * t + 2u) - 1u;
+            temp[bi] += temp[ai];
+        }
+        offset <<= 1;
+    }
+
+    if (t == 0u) {
+        sums[gl_WorkGroupID.x] = temp[N - 1u];
+        temp[N - 1u] = 0u;
+    }
+
+    // Down-sweep: Push the prefixes back down the tree
+    for (uint d = 1u; d < N; d <<= 1) {
+        offset >>= 1;
+        barrier();
+        if (t < d) {
+            uint ai = offset * (2u * t + 1u) - 1u;
+            uint bi = offset * (2u * t + 2u) - 1u;
+            uint v = temp[ai];
+            temp[ai] = temp[bi];
+            temp[bi] += v;
+        }
+    }
+    barrier();
+
+    if (a < count) {
+        prefix[a] = temp[t];
+    }
+    if (b < count) {
+        prefix[b] = temp[t + N / 2u];
+    }
+}
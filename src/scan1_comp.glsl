@@ -0,0 +1,36 @@
+#version 330 core
+#extension GL_ARB_compute_shader: require
+#extension GL_ARB_shader_storage_buffer_object: require
+#extension GL_ARB_shading_language_420pack: require
+
+
+// Adds the scanned block totals produced by scan0_comp.glsl onto the blocks
+layout (local_size_x = 512) in;
+
+layout (std430, binding = 1) buffer output_buffer {
+    uint prefix[];
+};
+
+layout (std430, binding = 2) buffer sums_buffer {
+    uint sums[];
+};
+
+uniform uint count;
+
+
+#define N 1024u
+
+
+void main(void)
+{
+    uint a = gl_WorkGroupID.x * N + gl_LocalInvocationID.x;
+    uint b = a + N / 2u;
+    uint add = sums[gl_WorkGroupID.x];
+
+    if (a < count) {
+        prefix[a] += add;
+    }
+    if (b < count) {
+        prefix[b] += add;
+    }
+}
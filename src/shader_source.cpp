@@ -0,0 +1,91 @@
+#include <cstdio>
+#include <map>
+#include <string>
+
+#include <dake/gl/gl.hpp>
+
+#include "shader_source.hpp"
+
+
+bool load_shader_source(const char *fname, const std::string &defines,
+                        std::string &out)
+{
+    FILE *fp = fopen(fname, "rb");
+    if (!fp) {
+        perror(fname);
+        return false;
+    }
+
+    out.clear();
+
+    char buf[4096];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        out.append(buf, len);
+    }
+
+    fclose(fp);
+
+    // Skip #version, #extension and empty lines
+    size_t pos = 0;
+    while (pos < out.size()) {
+        size_t eol = out.find('\n', pos);
+        if (eol == std::string::npos) {
+            break;
+        }
+
+        if (eol != pos && out.compare(pos, 8, "#version") &&
+            out.compare(pos, 10, "#extension"))
+        {
+            break;
+        }
+        pos = eol + 1;
+    }
+    out.insert(pos, defines);
+
+    return true;
+}
+
+
+ShaderDefines &ShaderDefines::set(const std::string &name,
+                                  const std::string &value)
+{
+    values[name] = value;
+    return *this;
+}
+
+
+ShaderDefines &ShaderDefines::set(const std::string &name, int value)
+{
+    return set(name, std::to_string(value));
+}
+
+
+std::string ShaderDefines::str(void) const
+{
+    std::string out;
+    for (const auto &v: values) {
+        out += "#define " + v.first + (v.second.empty() ? "" : " ")
+             + v.second + "\n";
+    }
+    return out;
+}
+
+
+GLuint ShaderCache::get(GLenum type, const std::string &source)
+{
+    std::string key = std::to_string(type) + "\n" + source;
+
+    auto it = shaders.find(key);
+    if (it != shaders.end()) {
+        return it->second;
+    }
+
+    GLuint sh = glCreateShader(type);
+    const char *src_ptr = source.c_str();
+    glShaderSource(sh, 1, &src_ptr, nullptr);
+    glCompileShader(sh);
+    shaders[key] = sh;
+
+    return sh;
+}
@@ -0,0 +1,49 @@
+#ifndef SHADER_SOURCE_HPP
+#define SHADER_SOURCE_HPP
+
+#include <map>
+#include <string>
+
+#include <dake/gl/gl.hpp>
+
+
+// Reads the GLSL source @fname into @out and inserts @defines after its
+// #version and #extension lines.  Returns false (after printing an error) if
+// the file cannot be read.
+bool load_shader_source(const char *fname, const std::string &defines,
+                        std::string &out);
+
+
+// Compile-time constants of a shader variant.  They are emitted sorted by
+// name, so the same set always results in the same source.  Tuning constants
+// have defaults in the shaders (#ifndef ... #define), so they only need to be
+// set to override them.
+class ShaderDefines {
+    public:
+        ShaderDefines &set(const std::string &name,
+                           const std::string &value = "");
+        ShaderDefines &set(const std::string &name, int value);
+
+        // The #define lines
+        std::string str(void) const;
+
+    private:
+        std::map<std::string, std::string> values;
+};
+
+
+// Compiles every variant (shader type and source, including its defines) only
+// once and shares it between all programs using it.  The compile status is
+// only checked by the programs when they are linked, so the driver can
+// compile in the background.
+class ShaderCache {
+    public:
+        GLuint get(GLenum type, const std::string &source);
+
+        size_t size(void) const { return shaders.size(); }
+
+    private:
+        std::map<std::string, GLuint> shaders;
+};
+
+#endif
@@ -1,9 +1,20 @@
+#include <algorithm>
 #include <chrono>
+#include <cinttypes>
 #include <cmath>
 #include <cstdint>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
 #include <getopt.h>
+#include <initializer_list>
+#include <map>
 #include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include <SDL2/SDL.h>
@@ -11,13 +22,31 @@
 #include <dake/gl/gl.hpp>
 #include <dake/gl/framebuffer.hpp>
 #include <dake/gl/obj.hpp>
-#include <dake/gl/shader.hpp>
 #include <dake/gl/texture.hpp>
 #include <dake/gl/vertex_array.hpp>
 #include <dake/gl/vertex_attrib.hpp>
 #include <dake/helper/function.hpp>
 #include <dake/math.hpp>
 
+#include "abuffer_resolve.hpp"
+#include "fragment_pool.hpp"
+#include "gpu_memory.hpp"
+#include "gpu_timer.hpp"
+#include "image.hpp"
+#include "mesh_cache.hpp"
+#include "multisample.hpp"
+#include "obj_loader.hpp"
+#include "object_section.hpp"
+#include "peel_query.hpp"
+#include "ping_pong.hpp"
+#include "prefix_sum.hpp"
+#include "program_cache.hpp"
+#include "readback.hpp"
+#include "reference.hpp"
+#include "render_program.hpp"
+#include "shader_source.hpp"
+#include "vertex_cache.hpp"
+
 
 static int WIDTH = 1280, HEIGHT = 720;
 
@@ -27,21 +56,22 @@ using namespace dake::helper;
 using namespace dake::math;
 
 
-struct ObjectSection {
-    vertex_array *va;
-    mat4 rel_mv;
-};
-
-
 static void ss_refract(framebuffer *fbs, const mat4 &mv, const mat4 &proj,
-                      program &draw_bf_prg, program &draw_ff_prg,
+                      RenderProgram &draw_bf_prg, RenderProgram &draw_ff_prg,
                        const std::vector<ObjectSection> &sections,
                        GLenum draw_mode)
 {
-    glEnable(GL_CULL_FACE);
-    glEnable(GL_DEPTH_TEST);
+    GPUScope scope("ss_refract");
+    GPUScope pass("blit");
 
     fbs[1].bind();
+    glClear(GL_DEPTH_BUFFER_BIT);
+    fbs[0].blit();
+
+    pass.next("back faces");
+
+    glEnable(GL_CULL_FACE);
+    glEnable(GL_DEPTH_TEST);
 
     glCullFace(GL_FRONT);
 
@@ -52,9 +82,11 @@ static void ss_refract(framebuffer *fbs, const mat4 &mv, const mat4 &proj,
     for (const ObjectSection &sec: sections) {
         draw_bf_prg.uniform<mat3>("mat_nrp") = mat3(proj) * (mat3(sec.rel_mv) * mat3(mv)).transposed_inverse();
         draw_bf_prg.uniform<mat4>("mat_mvp") = proj * sec.rel_mv * mv;
-        sec.va->draw(draw_mode);
+        sec.draw(draw_mode);
     }
 
+    pass.next("front faces");
+
     fbs[0].bind();
 
     glCullFace(GL_BACK);
@@ -67,9 +99,11 @@ static void ss_refract(framebuffer *fbs, const mat4 &mv, const mat4 &proj,
     for (const ObjectSection &sec: sections) {
         draw_ff_prg.uniform<mat3>("mat_nrp") = mat3(proj) * (mat3(sec.rel_mv) * mat3(mv)).transposed_inverse();
         draw_ff_prg.uniform<mat4>("mat_mvp") = proj * sec.rel_mv * mv;
-        sec.va->draw(draw_mode);
+        sec.draw(draw_mode);
     }
 
+    pass.next("blit");
+
     framebuffer::unbind();
     fbs[0].blit(0, 0, WIDTH, HEIGHT, 0, 0, WIDTH, HEIGHT);
 
@@ -78,30 +112,71 @@ static void ss_refract(framebuffer *fbs, const mat4 &mv, const mat4 &proj,
 }
 
 
+// Copies the color of all pixels which were drawn to in the previous pass
+// (i.e., whose depth in @prev is not the clear value 0), but not in the
+// current one (whose depth is still 0 then), from @prev.  That is all that has
+// to be copied to carry the result of one pass on to the next.  Expects
+// glDepthFunc(GL_GREATER) and face culling to be enabled.
+static void carry_undrawn(framebuffer &prev, RenderProgram &carry_prg,
+                          vertex_array &quad_va)
+{
+    glDisable(GL_CULL_FACE);
+    glDepthFunc(GL_EQUAL);
+    glDepthMask(false);
+    // Puts the quad at the clear depth
+    glDepthRange(0.0, 0.0);
+
+    prev[0].bind();
+    prev.depth().bind();
+    carry_prg.use();
+    carry_prg.uniform<texture>("fb") = prev[0];
+    carry_prg.uniform<texture>("depth") = prev.depth();
+    quad_va.draw(GL_TRIANGLE_STRIP);
+
+    glDepthRange(0.0, 1.0);
+    glDepthMask(true);
+    glDepthFunc(GL_GREATER);
+    glEnable(GL_CULL_FACE);
+}
+
+
+// Every one of the (at most) @passes passes peels a back and a front face.
 static void ss_refract_dp(framebuffer *fbs, const mat4 &mv, const mat4 &proj,
-                          program &draw_bfdp_prg, program &draw_ffdp_prg,
-                          int layer,
+                          RenderProgram &draw_bfdp_prg,
+                          RenderProgram &draw_ffdp_prg,
+                          RenderProgram &carry_prg, PeelQuery &query,
+                          int passes, int layer,
                           const std::vector<ObjectSection> &sections,
-                          GLenum draw_mode)
+                          GLenum draw_mode, vertex_array &quad_va)
 {
+    GPUScope scope("ss_refract_dp");
+
+    if (layer != -1) {
+        // Nothing is carried over, so start with the background in both
+        GPUScope gpu_pass("blit");
+
+        fbs[1].bind();
+        fbs[0].blit();
+    }
+
     glEnable(GL_CULL_FACE);
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_GREATER);
     glClearDepth(0.f);
 
-    for (int pass = 0; pass < 4; pass++) {
+    for (int pass = 0; pass < passes; pass++) {
+        GPUScope gpu_pass("back faces");
+
         fbs[1].bind();
-        if (layer == -1) {
-            // If no fragments are drawn to a certain pixel, it will have to
-            // remain unchanged from the previous pass, and not from the
-            // pre-previous
-            fbs[0].blit();
-        } else {
+        if (layer != -1) {
             bool hit = layer == pass;
             glColorMask(hit, hit, hit, hit);
         }
         glClear(GL_DEPTH_BUFFER_BIT);
 
+        // If there are no back faces left, there are no front faces either
+        query.begin(pass);
+
         glCullFace(GL_FRONT);
 
         fbs[0][0].bind();
@@ -112,13 +187,19 @@ static void ss_refract_dp(framebuffer *fbs, const mat4 &mv, const mat4 &proj,
         for (const ObjectSection &sec: sections) {
             draw_bfdp_prg.uniform<mat3>("mat_nrp") = mat3(proj) * (mat3(sec.rel_mv) * mat3(mv)).transposed_inverse();
             draw_bfdp_prg.uniform<mat4>("mat_mvp") = proj * sec.rel_mv * mv;
-            sec.va->draw(draw_mode);
+            sec.draw(draw_mode);
         }
 
-        fbs[0].bind();
+        query.end();
+
         if (layer == -1) {
-            fbs[1].blit();
+            gpu_pass.next("carry");
+            carry_undrawn(fbs[0], carry_prg, quad_va);
         }
+
+        gpu_pass.next("front faces");
+
+        fbs[0].bind();
         glClear(GL_DEPTH_BUFFER_BIT);
 
         glCullFace(GL_BACK);
@@ -131,10 +212,15 @@ static void ss_refract_dp(framebuffer *fbs, const mat4 &mv, const mat4 &proj,
         for (const ObjectSection &sec: sections) {
             draw_ffdp_prg.uniform<mat3>("mat_nrp") = mat3(proj) * (mat3(sec.rel_mv) * mat3(mv)).transposed_inverse();
             draw_ffdp_prg.uniform<mat4>("mat_mvp") = proj * sec.rel_mv * mv;
-            sec.va->draw(draw_mode);
+            sec.draw(draw_mode);
+        }
+
+        if (layer == -1) {
+            gpu_pass.next("carry");
+            carry_undrawn(fbs[1], carry_prg, quad_va);
         }
 
-        if (pass == layer) {
+        if (pass == layer || !query.more_layers(pass)) {
             break;
         }
     }
@@ -144,144 +230,415 @@ static void ss_refract_dp(framebuffer *fbs, const mat4 &mv, const mat4 &proj,
     glDepthFunc(GL_LESS);
     glClearDepth(1.f);
 
+    GPUScope pass("blit");
+
     framebuffer::unbind();
     fbs[0].blit(0, 0, WIDTH, HEIGHT, 0, 0, WIDTH, HEIGHT);
 }
 
 
-static void draw_with_alpha(program &prg, const mat4 &mv, const mat4 &proj,
-                            float alpha,
+static void draw_with_alpha(RenderProgram &prg, const mat4 &mv,
+                            const mat4 &proj, float alpha,
                             const std::vector<ObjectSection> &sections,
                             GLenum draw_mode)
 {
     for (const ObjectSection &sec: sections) {
         prg.uniform<float>("alpha") = alpha;
         prg.uniform<mat4>("mat_mvp") = proj * sec.rel_mv * mv;
-        sec.va->draw(draw_mode);
+        sec.draw(draw_mode);
     }
 }
 
 
-static void blend_alpha_dp(framebuffer *fbs, const mat4 &mv, const mat4 &proj,
-                           program &prg, int layer, float alpha,
+// Front to back depth peeling of (at most) @passes layers.  The two
+// framebuffers of @fb_dp share the accumulated color (RGBA16F); the depth of
+// the layer to be peeled (R32F) is written to one and read from the other,
+// alternately, so no pass has to copy anything.  Every pass composites the
+// layer peeled by the previous one, so there is one more geometry pass than
+// there are layers.  In the end, the accumulated color is blended over the
+// background.
+static void blend_alpha_dp(PingPongFramebuffer &fb_dp, const mat4 &mv,
+                           const mat4 &proj, RenderProgram &prg,
+                           RenderProgram &blend_prg,
+                           PeelQuery &query, int passes, int layer,
+                           float alpha,
                            const std::vector<ObjectSection> &sections,
-                           GLenum draw_mode)
+                           GLenum draw_mode, vertex_array &quad_va)
 {
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_GREATER);
-    glClearDepth(0.f);
+    GPUScope scope("blend_alpha_dp");
+    GPUScope gpu_pass("clear");
 
-    int fb = 1;
+    static const float zero[] = {0.f, 0.f, 0.f, 0.f};
+    // Nothing has been peeled before the first pass
+    static const float min_depth[] = {-1.f, 0.f, 0.f, 0.f};
+    static const float max_depth[] = {1.f, 0.f, 0.f, 0.f};
 
-    for (int pass = 0; pass < 8; pass++) {
-        fbs[fb].bind();
+    fb_dp.bind(1);
+    glClearBufferfv(GL_COLOR, 0, zero);
+    glClearBufferfv(GL_COLOR, 1, min_depth);
 
-        if (layer == -1) {
-            // If no fragments are drawn to a certain pixel, it will have to
-            // remain unchanged from the previous pass, and not from the
-            // pre-previous
-            fbs[!fb].blit();
-        } else {
-            bool hit = layer == pass;
-            glColorMask(hit, hit, hit, hit);
-        }
+    glEnable(GL_BLEND);
+    glBlendEquation(GL_FUNC_ADD);
+    glBlendEquationi(1, GL_MIN);
+    // Front to back, i.e. under the accumulated color
+    glBlendFunci(0, GL_ONE_MINUS_DST_ALPHA, GL_ONE);
 
-        glClear(GL_DEPTH_BUFFER_BIT);
+    int fb = 0;
+
+    for (int pass = 0; pass <= passes; pass++) {
+        gpu_pass.next("peel");
 
-        fbs[!fb][0].bind();
-        fbs[!fb].depth().bind();
+        fb_dp.bind(fb);
+        glClearBufferfv(GL_COLOR, 1, max_depth);
+
+        fb_dp.separate(!fb, 0).bind();
         prg.use();
-        prg.uniform<texture>("fb") = fbs[!fb][0];
-        prg.uniform<texture>("depth") = fbs[!fb].depth();
+        prg.uniform<texture>("depth") = fb_dp.separate(!fb, 0);
+        prg.uniform<int32_t>("composite") = layer < 0 || layer == pass - 1;
+        query.begin(pass);
         draw_with_alpha(prg, mv, proj, alpha, sections, draw_mode);
+        query.end();
 
         fb = !fb;
 
-        if (pass == layer) {
+        if (pass == layer + 1 && layer >= 0) {
+            break;
+        }
+        if (!query.more_layers(pass)) {
             break;
         }
     }
 
-    glDisable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LESS);
-    glClearDepth(1.f);
+    gpu_pass.next("composite");
+
+    glBlendEquation(GL_FUNC_ADD);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+    framebuffer::unbind();
+    fb_dp.shared(0).bind();
+    blend_prg.use();
+    blend_prg.uniform<texture>("layer") = fb_dp.shared(0);
+    quad_va.draw(GL_TRIANGLE_STRIP);
+
+    glDisable(GL_BLEND);
+}
+
+
+// Dual depth peeling: Every pass peels both the nearest and the farthest
+// remaining layer, so this needs only half the geometry passes of
+// blend_alpha_dp() for the same number of layers.  @fb_ddp are two
+// framebuffers (alternately read and written) with the depth range (RG32F),
+// the front and the back layer of a pass as their color attachments.  Back
+// layers are blended over the background (straight in the window) after every
+// pass, front layers under the ones in @fb_front, which is blended over the
+// window in the end.
+//
+// @layer counts like in blend_alpha_dp(), i.e. from the front.
+static void blend_alpha_ddp(framebuffer *fb_ddp, framebuffer &fb_front,
+                            const mat4 &mv,
+                            const mat4 &proj, RenderProgram &init_prg,
+                            RenderProgram &peel_prg, RenderProgram &blend_prg,
+                            PeelQuery &query, int passes, int layer,
+                            float alpha,
+                            const std::vector<ObjectSection> &sections,
+                            GLenum draw_mode, vertex_array &quad_va)
+{
+    GPUScope scope("blend_alpha_ddp");
+    GPUScope gpu_pass("init");
+
+    static const float min_depth[] = {-1.f, -1.f, 0.f, 0.f};
+    static const float zero[] = {0.f, 0.f, 0.f, 0.f};
+
+    // The pass showing the requested layer, and whether it is a front layer
+    int layer_pass = layer < passes ? layer : 2 * passes - 1 - layer;
+    bool layer_front = layer < passes;
+
+    fb_front.bind();
+    glClearBufferfv(GL_COLOR, 0, zero);
+
+    fb_ddp[0].bind();
+    glClearBufferfv(GL_COLOR, 0, min_depth);
+    glClearBufferfv(GL_COLOR, 1, zero);
+    glClearBufferfv(GL_COLOR, 2, zero);
+
+    glEnable(GL_BLEND);
+    glBlendEquation(GL_MAX);
+
+    init_prg.use();
+    draw_with_alpha(init_prg, mv, proj, alpha, sections, draw_mode);
+
+    int fb = 1;
+
+    for (int pass = 0; pass < passes; pass++) {
+        gpu_pass.next("peel");
+
+        fb_ddp[fb].bind();
+        glClearBufferfv(GL_COLOR, 0, min_depth);
+        glClearBufferfv(GL_COLOR, 1, zero);
+        glClearBufferfv(GL_COLOR, 2, zero);
+
+        glBlendEquation(GL_MAX);
+
+        fb_ddp[!fb][0].bind();
+        peel_prg.use();
+        peel_prg.uniform<texture>("depth") = fb_ddp[!fb][0];
+        query.begin(pass);
+        draw_with_alpha(peel_prg, mv, proj, alpha, sections, draw_mode);
+        query.end();
+
+        gpu_pass.next("blend");
+
+        glBlendEquation(GL_FUNC_ADD);
+        blend_prg.use();
+
+        if (layer < 0 || (!layer_front && pass == layer_pass)) {
+            glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+            framebuffer::unbind();
+            fb_ddp[fb][2].bind();
+            blend_prg.uniform<texture>("layer") = fb_ddp[fb][2];
+            quad_va.draw(GL_TRIANGLE_STRIP);
+        }
+
+        if (layer < 0 || (layer_front && pass == layer_pass)) {
+            glBlendFunc(GL_ONE_MINUS_DST_ALPHA, GL_ONE);
+
+            fb_front.bind();
+            fb_ddp[fb][1].bind();
+            blend_prg.uniform<texture>("layer") = fb_ddp[fb][1];
+            quad_va.draw(GL_TRIANGLE_STRIP);
+        }
+
+        fb = !fb;
+
+        if (pass == layer_pass || !query.more_layers(pass)) {
+            break;
+        }
+    }
+
+    gpu_pass.next("blend front");
+
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
 
     framebuffer::unbind();
-    fbs[!fb].blit(0, 0, WIDTH, HEIGHT, 0, 0, WIDTH, HEIGHT);
+    fb_front[0].bind();
+    blend_prg.use();
+    blend_prg.uniform<texture>("layer") = fb_front[0];
+    quad_va.draw(GL_TRIANGLE_STRIP);
+
+    glDisable(GL_BLEND);
 }
 
 
-static void simple_draw(const mat4 &mv, const mat4 &proj, program &prg,
+static void simple_draw(const mat4 &mv, const mat4 &proj, RenderProgram &prg,
                         float alpha, const std::vector<ObjectSection> &sections,
                         GLenum draw_mode)
 {
+    GPUScope scope("simple_draw");
+
     prg.use();
     draw_with_alpha(prg, mv, proj, alpha, sections, draw_mode);
 }
 
 
-static void abuffer_ll(const mat4 &mv, const mat4 &proj, program &abuf0_prg,
-                       program &abuf1_prg, texture &head, texture &list,
-                       int layer, float alpha,
+// Clears the accumulated color to 0 and the transparency to 1, and binds the
+// framebuffer
+static void clear_bamc(framebuffer &fb_bamc)
+{
+    fb_bamc.mask(1);
+    fb_bamc.bind();
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    fb_bamc.unmask(1);
+    fb_bamc.mask(0);
+    fb_bamc.bind();
+    glClearColor(1.f, 0.f, 0.f, 0.f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glClearColor(0.f, 0.f, 0.f, 0.f);
+
+    fb_bamc.unmask(0);
+    fb_bamc.bind();
+}
+
+
+// If @resolve is given (and no single layer is to be shown), the lists are
+// resolved by its compute shaders into @result, which is then composited by
+// @abuf2_prg; otherwise, @abuf1_prg resolves them directly.
+static void abuffer_ll(framebuffer &fb_tail, const mat4 &mv,
+                       const mat4 &proj, RenderProgram &abuf0_prg,
+                       RenderProgram &abuf1_prg, ABufferResolve *resolve,
+                       RenderProgram &abuf2_prg, texture &head, texture &result,
+                       FragmentPool &pool, int layer, float alpha,
                        const std::vector<ObjectSection> &sections,
                        GLenum draw_mode, vertex_array &quad_va)
 {
-    static GLuint atomic_counter_buffer;
+    GPUScope scope("abuffer_ll");
+    GPUScope pass("clear");
 
-    if (!atomic_counter_buffer) {
-        glGenBuffers(1, &atomic_counter_buffer);
-        glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, atomic_counter_buffer);
-        glBufferStorage(GL_ATOMIC_COUNTER_BUFFER, 4, nullptr, 0);
-        glBindBufferRange(GL_ATOMIC_COUNTER_BUFFER, 0, atomic_counter_buffer, 0, 4);
-    }
+    pool.begin_frame();
 
     //head.clear();
     glClearTexImage(head.glid(), 0, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
 
     texture::unbind(head.tmu());
-    texture::unbind(list.tmu());
 
-    glBindImageTexture(0, head.glid(), 0, false, 0, GL_WRITE_ONLY, GL_R32UI);
-    glBindImageTexture(1, list.glid(), 0, false, 0, GL_WRITE_ONLY, GL_RGBA32UI);
+    glBindImageTexture(0, head.glid(), 0, false, 0, GL_READ_WRITE, GL_R32UI);
 
-    glClearBufferData(GL_ATOMIC_COUNTER_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    // Fragments which do not fit into the pool are accumulated here (like in
+    // blend_bamc())
+    clear_bamc(fb_tail);
 
-    glColorMask(false, false, false, false);
+    pass.next("geometry");
+
+    glEnable(GL_BLEND);
+    glBlendFunci(0, GL_ONE, GL_ONE);
+    glBlendFunci(1, GL_ZERO, GL_SRC_COLOR);
 
     abuf0_prg.use();
     abuf0_prg.uniform<int32_t>("head") = 0;
-    abuf0_prg.uniform<int32_t>("list") = 1;
+    abuf0_prg.uniform<int32_t>("node_count") = pool.capacity();
     draw_with_alpha(abuf0_prg, mv, proj, alpha, sections, draw_mode);
 
-    glColorMask(true, true, true, true);
+    pool.end_frame();
+
+    pass.next("resolve");
+
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT
+                    | GL_SHADER_STORAGE_BARRIER_BIT);
 
-    glEnable(GL_BLEND);
     glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
 
-    glBindImageTexture(0, head.glid(), 0, false, 0, GL_READ_ONLY, GL_R32UI);
-    glBindImageTexture(1, list.glid(), 0, false, 0, GL_READ_ONLY, GL_RGBA32UI);
+    framebuffer::unbind();
+
+    fb_tail[0].bind();
+    fb_tail[1].bind();
+
+    if (resolve && layer < 0) {
+        texture::unbind(result.tmu());
+        glBindImageTexture(1, result.glid(), 0, false, 0, GL_WRITE_ONLY, GL_RGBA8);
+
+        resolve->run(fb_tail[0].tmu(), fb_tail[1].tmu());
+
+        glBindImageTexture(1, 0, 0, false, 0, 0, GL_RGBA8);
 
-    head.bind();
-    abuf1_prg.use();
-    abuf1_prg.uniform<int32_t>("head") = 0;
-    abuf1_prg.uniform<int32_t>("list") = 1;
-    if (layer >= 0) {
-        abuf1_prg.uniform<int32_t>("layer") = layer;
+        pass.next("composite");
+
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+        result.bind();
+        abuf2_prg.use();
+        abuf2_prg.uniform<texture>("result") = result;
+        quad_va.draw(GL_TRIANGLE_STRIP);
+    } else {
+        abuf1_prg.use();
+        abuf1_prg.uniform<int32_t>("head") = 0;
+        if (layer >= 0) {
+            abuf1_prg.uniform<int32_t>("layer") = layer;
+        } else {
+            abuf1_prg.uniform<texture>("accum") = fb_tail[0];
+            abuf1_prg.uniform<texture>("transp") = fb_tail[1];
+        }
+        quad_va.draw(GL_TRIANGLE_STRIP);
     }
-    quad_va.draw(GL_TRIANGLE_STRIP);
 
     glBindImageTexture(0, 0, 0, false, 0, 0, GL_R32UI);
-    glBindImageTexture(1, 0, 0, false, 0, 0, GL_RGBA32UI);
+
+    glDisable(GL_BLEND);
+}
+
+
+// Like abuffer_ll(), but instead of linked lists, every pixel's fragments are
+// stored contiguously: A first geometry pass only counts the fragments per
+// pixel, a prefix sum over those counts gives every pixel's offset into the
+// pool, and a second geometry pass stores the fragments there.
+static void abuffer_ps(framebuffer &fb_tail, const mat4 &mv,
+                       const mat4 &proj, RenderProgram &abps0_prg,
+                       RenderProgram &abps1_prg, RenderProgram &abps2_prg,
+                       PrefixSum &scan, GLuint counts, GLuint offsets,
+                       FragmentPool &pool, float alpha,
+                       const std::vector<ObjectSection> &sections,
+                       GLenum draw_mode, vertex_array &quad_va)
+{
+    GPUScope scope("abuffer_ps");
+    GPUScope pass("clear");
+
+    pool.begin_frame();
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, counts);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER,
+                      GL_UNSIGNED_INT, nullptr);
+
+    clear_bamc(fb_tail);
+
+    pass.next("count");
+
+    glColorMask(false, false, false, false);
+
+    abps0_prg.use();
+    abps0_prg.uniform<int32_t>("width") = WIDTH;
+    draw_with_alpha(abps0_prg, mv, proj, alpha, sections, draw_mode);
+
+    glColorMask(true, true, true, true);
+
+    pass.next("scan");
+
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    scan.run(counts, offsets, WIDTH * HEIGHT);
+
+    // The total is the exact number of nodes needed
+    pool.end_frame(scan.total_buffer());
+
+    pass.next("geometry");
+
+    pool.bind();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, counts);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, offsets);
+
+    glEnable(GL_BLEND);
+    glBlendFunci(0, GL_ONE, GL_ONE);
+    glBlendFunci(1, GL_ZERO, GL_SRC_COLOR);
+
+    abps1_prg.use();
+    abps1_prg.uniform<int32_t>("width") = WIDTH;
+    abps1_prg.uniform<int32_t>("node_count") = pool.capacity();
+    draw_with_alpha(abps1_prg, mv, proj, alpha, sections, draw_mode);
+
+    pass.next("resolve");
+
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+    framebuffer::unbind();
+
+    fb_tail[0].bind();
+    fb_tail[1].bind();
+    abps2_prg.use();
+    abps2_prg.uniform<texture>("accum") = fb_tail[0];
+    abps2_prg.uniform<texture>("transp") = fb_tail[1];
+    abps2_prg.uniform<int32_t>("width") = WIDTH;
+    abps2_prg.uniform<int32_t>("node_count") = pool.capacity();
+    quad_va.draw(GL_TRIANGLE_STRIP);
 
     glDisable(GL_BLEND);
 }
 
 
 static void blend_meshkin(framebuffer *fbs, const mat4 &mv, const mat4 &proj,
-                          program &prg, float alpha,
+                          RenderProgram &prg, float alpha,
                           const std::vector<ObjectSection> &sections,
                           GLenum draw_mode)
 {
+    GPUScope scope("blend_meshkin");
+    GPUScope pass("blit");
+
+    // The shader needs the background as a texture, but the result can go
+    // straight to the window
+    framebuffer::unbind();
+    fbs[0].blit(0, 0, WIDTH, HEIGHT, 0, 0, WIDTH, HEIGHT);
+
+    pass.next("geometry");
+
     glEnable(GL_BLEND);
     glBlendFunc(GL_ONE, GL_ONE);
 
@@ -292,34 +649,36 @@ static void blend_meshkin(framebuffer *fbs, const mat4 &mv, const mat4 &proj,
     draw_with_alpha(prg, mv, proj, alpha, sections, draw_mode);
 
     glDisable(GL_BLEND);
-
-    framebuffer::unbind();
-    fbs[1].blit(0, 0, WIDTH, HEIGHT, 0, 0, WIDTH, HEIGHT);
 }
 
 
-static void blend_bamy(framebuffer &fb_in, framebuffer &fb_bamy,
-                       const mat4 &mv, const mat4 &proj, program &prg_draw,
-                       program &prg_resolve, float alpha,
+static void blend_bamy(framebuffer &fb_bamy, const mat4 &mv,
+                       const mat4 &proj, RenderProgram &prg_draw,
+                       RenderProgram &prg_resolve, float alpha,
                        const std::vector<ObjectSection> &sections,
                        GLenum draw_mode, vertex_array &quad_va)
 {
+    GPUScope scope("blend_bamy");
+    GPUScope pass("clear");
+
     fb_bamy.bind();
-    /* We're not using the depth test anyway, so we don't need this
-     * fb_in.blit(0, 0, -1, -1, 0, 0, -1, -1, GL_DEPTH_BUFFER_BIT);
-     */
 
     glClear(GL_COLOR_BUFFER_BIT);
 
+    pass.next("geometry");
+
     glEnable(GL_BLEND);
     glBlendFunc(GL_ONE, GL_ONE);
 
     prg_draw.use();
     draw_with_alpha(prg_draw, mv, proj, alpha, sections, draw_mode);
 
+    pass.next("resolve");
+
     glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
 
-    fb_in.bind();
+    // Straight over the background in the window
+    framebuffer::unbind();
     fb_bamy[0].bind();
     fb_bamy[1].bind();
 
@@ -329,36 +688,21 @@ static void blend_bamy(framebuffer &fb_in, framebuffer &fb_bamy,
     quad_va.draw(GL_TRIANGLE_STRIP);
 
     glDisable(GL_BLEND);
-
-    framebuffer::unbind();
-    fb_in.blit(0, 0, WIDTH, HEIGHT, 0, 0, WIDTH, HEIGHT);
 }
 
 
-static void blend_bamc(framebuffer &fb_in, framebuffer &fb_bamc,
-                       const mat4 &mv, const mat4 &proj, program &prg_draw,
-                       program &prg_resolve, float alpha,
+static void blend_bamc(framebuffer &fb_bamc, const mat4 &mv,
+                       const mat4 &proj, RenderProgram &prg_draw,
+                       RenderProgram &prg_resolve, float alpha,
                        const std::vector<ObjectSection> &sections,
                        GLenum draw_mode, vertex_array &quad_va)
 {
-    /* We're not using the depth test anyway, so we don't need this
-     * fb_bamc.bind();
-     * fb_in.blit(0, 0, -1, -1, 0, 0, -1, -1, GL_DEPTH_BUFFER_BIT);
-     */
-
-    fb_bamc.mask(1);
-    fb_bamc.bind();
-    glClear(GL_COLOR_BUFFER_BIT);
+    GPUScope scope("blend_bamc");
+    GPUScope pass("clear");
 
-    fb_bamc.unmask(1);
-    fb_bamc.mask(0);
-    fb_bamc.bind();
-    glClearColor(1.f, 0.f, 0.f, 0.f);
-    glClear(GL_COLOR_BUFFER_BIT);
-    glClearColor(0.f, 0.f, 0.f, 0.f);
+    clear_bamc(fb_bamc);
 
-    fb_bamc.unmask(0);
-    fb_bamc.bind();
+    pass.next("geometry");
 
     glEnable(GL_BLEND);
     glBlendFunci(0, GL_ONE, GL_ONE);
@@ -367,9 +711,12 @@ static void blend_bamc(framebuffer &fb_in, framebuffer &fb_bamc,
     prg_draw.use();
     draw_with_alpha(prg_draw, mv, proj, alpha, sections, draw_mode);
 
+    pass.next("resolve");
+
     glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
 
-    fb_in.bind();
+    // Straight over the background in the window
+    framebuffer::unbind();
     fb_bamc[0].bind();
     fb_bamc[1].bind();
 
@@ -379,619 +726,2442 @@ static void blend_bamc(framebuffer &fb_in, framebuffer &fb_bamc,
     quad_va.draw(GL_TRIANGLE_STRIP);
 
     glDisable(GL_BLEND);
-
-    framebuffer::unbind();
-    fb_in.blit(0, 0, WIDTH, HEIGHT, 0, 0, WIDTH, HEIGHT);
 }
 
 
-static void adaptive_transp(texture &tex_a, texture &tex_d, texture *tex_l,
-                            const mat4 &mv, const mat4 &proj,
-                            program &col_vis_prg, program &draw_prg,
-                            float alpha,
-                            const std::vector<ObjectSection> &sections,
-                            GLenum draw_mode)
+// Moment-based OIT: The first pass accumulates the total absorbance into
+// @fb_moments[0] and @moments (4 or 8) of its power moments over the depth
+// into @fb_moments[1] (and [2]).  The second pass reconstructs every
+// fragment's transmittance from those and accumulates the attenuated colors
+// into @fb_accum, whose average is then blended over the background like in
+// blend_bamc().
+static void blend_mboit(framebuffer &fb_moments, framebuffer &fb_accum,
+                        int moments, const mat4 &mv, const mat4 &proj,
+                        RenderProgram &prg_moments, RenderProgram &prg_draw,
+                        RenderProgram &prg_resolve, float alpha,
+                        const std::vector<ObjectSection> &sections,
+                        GLenum draw_mode, vertex_array &quad_va)
 {
+    GPUScope scope("blend_mboit");
+    GPUScope pass("moments");
+
+    fb_moments.bind();
+    glClear(GL_COLOR_BUFFER_BIT);
+
     glEnable(GL_BLEND);
-    glBlendFunc(GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+    glBlendFunc(GL_ONE, GL_ONE);
 
-    glClearTexImage(tex_a.glid(), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-    vec4 dc(1.f, 1.f, 1.f, 1.f);
-    glClearTexImage(tex_d.glid(), 0, GL_RGBA, GL_FLOAT, &dc);
+    prg_moments.use();
+    draw_with_alpha(prg_moments, mv, proj, alpha, sections, draw_mode);
 
-    if (tex_l) {
-        glClearTexImage(tex_l->glid(), 0, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
-    }
+    pass.next("geometry");
+
+    fb_accum.bind();
+    glClear(GL_COLOR_BUFFER_BIT);
 
-    texture::unbind(tex_a.tmu());
-    texture::unbind(tex_d.tmu());
+    fb_moments[0].bind();
+    fb_moments[1].bind();
 
-    glBindImageTexture(0, tex_a.glid(), 0, false, 0, GL_READ_WRITE, GL_RGBA8_SNORM);
-    glBindImageTexture(1, tex_d.glid(), 0, false, 0, GL_READ_WRITE, GL_RGBA16_SNORM);
-    if (tex_l) {
-        glBindImageTexture(2, tex_l->glid(), 0, false, 0, GL_READ_WRITE, GL_R32UI);
+    prg_draw.use();
+    prg_draw.uniform<texture>("absorbance") = fb_moments[0];
+    prg_draw.uniform<texture>("moments") = fb_moments[1];
+    if (moments > 4) {
+        fb_moments[2].bind();
+        prg_draw.uniform<texture>("moments_high") = fb_moments[2];
     }
+    draw_with_alpha(prg_draw, mv, proj, alpha, sections, draw_mode);
 
-    col_vis_prg.use();
-    col_vis_prg.uniform<int32_t>("alpha_tex") = 0;
-    col_vis_prg.uniform<int32_t>("depth_tex") = 1;
-    if (tex_l) {
-        col_vis_prg.uniform<int32_t>("lock_tex")  = 2;
-    }
-    draw_with_alpha(col_vis_prg, mv, proj, alpha, sections, draw_mode);
+    pass.next("resolve");
 
-    glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA8_SNORM);
-    glBindImageTexture(1, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA16_SNORM);
-    if (tex_l) {
-        glBindImageTexture(2, 0, 0, false, 0, GL_READ_WRITE, GL_R32UI);
-    }
+    glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
 
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+    // Straight over the background in the window
+    framebuffer::unbind();
+    fb_accum[0].bind();
 
-    tex_a.bind();
-    tex_d.bind();
-    draw_prg.use();
-    draw_prg.uniform<texture>("alpha_tex") = tex_a;
-    draw_prg.uniform<texture>("depth_tex") = tex_d;
-    draw_with_alpha(draw_prg, mv, proj, alpha, sections, draw_mode);
+    prg_resolve.use();
+    prg_resolve.uniform<texture>("accum") = fb_accum[0];
+    prg_resolve.uniform<texture>("absorbance") = fb_moments[0];
+    quad_va.draw(GL_TRIANGLE_STRIP);
 
     glDisable(GL_BLEND);
 }
 
 
-static void hybrid_transp(framebuffer &fb_hytp, array_texture &abuffer,
-                          const mat4 &mv, const mat4 &proj,
-                          program &col_frag_prg, program &calc_vis_prg,
-                          program &resolv_prg, float alpha,
-                          const std::vector<ObjectSection> &sections,
-                          GLenum draw_mode, vertex_array &quad_va)
+// Stochastic transparency (Enderton et al.): Every fragment covers a random
+// subset of the samples of @fb_ms as large as it is opaque, and the depth test
+// keeps the front-most one per sample, so averaging the samples composites the
+// layers in order (with noise) in a single geometry pass.
+//
+// With @accumulate, that pass only leaves the depth per sample.  A second one
+// then accumulates every fragment's premultiplied color into all samples in
+// which it is visible, and a third one the total transparency into
+// @fb_bamc[1]; the normalized average is blended over the background like in
+// blend_bamc(), which removes most of the noise.
+static void stochastic_transp(MultisampleFramebuffer &fb_ms,
+                              framebuffer &fb_bamc, bool accumulate,
+                              const mat4 &mv, const mat4 &proj,
+                              RenderProgram &stoch_prg,
+                              RenderProgram &accum_prg,
+                              RenderProgram &transp_prg,
+                              RenderProgram &blend_prg,
+                              RenderProgram &resolve_prg, float alpha,
+                              const std::vector<ObjectSection> &sections,
+                              GLenum draw_mode, vertex_array &quad_va)
 {
-    uint32_t dc = 0xffffff00u; // depth = 1.0; alpha = 0.0
-    glClearTexImage(abuffer.glid(), 0, GL_RED_INTEGER, GL_UNSIGNED_INT, &dc);
-
-    glClearTexImage(fb_hytp[0].glid(), 0, GL_RED, GL_FLOAT, nullptr);
-    float vis_clear = 1.f;
-    glClearTexImage(fb_hytp[1].glid(), 0, GL_RED, GL_FLOAT, &vis_clear);
+    GPUScope scope("stochastic_transp");
+    GPUScope pass("coverage");
 
-    array_texture::unbind(abuffer.tmu());
+    fb_ms.bind();
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glBindImageTexture(0, abuffer.glid(), 0, true, 0, GL_READ_WRITE, GL_R32UI);
+    glEnable(GL_DEPTH_TEST);
+    if (accumulate) {
+        glColorMask(false, false, false, false);
+    }
 
-    fb_hytp.bind();
+    stoch_prg.use();
+    draw_with_alpha(stoch_prg, mv, proj, alpha, sections, draw_mode);
 
     glEnable(GL_BLEND);
-    glBlendFunci(0, GL_ONE, GL_ONE);
-    glBlendFunci(1, GL_ZERO, GL_SRC_COLOR);
 
-    col_frag_prg.use();
-    col_frag_prg.uniform<int32_t>("abuffer") = 0;
-    draw_with_alpha(col_frag_prg, mv, proj, alpha, sections, draw_mode);
+    if (accumulate) {
+        pass.next("accumulate");
 
-    framebuffer::unbind();
-    glBlendFunc(GL_ZERO, GL_SRC_ALPHA);
+        glColorMask(true, true, true, true);
+        glDepthFunc(GL_LEQUAL);
+        glDepthMask(false);
+        glBlendFunc(GL_ONE, GL_ONE);
 
-    fb_hytp[1].bind();
-    calc_vis_prg.use();
-    calc_vis_prg.uniform<int32_t>("abuffer") = 0;
-    calc_vis_prg.uniform<texture>("visibility") = fb_hytp[1];
-    quad_va.draw(GL_TRIANGLE_STRIP);
+        accum_prg.use();
+        draw_with_alpha(accum_prg, mv, proj, alpha, sections, draw_mode);
 
-    glBindImageTexture(0, 0, 0, false, 0, GL_READ_ONLY, GL_R32UI);
+        glDepthMask(true);
+        glDepthFunc(GL_LESS);
+    }
 
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+    glDisable(GL_DEPTH_TEST);
 
-    abuffer.bind();
-    fb_hytp[0].bind();
-    resolv_prg.use();
-    resolv_prg.uniform<array_texture>("abuffer") = abuffer;
-    resolv_prg.uniform<texture>("alpha_accum") = fb_hytp[0];
-    draw_with_alpha(resolv_prg, mv, proj, alpha, sections, draw_mode);
+    pass.next("resolve");
+
+    fb_ms.resolve();
+
+    if (accumulate) {
+        pass.next("transparency");
+
+        clear_bamc(fb_bamc);
+        glBlendFunci(0, GL_ZERO, GL_ONE);
+        glBlendFunci(1, GL_ZERO, GL_SRC_COLOR);
+
+        transp_prg.use();
+        draw_with_alpha(transp_prg, mv, proj, alpha, sections, draw_mode);
+
+        pass.next("composite");
+
+        glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
+
+        framebuffer::unbind();
+        fb_ms.resolved().bind();
+        fb_bamc[1].bind();
+
+        resolve_prg.use();
+        resolve_prg.uniform<texture>("accum") = fb_ms.resolved();
+        resolve_prg.uniform<texture>("transp") = fb_bamc[1];
+        quad_va.draw(GL_TRIANGLE_STRIP);
+    } else {
+        pass.next("composite");
+
+        // The uncovered samples are transparent black, so the average is
+        // premultiplied
+        glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+        framebuffer::unbind();
+        fb_ms.resolved().bind();
+
+        blend_prg.use();
+        blend_prg.uniform<texture>("layer") = fb_ms.resolved();
+        quad_va.draw(GL_TRIANGLE_STRIP);
+    }
 
     glDisable(GL_BLEND);
 }
 
 
-static void abuf_atomic(framebuffer &fb_bamc, array_texture &abuffer0,
-                        array_texture &abuffer1,
-                        const mat4 &mv, const mat4 &proj,
-                        program &col_frag_prg, program &calc_col_prg,
-                        program &resolv_prg, float alpha,
-                        const std::vector<ObjectSection> &sections,
-                        GLenum draw_mode, vertex_array &quad_va)
+// Tuning constants given on the command line, injected into all programs
+static ShaderDefines shader_overrides;
+
+
+// Sets up a program drawing the objects with the fragment shader @fname
+// (with @defines inserted into its source) and the vertex shader @vsh;
+// further outputs can be bound until it is built
+static RenderProgram *object_program(const char *fname,
+                                     const std::string &defines = "",
+                                     const char *vsh = "draw_xf_vert.glsl")
 {
-    uint32_t dc = 0xffffffffu;
-    glClearTexImage(abuffer0.glid(), 0, GL_RED_INTEGER, GL_UNSIGNED_INT, &dc);
-    glClearTexImage(abuffer1.glid(), 0, GL_RGBA, GL_FLOAT, nullptr);
+    RenderProgram *prg = new RenderProgram(vsh, fname,
+                                           defines + shader_overrides.str());
+    prg->bind_attrib("in_pos", 0);
+    prg->bind_attrib("in_nrm", 1);
+    prg->bind_attrib("in_col", 2);
+    prg->bind_frag("out_col", 0);
+    return prg;
+}
 
-    array_texture::unbind(abuffer0.tmu());
-    array_texture::unbind(abuffer1.tmu());
 
-    glBindImageTexture(0, abuffer0.glid(), 0, true, 0, GL_READ_WRITE, GL_R32UI);
+// Sets up a program drawing a full-screen quad
+static RenderProgram *quad_program(const char *fname,
+                                   const std::string &defines = "")
+{
+    RenderProgram *prg = new RenderProgram("draw_tex_vert.glsl", fname,
+                                           defines + shader_overrides.str());
+    prg->bind_attrib("in_pos", 0);
+    prg->bind_frag("out_col", 0);
+    return prg;
+}
 
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
 
-    col_frag_prg.use();
-    col_frag_prg.uniform<int32_t>("abuffer") = 0;
-    draw_with_alpha(col_frag_prg, mv, proj, alpha, sections, draw_mode);
+// Starts building all of @prgs and returns whether they are done (always
+// after waiting for them if @wait is set); @ok is cleared if any of them
+// failed
+static bool programs_ready(std::initializer_list<RenderProgram *> prgs,
+                           bool wait, bool &ok)
+{
+    for (RenderProgram *prg: prgs) {
+        prg->build();
+    }
 
-    glBindImageTexture(0, abuffer1.glid(), 0, true, 0, GL_WRITE_ONLY, GL_RGBA8_SNORM);
+    if (!wait) {
+        for (RenderProgram *prg: prgs) {
+            if (!prg->ready()) {
+                return false;
+            }
+        }
+    }
 
-    fb_bamc.mask(1);
-    fb_bamc.bind();
-    glBlendFunc(GL_ONE, GL_ONE);
-    glClear(GL_COLOR_BUFFER_BIT);
+    for (RenderProgram *prg: prgs) {
+        ok = prg->finish() && ok;
+    }
+    return true;
+}
 
-    abuffer0.bind();
-    calc_col_prg.use();
-    calc_col_prg.uniform<int32_t>("colors") = 0;
-    calc_col_prg.uniform<array_texture>("abuffer") = abuffer0;
-    draw_with_alpha(calc_col_prg, mv, proj, alpha, sections, draw_mode);
 
-    framebuffer::unbind();
+// Visibility function of adaptive transparency with @nodes nodes per pixel.
+// The alpha (8 bit) and depth (16 bit) values of four nodes share a texel,
+// one array texture layer per four nodes (just RG for two nodes).  The shader
+// code is generated for the node count.
+struct AdaptiveVariant {
+    int nodes, layers;
+    GLenum alpha_format, depth_format;
+    array_texture *alpha, *depth;
+
+    // Front-most fragments for the lock-free insertion (allocated on first
+    // use)
+    array_texture *keys = nullptr;
+
+    // The previous frame's visibility function for the temporal mode
+    // (allocated on first use), swapped with alpha/depth every frame
+    array_texture *hist_alpha = nullptr, *hist_depth = nullptr;
+    // State it was built with; invalid if hist_sections is null
+    mat4 hist_mv;
+    const std::vector<ObjectSection> *hist_sections = nullptr;
+
+    // Either locked or ordered by GL_INTEL_fragment_shader_ordering
+    RenderProgram *insert_prg;
+    RenderProgram *insert_atomic_prg, *fixup_prg;
+    RenderProgram *draw_prg;
+    // Inserts like insert_prg and composites with the previous frame's
+    // visibility function at the same time
+    RenderProgram *temporal_prg;
+};
 
-    glBindImageTexture(0, 0, 0, false, 0, GL_READ_ONLY, GL_R32UI);
 
-    fb_bamc.unmask(1);
-    fb_bamc[0].bind();
-    abuffer1.bind();
-    resolv_prg.use();
-    resolv_prg.uniform<array_texture>("colors") = abuffer1;
-    resolv_prg.uniform<texture>("accum") = fb_bamc[0];
-    quad_va.draw(GL_TRIANGLE_STRIP);
+// Texture formats of the alpha and depth values for @nodes nodes
+static void adaptive_formats(int nodes, GLenum &alpha_format,
+                             GLenum &depth_format)
+{
+    alpha_format = nodes < 4 ? GL_RG8_SNORM : GL_RGBA8_SNORM;
+    depth_format = nodes < 4 ? GL_RG16_SNORM : GL_RGBA16_SNORM;
+}
 
-    glDisable(GL_BLEND);
+
+static void create_visibility_textures(const AdaptiveVariant &v,
+                                       array_texture *&alpha,
+                                       array_texture *&depth)
+{
+    GLenum fmt = v.nodes < 4 ? GL_RG : GL_RGBA;
+
+    alpha = new array_texture;
+    alpha->format(v.alpha_format, WIDTH, HEIGHT, v.layers, fmt);
+    depth = new array_texture;
+    depth->format(v.depth_format, WIDTH, HEIGHT, v.layers, fmt);
+    depth->tmu() = 1;
 }
 
 
-int main(int argc, char *argv[])
+static AdaptiveVariant *create_adaptive_variant(int nodes, bool pixel_sync)
 {
-    const char *bg_tex_name, *entity_name = "entity.obj";
-    bool entity_gradient = true, borderless = false, two_objects = true;
-    bool pixel_sync = false, bfcull = false;
+    AdaptiveVariant *v = new AdaptiveVariant;
+
+    v->nodes = nodes;
+    v->layers = (nodes + 3) / 4;
+    adaptive_formats(nodes, v->alpha_format, v->depth_format);
+
+    create_visibility_textures(*v, v->alpha, v->depth);
+
+    ShaderDefines def;
+    def.set("NODES", nodes)
+       .set("LAYERS", v->layers)
+       .set("ALPHA_FORMAT", nodes < 4 ? "rg8_snorm" : "rgba8_snorm")
+       .set("DEPTH_FORMAT", nodes < 4 ? "rg16_snorm" : "rgba16_snorm");
+    std::string defines = def.str();
+
+    // Only the programs of the modes actually used are built
+    v->insert_prg = object_program(pixel_sync ? "draw_adtp0o_frag.glsl"
+                                              : "draw_adtp0_frag.glsl",
+                                   defines);
+    v->insert_atomic_prg = object_program("draw_adtp0a_frag.glsl", defines);
+    v->fixup_prg = quad_program("draw_adtp2_frag.glsl", defines);
+    v->draw_prg = object_program("draw_adtp1_frag.glsl", defines);
+    v->temporal_prg = object_program(pixel_sync ? "draw_adtp0o_frag.glsl"
+                                                : "draw_adtp0_frag.glsl",
+                                     def.set("TEMPORAL").str(),
+                                     "draw_xf_prev_vert.glsl");
+    v->temporal_prg->bind_frag("out_transp", 1);
+
+    return v;
+}
 
-    static const struct option options[] = {
-        {"help", no_argument, nullptr, 'h'},
-        {"entity", required_argument, nullptr, 'e'},
-        {"material", no_argument, nullptr, 'm'},
-        {"borderless", no_argument, nullptr, 'b'},
-        {"single", no_argument, nullptr, 's'},
-        {"pixel-sync", no_argument, nullptr, 'y'},
-        {"cull-backfaces", no_argument, nullptr, 'c'},
 
-        {nullptr, 0, nullptr, 0}
-    };
+static void clear_adaptive(AdaptiveVariant &v)
+{
+    glClearTexImage(v.alpha->glid(), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    vec4 dc(1.f, 1.f, 1.f, 1.f);
+    glClearTexImage(v.depth->glid(), 0, GL_RGBA, GL_FLOAT, &dc);
 
-    for (;;) {
-        int option = getopt_long(argc, argv, "he:mbsyc", options, nullptr);
-        if (option == -1) {
-            break;
-        }
+    array_texture::unbind(v.alpha->tmu());
+    array_texture::unbind(v.depth->tmu());
+}
 
-        switch (option) {
-            case 'h':
-            case '?':
-                fprintf(stderr, "Usage: %s [options...] <bg-texture.(png|jpg)>\n\n", argv[0]);
-                fprintf(stderr, "Options:\n");
-                fprintf(stderr, "  -h, --help                   Shows this information\n");
-                fprintf(stderr, "  -e, --entity=<entity.obj>    Chooses a mesh to be displayed\n");
-                fprintf(stderr, "  -m, --material               Uses the material as specified by the entity,\n");
-                fprintf(stderr, "                               instead of generating a gradient\n");
-                fprintf(stderr, "  -b, --borderless             Run borderless in 1920x1080\n");
-                fprintf(stderr, "  -s, --single                 Draw only a single object\n");
-                fprintf(stderr, "  -y, --pixel-sync             Use GL_INTEL_fragment_shader_ordering\n");
-                fprintf(stderr, "                               if available\n");
-                fprintf(stderr, "  -c, --cull-backfraces        Enable backface culling\n");
-                return 0;
 
-            case 'e':
-                entity_name = optarg;
-                break;
+static void composite_adaptive(AdaptiveVariant &v, const mat4 &mv,
+                               const mat4 &proj, float alpha,
+                               const std::vector<ObjectSection> &sections,
+                               GLenum draw_mode)
+{
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
 
-            case 'm':
-                entity_gradient = false;
-                break;
+    v.alpha->bind();
+    v.depth->bind();
+    v.draw_prg->use();
+    v.draw_prg->uniform<array_texture>("alpha_tex") = *v.alpha;
+    v.draw_prg->uniform<array_texture>("depth_tex") = *v.depth;
+    draw_with_alpha(*v.draw_prg, mv, proj, alpha, sections, draw_mode);
+}
 
-            case 'b':
-                WIDTH = 1920;
-                HEIGHT = 1080;
-                borderless = true;
-                break;
 
-            case 's':
-                two_objects = false;
-                break;
+static void adaptive_transp(AdaptiveVariant &v, texture *tex_l,
+                            const mat4 &mv, const mat4 &proj, float alpha,
+                            const std::vector<ObjectSection> &sections,
+                            GLenum draw_mode)
+{
+    GPUScope scope("adaptive_transp");
+    GPUScope pass("clear");
 
-            case 'y':
-                pixel_sync = true;
-                break;
+    // Overwrites what the temporal mode would take as its history
+    v.hist_sections = nullptr;
 
-            case 'c':
-                bfcull = true;
-                break;
-        }
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+
+    clear_adaptive(v);
+
+    if (tex_l) {
+        glClearTexImage(tex_l->glid(), 0, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
     }
 
-    if (optind != argc - 1) {
-        fprintf(stderr, "Expecting exactly one non-option argument\n");
-        return 1;
+    glBindImageTexture(0, v.alpha->glid(), 0, true, 0, GL_READ_WRITE, v.alpha_format);
+    glBindImageTexture(1, v.depth->glid(), 0, true, 0, GL_READ_WRITE, v.depth_format);
+    if (tex_l) {
+        glBindImageTexture(2, tex_l->glid(), 0, false, 0, GL_READ_WRITE, GL_R32UI);
     }
 
-    bg_tex_name = argv[optind];
+    pass.next("visibility");
 
-    SDL_Init(SDL_INIT_VIDEO);
+    v.insert_prg->use();
+    v.insert_prg->uniform<int32_t>("alpha_tex") = 0;
+    v.insert_prg->uniform<int32_t>("depth_tex") = 1;
+    if (tex_l) {
+        v.insert_prg->uniform<int32_t>("lock_tex")  = 2;
+    }
+    draw_with_alpha(*v.insert_prg, mv, proj, alpha, sections, draw_mode);
 
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK,
-                        SDL_GL_CONTEXT_PROFILE_CORE);
+    glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, v.alpha_format);
+    glBindImageTexture(1, 0, 0, false, 0, GL_READ_WRITE, v.depth_format);
+    if (tex_l) {
+        glBindImageTexture(2, 0, 0, false, 0, GL_READ_WRITE, GL_R32UI);
+    }
 
-    SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
-    SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
-    SDL_GL_SetSwapInterval(1);
+    pass.next("composite");
 
-    SDL_Window *wnd = SDL_CreateWindow("transp", SDL_WINDOWPOS_UNDEFINED,
-                                       SDL_WINDOWPOS_UNDEFINED, WIDTH, HEIGHT,
-                                       SDL_WINDOW_OPENGL
-                                       | (borderless * SDL_WINDOW_BORDERLESS));
-    SDL_GL_CreateContext(wnd);
+    composite_adaptive(v, mv, proj, alpha, sections, draw_mode);
 
+    glDisable(GL_BLEND);
+}
 
-    glext.init();
 
-    pixel_sync &= glext.has_extension("GL_INTEL_fragment_shader_ordering");
+// Adaptive transparency without a lock or fragment shader ordering: The
+// insertion keeps the front-most fragments per pixel in @v.keys with atomics
+// only, and the fix-up pass turns them into the visibility function, which
+// is then used just like in adaptive_transp().
+static void adaptive_transp_atomic(AdaptiveVariant &v, const mat4 &mv,
+                                   const mat4 &proj, float alpha,
+                                   const std::vector<ObjectSection> &sections,
+                                   GLenum draw_mode, vertex_array &quad_va)
+{
+    if (!v.keys) {
+        v.keys = new array_texture;
+        v.keys->format(GL_R32UI, WIDTH, HEIGHT, v.nodes, GL_RED_INTEGER);
+    }
 
+    GPUScope scope("adaptive_transp_atomic");
+    GPUScope pass("clear");
 
-    texture input(bg_tex_name);
+    // Overwrites what the temporal mode would take as its history
+    v.hist_sections = nullptr;
 
-    vertex_array quad;
-    quad.set_elements(4);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
 
-    vec2 quad_vertex_positions[] = {
-        vec2(-1.f, 1.f), vec2(-1.f, -1.f), vec2(1.f, 1.f), vec2(1.f, -1.f)
-    };
+    uint32_t kc = 0xffffffffu;
+    glClearTexImage(v.keys->glid(), 0, GL_RED_INTEGER, GL_UNSIGNED_INT, &kc);
 
-    quad.attrib(0)->format(2);
-    quad.attrib(0)->data(quad_vertex_positions);
+    array_texture::unbind(v.keys->tmu());
+    clear_adaptive(v);
 
+    glBindImageTexture(0, v.keys->glid(), 0, true, 0, GL_READ_WRITE,
+                       GL_R32UI);
 
-    texture abuf_ll_head, abuf_list_data;
-    abuf_ll_head.format(GL_R32UI, WIDTH, HEIGHT, GL_RED_INTEGER, GL_UNSIGNED_INT);
-    abuf_list_data.format(GL_RGBA32UI, 2048, 2048, GL_RGBA_INTEGER, GL_UNSIGNED_INT);
+    pass.next("insert");
+
+    v.insert_atomic_prg->use();
+    v.insert_atomic_prg->uniform<int32_t>("keys") = 0;
+    draw_with_alpha(*v.insert_atomic_prg, mv, proj, alpha, sections,
+                    draw_mode);
+
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+    pass.next("fix-up");
+
+    glBindImageTexture(1, v.alpha->glid(), 0, true, 0, GL_WRITE_ONLY, v.alpha_format);
+    glBindImageTexture(2, v.depth->glid(), 0, true, 0, GL_WRITE_ONLY, v.depth_format);
+
+    // Only writes the images
+    glColorMask(false, false, false, false);
+
+    v.fixup_prg->use();
+    v.fixup_prg->uniform<int32_t>("keys") = 0;
+    v.fixup_prg->uniform<int32_t>("alpha_tex") = 1;
+    v.fixup_prg->uniform<int32_t>("depth_tex") = 2;
+    quad_va.draw(GL_TRIANGLE_STRIP);
+
+    glColorMask(true, true, true, true);
+
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
 
-    abuf_list_data.tmu() = 1;
+    glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_R32UI);
+    glBindImageTexture(1, 0, 0, false, 0, GL_WRITE_ONLY, v.alpha_format);
+    glBindImageTexture(2, 0, 0, false, 0, GL_WRITE_ONLY, v.depth_format);
 
+    pass.next("composite");
 
-    shader *pass_vsh = new shader(shader::VERTEX, "draw_tex_vert.glsl");
+    composite_adaptive(v, mv, proj, alpha, sections, draw_mode);
 
-    program draw_tex_prg   {shader(shader::FRAGMENT, "draw_tex_frag.glsl")};
-    program draw_bamy1_prg {shader(shader::FRAGMENT, "draw_bamy1_frag.glsl")};
-    program draw_bamc1_prg {shader(shader::FRAGMENT, "draw_bamc1_frag.glsl")};
-    program draw_baab2_prg {shader(shader::FRAGMENT, "draw_baab2_frag.glsl")};
+    glDisable(GL_BLEND);
+}
+
+
+// Largest distance (in pixels) any vertex of @sections has moved on screen
+// from @prev_mv to @mv; only a few hundred vertices per section are sampled
+static float screen_motion(const mat4 &prev_mv, const mat4 &mv,
+                           const mat4 &proj,
+                           const std::vector<ObjectSection> &sections)
+{
+    float max_dist = 0.f;
+
+    for (const ObjectSection &sec: sections) {
+        mat4 mvp = proj * sec.rel_mv * mv;
+        mat4 prev_mvp = proj * sec.rel_mv * prev_mv;
+
+        size_t step = sec.vertex_count / 256 + 1;
+        for (size_t i = 0; i < sec.vertex_count; i += step) {
+            vec4 c = mvp * vec4(sec.positions[i], 1.f);
+            vec4 pc = prev_mvp * vec4(sec.positions[i], 1.f);
 
-    program *draw_abuf1_prg = nullptr, *draw_abuf1l_prg = nullptr;
-    program *draw_hytp1_prg = nullptr;
-    if (glext.has_extension("GL_ARB_shader_image_load_store")) {
-        draw_abuf1_prg  = new program {shader(shader::FRAGMENT,
-                                       "draw_abuf1_frag.glsl")};
-        draw_abuf1l_prg = new program {shader(shader::FRAGMENT,
-                                       "draw_abuf1l_frag.glsl")};
-        draw_hytp1_prg  = new program {shader(shader::FRAGMENT,
-                                       "draw_hytp1_frag.glsl")};
+            float dx = (c.x() / c.w() - pc.x() / pc.w()) * WIDTH / 2.f;
+            float dy = (c.y() / c.w() - pc.y() / pc.w()) * HEIGHT / 2.f;
+            max_dist = std::max(max_dist, sqrtf(dx * dx + dy * dy));
+        }
+    }
+
+    return max_dist;
+}
+
+
+// Beyond this motion (in pixels), the previous frame's visibility function is
+// not trusted and temporal_adaptive_transp() rebuilds it from scratch
+#define TEMPORAL_MAX_MOTION 8.f
+
+// Temporal adaptive transparency: Every fragment is composited with the
+// previous frame's visibility function (looked up where the fragment was
+// then) and inserted into the current one in the same geometry pass, which
+// accumulates like blend_bamc() into @fb_bamc.  After large motion or a
+// change of the objects, this falls back to adaptive_transp() for a frame.
+static void temporal_adaptive_transp(AdaptiveVariant &v, texture *tex_l,
+                                     framebuffer &fb_bamc, const mat4 &mv,
+                                     const mat4 &proj,
+                                     RenderProgram &resolve_prg, float alpha,
+                                     const std::vector<ObjectSection> &sections,
+                                     GLenum draw_mode, vertex_array &quad_va)
+{
+    if (!v.hist_alpha) {
+        create_visibility_textures(v, v.hist_alpha, v.hist_depth);
     }
 
-    for (program *prg: {&draw_tex_prg, &draw_bamy1_prg, &draw_bamc1_prg,
-                        draw_abuf1_prg, draw_abuf1l_prg, draw_hytp1_prg,
-                        &draw_baab2_prg})
+    if (v.hist_sections != &sections ||
+        screen_motion(v.hist_mv, mv, proj, sections) > TEMPORAL_MAX_MOTION)
     {
-        if (!prg) {
-            continue;
-        }
+        adaptive_transp(v, tex_l, mv, proj, alpha, sections, draw_mode);
 
-        *prg << *pass_vsh;
-        prg->bind_attrib("in_pos", 0);
-        prg->bind_frag("out_col", 0);
+        v.hist_mv = mv;
+        v.hist_sections = &sections;
+        return;
     }
 
-    shader *simple_vsh = new shader(shader::VERTEX, "draw_xf_vert.glsl");
-
-    program draw_bf_prg     {shader(shader::FRAGMENT, "draw_bf_frag.glsl")};
-    program draw_ff_prg     {shader(shader::FRAGMENT, "draw_ff_frag.glsl")};
-    program draw_dp_prg     {shader(shader::FRAGMENT, "draw_dp_frag.glsl")};
-    program draw_bfdp_prg   {shader(shader::FRAGMENT, "draw_bfdp_frag.glsl")};
-    program draw_ffdp_prg   {shader(shader::FRAGMENT, "draw_ffdp_frag.glsl")};
-    program draw_simple_prg {shader(shader::FRAGMENT, "draw_simple_frag.glsl")};
-    program draw_meshk_prg  {shader(shader::FRAGMENT, "draw_meshk_frag.glsl")};
-    program draw_bamy0_prg  {shader(shader::FRAGMENT, "draw_bamy0_frag.glsl")};
-    program draw_bamc0_prg  {shader(shader::FRAGMENT, "draw_bamc0_frag.glsl")};
-    program draw_bamc0w_prg {shader(shader::FRAGMENT, "draw_bamc0w_frag.glsl")};
-    program draw_adtp1_prg  {shader(shader::FRAGMENT, "draw_adtp1_frag.glsl")};
-    program draw_hytp2_prg  {shader(shader::FRAGMENT, "draw_hytp2_frag.glsl")};
-
-    program *draw_abuf0_prg = nullptr, *draw_adtp0_prg = nullptr;
-    program *draw_hytp0_prg = nullptr, *draw_baab0_prg = nullptr;
-    program *draw_baab1_prg = nullptr;
-    if (glext.has_extension("GL_ARB_shader_image_load_store")) {
-        draw_abuf0_prg = new program {shader(shader::FRAGMENT,
-                                      "draw_abuf0_frag.glsl")};
-        draw_hytp0_prg = new program {shader(shader::FRAGMENT,
-                                      "draw_hytp0_frag.glsl")};
-        draw_baab0_prg = new program {shader(shader::FRAGMENT,
-                                      "draw_baab0_frag.glsl")};
-        draw_baab1_prg = new program {shader(shader::FRAGMENT,
-                                      "draw_baab1_frag.glsl")};
-
-        if (pixel_sync) {
-            draw_adtp0_prg = new program {shader(shader::FRAGMENT,
-                                          "draw_adtp0o_frag.glsl")};
-        } else {
-            draw_adtp0_prg = new program {shader(shader::FRAGMENT,
-                                          "draw_adtp0_frag.glsl")};
-        }
+    GPUScope scope("temporal_adaptive_transp");
+    GPUScope pass("clear");
+
+    // The last frame's function becomes the history, the one before that is
+    // rebuilt
+    std::swap(v.alpha, v.hist_alpha);
+    std::swap(v.depth, v.hist_depth);
+
+    clear_adaptive(v);
+
+    if (tex_l) {
+        glClearTexImage(tex_l->glid(), 0, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
     }
 
-    for (program *prg: {&draw_bf_prg, &draw_ff_prg, &draw_dp_prg,
-                        &draw_bfdp_prg, &draw_ffdp_prg, &draw_simple_prg,
-                        &draw_meshk_prg, &draw_bamy0_prg, &draw_bamc0_prg,
-                        &draw_bamc0w_prg, draw_adtp0_prg, &draw_adtp1_prg,
-                        draw_abuf0_prg, draw_hytp0_prg, &draw_hytp2_prg,
-                        draw_baab0_prg, draw_baab1_prg})
-    {
-        if (!prg) {
-            continue;
-        }
+    glBindImageTexture(0, v.alpha->glid(), 0, true, 0, GL_READ_WRITE, v.alpha_format);
+    glBindImageTexture(1, v.depth->glid(), 0, true, 0, GL_READ_WRITE, v.depth_format);
+    if (tex_l) {
+        glBindImageTexture(2, tex_l->glid(), 0, false, 0, GL_READ_WRITE, GL_R32UI);
+    }
+
+    clear_bamc(fb_bamc);
+
+    pass.next("geometry");
+
+    glEnable(GL_BLEND);
+    glBlendFunci(0, GL_ONE, GL_ONE);
+    glBlendFunci(1, GL_ZERO, GL_SRC_COLOR);
 
-        *prg << *simple_vsh;
-        prg->bind_attrib("in_pos", 0);
-        prg->bind_attrib("in_nrm", 1);
-        prg->bind_attrib("in_col", 2);
-        prg->bind_frag("out_col", 0);
+    v.hist_alpha->bind();
+    v.hist_depth->bind();
+
+    v.temporal_prg->use();
+    v.temporal_prg->uniform<int32_t>("alpha_tex") = 0;
+    v.temporal_prg->uniform<int32_t>("depth_tex") = 1;
+    if (tex_l) {
+        v.temporal_prg->uniform<int32_t>("lock_tex") = 2;
     }
+    v.temporal_prg->uniform<array_texture>("prev_alpha_tex") = *v.hist_alpha;
+    v.temporal_prg->uniform<array_texture>("prev_depth_tex") = *v.hist_depth;
+    v.temporal_prg->uniform<float>("alpha") = alpha;
 
-    draw_bamy0_prg.bind_frag("out_count", 1);
-    draw_bamc0_prg.bind_frag("out_transp", 1);
-    draw_bamc0w_prg.bind_frag("out_transp", 1);
-    if (draw_hytp0_prg) {
-        draw_hytp0_prg->bind_frag("out_transp", 0);
-        draw_hytp0_prg->bind_frag("out_vis", 1);
+    for (const ObjectSection &sec: sections) {
+        v.temporal_prg->uniform<mat4>("mat_mvp") = proj * sec.rel_mv * mv;
+        v.temporal_prg->uniform<mat4>("mat_prev_mvp") = proj * sec.rel_mv * v.hist_mv;
+        sec.draw(draw_mode);
     }
 
-    obj entity = load_obj(entity_name), entity_copy = entity;
-    std::vector<ObjectSection> entity_secs;
-    vec3 ur = entity.upper_right, ll = entity.lower_left;
-    float scale = 1.5f / maximum(
-                            maximum(fabsf(ur.x()), maximum(fabsf(ur.y()), fabsf(ur.z()))),
-                            maximum(fabsf(ll.x()), maximum(fabsf(ll.y()), fabsf(ll.z())))
-                        );
-    for (obj_section &sec: entity.sections) {
-        entity_secs.emplace_back();
-        entity_secs.back().va = sec.make_vertex_array(0, -1, 1);
-        entity_secs.back().rel_mv = mat4::identity();
-        if (two_objects) {
-            entity_secs.back().rel_mv.translate(vec3(-2.f, 0.f, 0.f));
+    glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, v.alpha_format);
+    glBindImageTexture(1, 0, 0, false, 0, GL_READ_WRITE, v.depth_format);
+    if (tex_l) {
+        glBindImageTexture(2, 0, 0, false, 0, GL_READ_WRITE, GL_R32UI);
+    }
+
+    // Read through samplers in the next frame
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    pass.next("resolve");
+
+    glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
+
+    framebuffer::unbind();
+    fb_bamc[0].bind();
+    fb_bamc[1].bind();
+
+    resolve_prg.use();
+    resolve_prg.uniform<texture>("accum") = fb_bamc[0];
+    resolve_prg.uniform<texture>("transp") = fb_bamc[1];
+    quad_va.draw(GL_TRIANGLE_STRIP);
+
+    glDisable(GL_BLEND);
+
+    v.hist_mv = mv;
+}
+
+
+static void hybrid_transp(framebuffer &fb_hytp, array_texture &abuffer,
+                          const mat4 &mv, const mat4 &proj,
+                          RenderProgram &col_frag_prg,
+                          RenderProgram &calc_vis_prg,
+                          RenderProgram &resolv_prg, float alpha,
+                          const std::vector<ObjectSection> &sections,
+                          GLenum draw_mode, vertex_array &quad_va)
+{
+    GPUScope scope("hybrid_transp");
+    GPUScope pass("clear");
+
+    uint32_t dc = 0xffffff00u; // depth = 1.0; alpha = 0.0
+    glClearTexImage(abuffer.glid(), 0, GL_RED_INTEGER, GL_UNSIGNED_INT, &dc);
+
+    glClearTexImage(fb_hytp[0].glid(), 0, GL_RED, GL_FLOAT, nullptr);
+    float vis_clear = 1.f;
+    glClearTexImage(fb_hytp[1].glid(), 0, GL_RED, GL_FLOAT, &vis_clear);
+
+    array_texture::unbind(abuffer.tmu());
+
+    glBindImageTexture(0, abuffer.glid(), 0, true, 0, GL_READ_WRITE, GL_R32UI);
+
+    pass.next("core");
+
+    fb_hytp.bind();
+
+    glEnable(GL_BLEND);
+    glBlendFunci(0, GL_ONE, GL_ONE);
+    glBlendFunci(1, GL_ZERO, GL_SRC_COLOR);
+
+    col_frag_prg.use();
+    col_frag_prg.uniform<int32_t>("abuffer") = 0;
+    draw_with_alpha(col_frag_prg, mv, proj, alpha, sections, draw_mode);
+
+    pass.next("visibility");
+
+    framebuffer::unbind();
+    glBlendFunc(GL_ZERO, GL_SRC_ALPHA);
+
+    fb_hytp[1].bind();
+    calc_vis_prg.use();
+    calc_vis_prg.uniform<int32_t>("abuffer") = 0;
+    calc_vis_prg.uniform<texture>("visibility") = fb_hytp[1];
+    quad_va.draw(GL_TRIANGLE_STRIP);
+
+    glBindImageTexture(0, 0, 0, false, 0, GL_READ_ONLY, GL_R32UI);
+
+    pass.next("resolve");
+
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+
+    abuffer.bind();
+    fb_hytp[0].bind();
+    resolv_prg.use();
+    resolv_prg.uniform<array_texture>("abuffer") = abuffer;
+    resolv_prg.uniform<texture>("alpha_accum") = fb_hytp[0];
+    draw_with_alpha(resolv_prg, mv, proj, alpha, sections, draw_mode);
+
+    glDisable(GL_BLEND);
+}
+
+
+// Hybrid transparency in a single geometry pass: The core fragments are kept
+// sorted in @abuffer together with their colors in @colors (under a lock in
+// @tex_l, or ordered by GL_INTEL_fragment_shader_ordering if that is null),
+// and whatever falls out of the core is accumulated into @fb_bamc like in
+// blend_bamc().  One full-screen pass then resolves everything.
+static void hybrid_transp_1p(framebuffer &fb_bamc, array_texture &abuffer,
+                             array_texture &colors, texture *tex_l,
+                             const mat4 &mv, const mat4 &proj,
+                             RenderProgram &insert_prg,
+                             RenderProgram &resolv_prg, float alpha,
+                             const std::vector<ObjectSection> &sections,
+                             GLenum draw_mode, vertex_array &quad_va)
+{
+    GPUScope scope("hybrid_transp_1p");
+    GPUScope pass("clear");
+
+    uint32_t dc = 0xffffff00u; // depth = 1.0; alpha = 0.0
+    glClearTexImage(abuffer.glid(), 0, GL_RED_INTEGER, GL_UNSIGNED_INT, &dc);
+    glClearTexImage(colors.glid(), 0, GL_RGBA, GL_FLOAT, nullptr);
+    if (tex_l) {
+        glClearTexImage(tex_l->glid(), 0, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    }
+
+    array_texture::unbind(abuffer.tmu());
+    array_texture::unbind(colors.tmu());
+
+    glBindImageTexture(0, abuffer.glid(), 0, true, 0, GL_READ_WRITE, GL_R32UI);
+    glBindImageTexture(1, colors.glid(), 0, true, 0, GL_READ_WRITE, GL_RGBA8);
+    if (tex_l) {
+        glBindImageTexture(2, tex_l->glid(), 0, false, 0, GL_READ_WRITE, GL_R32UI);
+    }
+
+    clear_bamc(fb_bamc);
+
+    pass.next("geometry");
+
+    glEnable(GL_BLEND);
+    glBlendFunci(0, GL_ONE, GL_ONE);
+    glBlendFunci(1, GL_ZERO, GL_SRC_COLOR);
+
+    insert_prg.use();
+    insert_prg.uniform<int32_t>("abuffer") = 0;
+    insert_prg.uniform<int32_t>("colors") = 1;
+    if (tex_l) {
+        insert_prg.uniform<int32_t>("lock_tex") = 2;
+    }
+    draw_with_alpha(insert_prg, mv, proj, alpha, sections, draw_mode);
+
+    glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_R32UI);
+    glBindImageTexture(1, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA8);
+    if (tex_l) {
+        glBindImageTexture(2, 0, 0, false, 0, GL_READ_WRITE, GL_R32UI);
+    }
+
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    pass.next("resolve");
+
+    // Premultiplied over the background
+    glBlendFunc(GL_ONE, GL_SRC_ALPHA);
+
+    framebuffer::unbind();
+    abuffer.bind();
+    colors.bind();
+    fb_bamc[0].bind();
+    fb_bamc[1].bind();
+
+    resolv_prg.use();
+    resolv_prg.uniform<array_texture>("abuffer") = abuffer;
+    resolv_prg.uniform<array_texture>("colors") = colors;
+    resolv_prg.uniform<texture>("accum") = fb_bamc[0];
+    resolv_prg.uniform<texture>("transp") = fb_bamc[1];
+    quad_va.draw(GL_TRIANGLE_STRIP);
+
+    glDisable(GL_BLEND);
+}
+
+
+// Bounded A-buffer with @layers fragments per pixel, kept sorted with atomics
+// only.  The shader code is generated for the layer count.
+struct AtomicABufferVariant {
+    int layers;
+
+    // Depths (or packed keys) and colors, one layer per fragment
+    array_texture keys, colors;
+
+    RenderProgram *depth_prg, *color_prg, *resolve_prg;
+    // Single pass with depth and color packed into the keys
+    RenderProgram *packed_prg, *packed_resolve_prg;
+};
+
+
+static AtomicABufferVariant *create_abuf_atomic_variant(int layers)
+{
+    AtomicABufferVariant *v = new AtomicABufferVariant;
+
+    v->layers = layers;
+
+    v->keys.format(GL_R32UI, WIDTH, HEIGHT, layers, GL_RED_INTEGER);
+    v->colors.format(GL_RGBA8_SNORM, WIDTH, HEIGHT, layers);
+    // Read together with fb_bamc
+    v->keys.tmu() = 2;
+    v->colors.tmu() = 3;
+
+    ShaderDefines def;
+    def.set("LAYERS", layers);
+    std::string defines = def.str();
+
+    v->depth_prg = object_program("draw_baab0_frag.glsl", defines);
+    v->color_prg = object_program("draw_baab1_frag.glsl", defines);
+    v->resolve_prg = quad_program("draw_baab2_frag.glsl", defines);
+    v->packed_prg = object_program("draw_baab3_frag.glsl", defines);
+    v->packed_resolve_prg = quad_program("draw_baab2_frag.glsl",
+                                         def.set("PACKED").str());
+
+    for (RenderProgram *prg: {v->depth_prg, v->color_prg, v->packed_prg}) {
+        prg->bind_frag("out_transp", 1);
+    }
+
+    return v;
+}
+
+
+// Blends the layers of @v front to back and the tail (accumulated in @fb_bamc)
+// under them, over the background
+static void resolve_abuf_atomic(framebuffer &fb_bamc, RenderProgram &resolv_prg,
+                                array_texture &layers, const char *name,
+                                vertex_array &quad_va)
+{
+    glBlendFunc(GL_ONE, GL_SRC_ALPHA);
+
+    framebuffer::unbind();
+    layers.bind();
+    fb_bamc[0].bind();
+    fb_bamc[1].bind();
+
+    resolv_prg.use();
+    resolv_prg.uniform<array_texture>(name) = layers;
+    resolv_prg.uniform<texture>("accum") = fb_bamc[0];
+    resolv_prg.uniform<texture>("transp") = fb_bamc[1];
+    quad_va.draw(GL_TRIANGLE_STRIP);
+}
+
+
+// The first pass sorts the depths of the front-most fragments into @v.keys,
+// the second one stores their colors in @v.colors and accumulates all others
+// into @fb_bamc (like blend_bamc()), to be blended under them.
+static void abuf_atomic(framebuffer &fb_bamc, AtomicABufferVariant &v,
+                        const mat4 &mv, const mat4 &proj, float alpha,
+                        const std::vector<ObjectSection> &sections,
+                        GLenum draw_mode, vertex_array &quad_va)
+{
+    GPUScope scope("abuf_atomic");
+    GPUScope pass("clear");
+
+    uint32_t dc = 0xffffffffu;
+    glClearTexImage(v.keys.glid(), 0, GL_RED_INTEGER, GL_UNSIGNED_INT, &dc);
+    glClearTexImage(v.colors.glid(), 0, GL_RGBA, GL_FLOAT, nullptr);
+
+    array_texture::unbind(v.keys.tmu());
+    array_texture::unbind(v.colors.tmu());
+
+    glBindImageTexture(0, v.keys.glid(), 0, true, 0, GL_READ_WRITE, GL_R32UI);
+
+    pass.next("depths");
+
+    // Only writes the image
+    glColorMask(false, false, false, false);
+
+    v.depth_prg->use();
+    v.depth_prg->uniform<int32_t>("abuffer") = 0;
+    draw_with_alpha(*v.depth_prg, mv, proj, alpha, sections, draw_mode);
+
+    glColorMask(true, true, true, true);
+
+    glBindImageTexture(0, v.colors.glid(), 0, true, 0, GL_WRITE_ONLY, GL_RGBA8_SNORM);
+
+    pass.next("colors");
+
+    clear_bamc(fb_bamc);
+
+    glEnable(GL_BLEND);
+    glBlendFunci(0, GL_ONE, GL_ONE);
+    glBlendFunci(1, GL_ZERO, GL_SRC_COLOR);
+
+    v.keys.bind();
+    v.color_prg->use();
+    v.color_prg->uniform<int32_t>("colors") = 0;
+    v.color_prg->uniform<array_texture>("abuffer") = v.keys;
+    draw_with_alpha(*v.color_prg, mv, proj, alpha, sections, draw_mode);
+
+    glBindImageTexture(0, 0, 0, false, 0, GL_WRITE_ONLY, GL_RGBA8_SNORM);
+
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    pass.next("resolve");
+
+    resolve_abuf_atomic(fb_bamc, *v.resolve_prg, v.colors, "colors", quad_va);
+
+    glDisable(GL_BLEND);
+}
+
+
+// Like abuf_atomic(), but in a single geometry pass: The keys in @v.keys
+// contain a quantized depth and the color, so whatever is pushed out of the
+// last layer can be accumulated into the tail right away.
+static void abuf_atomic_packed(framebuffer &fb_bamc, AtomicABufferVariant &v,
+                               const mat4 &mv, const mat4 &proj, float alpha,
+                               const std::vector<ObjectSection> &sections,
+                               GLenum draw_mode, vertex_array &quad_va)
+{
+    GPUScope scope("abuf_atomic_packed");
+    GPUScope pass("clear");
+
+    uint32_t dc = 0xffffffffu;
+    glClearTexImage(v.keys.glid(), 0, GL_RED_INTEGER, GL_UNSIGNED_INT, &dc);
+
+    array_texture::unbind(v.keys.tmu());
+
+    glBindImageTexture(0, v.keys.glid(), 0, true, 0, GL_READ_WRITE, GL_R32UI);
+
+    clear_bamc(fb_bamc);
+
+    pass.next("geometry");
+
+    glEnable(GL_BLEND);
+    glBlendFunci(0, GL_ONE, GL_ONE);
+    glBlendFunci(1, GL_ZERO, GL_SRC_COLOR);
+
+    v.packed_prg->use();
+    v.packed_prg->uniform<int32_t>("abuffer") = 0;
+    draw_with_alpha(*v.packed_prg, mv, proj, alpha, sections, draw_mode);
+
+    glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_R32UI);
+
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    pass.next("resolve");
+
+    resolve_abuf_atomic(fb_bamc, *v.packed_resolve_prg, v.keys, "abuffer",
+                        quad_va);
+
+    glDisable(GL_BLEND);
+}
+
+
+struct FrameStats {
+    double mean, median, p95, p99;
+};
+
+
+// Sorts @times in the process
+static FrameStats frame_stats(std::vector<double> &times)
+{
+    FrameStats stats = {0.0, 0.0, 0.0, 0.0};
+
+    if (times.empty()) {
+        return stats;
+    }
+
+    std::sort(times.begin(), times.end());
+
+    for (double t: times) {
+        stats.mean += t;
+    }
+    stats.mean /= times.size();
+
+    size_t n = times.size();
+    stats.median = n % 2 ? times[n / 2]
+                         : (times[n / 2 - 1] + times[n / 2]) / 2.0;
+
+    // Nearest-rank percentiles
+    stats.p95 = times[static_cast<size_t>(ceil(.95 * n)) - 1];
+    stats.p99 = times[static_cast<size_t>(ceil(.99 * n)) - 1];
+
+    return stats;
+}
+
+
+// Compares dake's OBJ loader against load_obj_parallel() with increasing
+// thread counts (best of three runs each)
+static int obj_benchmark(const char *fname)
+{
+    auto best_of_3 = [](const std::function<void()> &fn) {
+        double best = HUGE_VAL;
+        for (int i = 0; i < 3; i++) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            fn();
+            best = std::min(best, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() / 1000.);
+        }
+        return best;
+    };
+
+    auto vertex_count = [](const obj &o) {
+        size_t count = 0;
+        for (const obj_section &sec: o.sections) {
+            count += sec.positions.size();
+        }
+        return count;
+    };
+
+    FILE *fp = fopen(fname, "rb");
+    if (!fp) {
+        perror(fname);
+        return 1;
+    }
+    fseek(fp, 0, SEEK_END);
+    double mb = ftell(fp) / 1048576.;
+    fclose(fp);
+
+    obj reference;
+    double ref_ms = best_of_3([&]() { reference = load_obj(fname); });
+    fprintf(stderr, "%s (%.1f MB, %zu vertices)\n", fname, mb,
+            vertex_count(reference));
+    fprintf(stderr, "  dake::gl::load_obj:        %8.1f ms  %7.1f MB/s\n",
+            ref_ms, mb / ref_ms * 1000.);
+
+    int max_threads = std::max(1u, std::thread::hardware_concurrency());
+    double single_ms = 0.;
+    for (int threads = 1; threads <= max_threads;
+         threads = threads < max_threads ? std::min(threads * 2, max_threads)
+                                         : max_threads + 1)
+    {
+        obj loaded;
+        bool ok = true;
+        double ms = best_of_3([&]() {
+            loaded = obj();
+            ok = load_obj_parallel(fname, &loaded, threads) && ok;
+        });
+        if (!ok) {
+            return 1;
+        }
+        if (threads == 1) {
+            single_ms = ms;
+        }
+
+        fprintf(stderr, "  load_obj_parallel (%3i):   %8.1f ms  %7.1f MB/s  "
+                        "%5.2fx vs. 1 thread, %5.2fx vs. dake%s\n",
+                threads, ms, mb / ms * 1000., single_ms / ms, ref_ms / ms,
+                vertex_count(loaded) == vertex_count(reference)
+                ? "" : " (vertex count differs!)");
+    }
+
+    return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+    const char *bg_tex_name, *entity_name = "entity.obj";
+    const char *bench_fname = nullptr, *trace_fname = nullptr;
+    const char *quality_dir = nullptr;
+    bool entity_gradient = true, borderless = false, two_objects = true;
+    bool pixel_sync = false, bfcull = false, quality = false;
+    bool compact_nodes = false, obj_bench = false, indexed_mesh = true;
+    const char *cache_dir = "shader_cache";
+    int bench_frames = 256, max_layers = 8, adtp_nodes = 4, baab_layers = 4;
+    int abuf_fragments = 32, hytp_layers = 4;
+
+    static const struct option options[] = {
+        {"help", no_argument, nullptr, 'h'},
+        {"entity", required_argument, nullptr, 'e'},
+        {"material", no_argument, nullptr, 'm'},
+        {"borderless", no_argument, nullptr, 'b'},
+        {"single", no_argument, nullptr, 's'},
+        {"pixel-sync", no_argument, nullptr, 'y'},
+        {"cull-backfaces", no_argument, nullptr, 'c'},
+        {"resolution", required_argument, nullptr, 'r'},
+        {"bench", required_argument, nullptr, 'B'},
+        {"bench-frames", required_argument, nullptr, 'n'},
+        {"gpu-trace", required_argument, nullptr, 'T'},
+        {"quality", optional_argument, nullptr, 'Q'},
+        {"max-layers", required_argument, nullptr, 'l'},
+        {"adaptive-nodes", required_argument, nullptr, 'a'},
+        {"abuffer-layers", required_argument, nullptr, 'k'},
+        {"compact-nodes", no_argument, nullptr, 'C'},
+        {"abuffer-fragments", required_argument, nullptr, 'F'},
+        {"hybrid-layers", required_argument, nullptr, 'H'},
+        {"define", required_argument, nullptr, 'D'},
+        {"shader-cache", required_argument, nullptr, 'S'},
+        {"no-shader-cache", no_argument, nullptr, 'N'},
+        {"obj-bench", no_argument, nullptr, 'O'},
+        {"unindexed", no_argument, nullptr, 'U'},
+
+        {nullptr, 0, nullptr, 0}
+    };
+
+    for (;;) {
+        int option = getopt_long(argc, argv, "he:mbsycr:B:n:T:Q::l:a:k:CF:H:D:S:NOU", options, nullptr);
+        if (option == -1) {
+            break;
+        }
+
+        switch (option) {
+            case 'h':
+            case '?':
+                fprintf(stderr, "Usage: %s [options...] <bg-texture.(png|jpg)>\n\n", argv[0]);
+                fprintf(stderr, "Options:\n");
+                fprintf(stderr, "  -h, --help                   Shows this information\n");
+                fprintf(stderr, "  -e, --entity=<entity.obj>    Chooses a mesh to be displayed\n");
+                fprintf(stderr, "  -m, --material               Uses the material as specified by the entity,\n");
+                fprintf(stderr, "                               instead of generating a gradient\n");
+                fprintf(stderr, "  -b, --borderless             Run borderless in 1920x1080\n");
+                fprintf(stderr, "  -s, --single                 Draw only a single object\n");
+                fprintf(stderr, "  -y, --pixel-sync             Use GL_INTEL_fragment_shader_ordering\n");
+                fprintf(stderr, "                               if available\n");
+                fprintf(stderr, "  -c, --cull-backfraces        Enable backface culling\n");
+                fprintf(stderr, "  -r, --resolution=<w>x<h>     Sets the window size (default: 1280x720)\n");
+                fprintf(stderr, "  -B, --bench=<results.csv>    Runs every mode on every object set with\n");
+                fprintf(stderr, "                               vsync disabled and appends frame time\n");
+                fprintf(stderr, "                               statistics to the given CSV file\n");
+                fprintf(stderr, "  -n, --bench-frames=<n>       Frames measured per mode (default: 256)\n");
+                fprintf(stderr, "  -T, --gpu-trace=<trace.json> Measures the GPU time of every pass and\n");
+                fprintf(stderr, "                               writes it in Chrome's trace format on exit\n");
+                fprintf(stderr, "  -Q, --quality[=<dir>]        With --bench: Compares frames against the\n");
+                fprintf(stderr, "                               exact result (rendered on the CPU) and\n");
+                fprintf(stderr, "                               reports RMSE, PSNR and the maximum error;\n");
+                fprintf(stderr, "                               reference PNGs are loaded from and stored\n");
+                fprintf(stderr, "                               in <dir> if given\n");
+                fprintf(stderr, "  -l, --max-layers=<n>         Maximum number of layers to peel (default: 8;\n");
+                fprintf(stderr, "                               peeling stops early once all are peeled)\n");
+                fprintf(stderr, "  -a, --adaptive-nodes=<n>     Nodes per pixel for adaptive transparency\n");
+                fprintf(stderr, "                               (2, 4, 8 or 16; default: 4)\n");
+                fprintf(stderr, "  -k, --abuffer-layers=<n>     Layers of the bounded atomic A-buffer\n");
+                fprintf(stderr, "                               (4, 8 or 16; default: 4)\n");
+                fprintf(stderr, "  -C, --compact-nodes          Use 8 byte nodes for the linked list A-buffer\n");
+                fprintf(stderr, "                               (16 bit depth, RGB 5:6:5 color) instead of 16\n");
+                fprintf(stderr, "  -F, --abuffer-fragments=<n>  Fragments per pixel sorted when resolving the\n");
+                fprintf(stderr, "                               A-buffers in a fragment shader (default: 32)\n");
+                fprintf(stderr, "  -H, --hybrid-layers=<n>      Core layers of hybrid transparency (default: 4)\n");
+                fprintf(stderr, "  -D, --define=<name>[=<val>]  Overrides a tuning constant of the shaders,\n");
+                fprintf(stderr, "                               e.g. EPSILON or WEIGHT_SCALE, WEIGHT_EXPONENT\n");
+                fprintf(stderr, "                               and WEIGHT_MIN of the depth weighting, or the\n");
+                fprintf(stderr, "                               moment bias BIAS of moment-based OIT\n");
+                fprintf(stderr, "  -S, --shader-cache=<dir>     Directory for linked program binaries\n");
+                fprintf(stderr, "                               (default: shader_cache)\n");
+                fprintf(stderr, "  -N, --no-shader-cache        Always build all programs from source\n");
+                fprintf(stderr, "  -O, --obj-bench              Benchmarks loading the entity with dake's\n");
+                fprintf(stderr, "                               and the parallel OBJ loader and exits\n");
+                fprintf(stderr, "  -U, --unindexed              Draws the entity as a triangle soup instead\n");
+                fprintf(stderr, "                               of indexed (for comparison)\n");
+                fprintf(stderr, "\nKeys:\n");
+                fprintf(stderr, "  Space/Backspace              Next/previous mode\n");
+                fprintf(stderr, "  Return                       Switch between the mesh and quads\n");
+                fprintf(stderr, "  P                            Pause the motion\n");
+                fprintf(stderr, "  L                            Show a single layer (where supported)\n");
+                fprintf(stderr, "  T                            Show GPU pass times in the window title\n");
+                fprintf(stderr, "  N                            Cycle the adaptive transparency node count\n");
+                fprintf(stderr, "  K                            Cycle the bounded A-buffer layer count\n");
+                fprintf(stderr, "  M                            Print the GPU memory used by the current mode\n");
+                fprintf(stderr, "  G                            Render the current frame on the CPU (exact\n");
+                fprintf(stderr, "                               order-independent result) to reference.png\n");
+                return 0;
+
+            case 'e':
+                entity_name = optarg;
+                break;
+
+            case 'm':
+                entity_gradient = false;
+                break;
+
+            case 'b':
+                WIDTH = 1920;
+                HEIGHT = 1080;
+                borderless = true;
+                break;
+
+            case 's':
+                two_objects = false;
+                break;
+
+            case 'y':
+                pixel_sync = true;
+                break;
+
+            case 'c':
+                bfcull = true;
+                break;
+
+            case 'r':
+                if (sscanf(optarg, "%dx%d", &WIDTH, &HEIGHT) != 2 ||
+                    WIDTH <= 0 || HEIGHT <= 0)
+                {
+                    fprintf(stderr, "Invalid resolution \"%s\"\n", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'B':
+                bench_fname = optarg;
+                break;
+
+            case 'n':
+                bench_frames = atoi(optarg);
+                if (bench_frames <= 0) {
+                    fprintf(stderr, "Invalid frame count \"%s\"\n", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'T':
+                trace_fname = optarg;
+                break;
+
+            case 'Q':
+                quality = true;
+                quality_dir = optarg;
+                break;
+
+            case 'l':
+                max_layers = atoi(optarg);
+                if (max_layers <= 0) {
+                    fprintf(stderr, "Invalid layer count \"%s\"\n", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'a':
+                adtp_nodes = atoi(optarg);
+                if (adtp_nodes != 2 && adtp_nodes != 4 && adtp_nodes != 8 &&
+                    adtp_nodes != 16)
+                {
+                    fprintf(stderr, "Invalid node count \"%s\"\n", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'C':
+                compact_nodes = true;
+                break;
+
+            case 'k':
+                baab_layers = atoi(optarg);
+                if (baab_layers != 4 && baab_layers != 8 && baab_layers != 16) {
+                    fprintf(stderr, "Invalid layer count \"%s\"\n", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'F':
+                abuf_fragments = atoi(optarg);
+                if (abuf_fragments <= 0 || abuf_fragments > 64) {
+                    fprintf(stderr, "Invalid fragment count \"%s\"\n", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'H':
+                hytp_layers = atoi(optarg);
+                if (hytp_layers <= 0 || hytp_layers > 16) {
+                    fprintf(stderr, "Invalid layer count \"%s\"\n", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'D': {
+                char *eq = strchr(optarg, '=');
+                if (eq) {
+                    shader_overrides.set(std::string(optarg, eq), eq + 1);
+                } else {
+                    shader_overrides.set(optarg);
+                }
+                break;
+            }
+
+            case 'S':
+                cache_dir = optarg;
+                break;
+
+            case 'N':
+                cache_dir = nullptr;
+                break;
+
+            case 'O':
+                obj_bench = true;
+                break;
+
+            case 'U':
+                indexed_mesh = false;
+                break;
+        }
+    }
+
+    if (obj_bench) {
+        return obj_benchmark(entity_name);
+    }
+
+    if (optind != argc - 1) {
+        fprintf(stderr, "Expecting exactly one non-option argument\n");
+        return 1;
+    }
+
+    if (quality && !bench_fname) {
+        fprintf(stderr, "--quality requires --bench\n");
+        return 1;
+    }
+
+    bg_tex_name = argv[optind];
+
+    SDL_Init(SDL_INIT_VIDEO);
+
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK,
+                        SDL_GL_CONTEXT_PROFILE_CORE);
+
+    SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
+    SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
+
+    SDL_Window *wnd = SDL_CreateWindow("transp", SDL_WINDOWPOS_UNDEFINED,
+                                       SDL_WINDOWPOS_UNDEFINED, WIDTH, HEIGHT,
+                                       SDL_WINDOW_OPENGL
+                                       | (borderless * SDL_WINDOW_BORDERLESS));
+    SDL_GL_CreateContext(wnd);
+
+    // The benchmark wants to know how fast we can go, not how fast the
+    // display is
+    SDL_GL_SetSwapInterval(bench_fname ? 0 : 1);
+
+
+    glext.init();
+
+    std::chrono::steady_clock::time_point startup_tp = std::chrono::steady_clock::now();
+
+    pixel_sync &= glext.has_extension("GL_INTEL_fragment_shader_ordering");
+
+    if (cache_dir && glext.has_extension("GL_ARB_get_program_binary")) {
+        program_cache = ProgramCache::create(cache_dir);
+    }
+
+    // Let the driver build programs in the background (see prepare_mode)
+    if (glext.has_extension("GL_KHR_parallel_shader_compile")) {
+        glMaxShaderCompilerThreadsKHR(0xffffffffu);
+        ComputeProgram::parallel_compile = true;
+        RenderProgram::parallel_compile = true;
+    }
+
+    if (trace_fname) {
+        gpu_timer = new GPUTimer(true);
+    }
+
+
+    texture input(bg_tex_name);
+
+    vertex_array quad;
+    quad.set_elements(4);
+
+    vec2 quad_vertex_positions[] = {
+        vec2(-1.f, 1.f), vec2(-1.f, -1.f), vec2(1.f, 1.f), vec2(1.f, -1.f)
+    };
+
+    quad.attrib(0)->format(2);
+    quad.attrib(0)->data(quad_vertex_positions);
+
+
+    texture abuf_ll_head;
+    abuf_ll_head.format(GL_R32UI, WIDTH, HEIGHT, GL_RED_INTEGER, GL_UNSIGNED_INT);
+
+    // Node layout of the linked list A-buffer, for all of its shaders
+    std::string abuf_nodes;
+    bool have_ssbo = glext.has_extension("GL_ARB_shader_image_load_store")
+                  && glext.has_extension("GL_ARB_shader_storage_buffer_object")
+                  && load_shader_source("abuf_nodes.glsl",
+                                        compact_nodes ? "#define COMPACT_NODES\n"
+                                                      : "",
+                                        abuf_nodes);
+
+    // Starts with 4M nodes (64 MB, or 32 MB if compact) and grows as needed;
+    // compact nodes can only link 2^24 - 1 nodes
+    FragmentPool *abuf_pool = nullptr;
+    if (have_ssbo) {
+        abuf_pool = compact_nodes ? new FragmentPool(2048 * 2048, 8, 0xffffff)
+                                  : new FragmentPool(2048 * 2048, 16);
+    }
+
+    bool have_compute = have_ssbo
+                     && glext.has_extension("GL_ARB_compute_shader");
+
+    // Resolving the linked lists with a compute shader is faster (if
+    // available); built by prepare_mode()
+    ABufferResolve *abuf_resolve = nullptr;
+    texture abuf_resolved;
+    if (have_compute) {
+        abuf_resolved.format(GL_RGBA8, WIDTH, HEIGHT);
+        abuf_resolved.tmu() = 2;
+    }
+
+    // Per-pixel fragment counts and offsets for the prefix sum A-buffer,
+    // whose nodes are only half as large (no next pointer)
+    FragmentPool *abps_pool = nullptr;
+    PrefixSum *abps_scan = nullptr;
+    GLuint abps_counts = 0, abps_offsets = 0;
+    if (have_compute) {
+        abps_pool = new FragmentPool(2048 * 2048, 8);
+
+        for (GLuint *buf: {&abps_counts, &abps_offsets}) {
+            glGenBuffers(1, buf);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, *buf);
+            glBufferStorage(GL_SHADER_STORAGE_BUFFER, WIDTH * HEIGHT * 4,
+                            nullptr, 0);
+        }
+    }
+
+    // Stochastic transparency needs to write gl_SampleMask
+    MultisampleFramebuffer *stoch_fb = nullptr;
+    if (glext.has_extension("GL_ARB_sample_shading")) {
+        stoch_fb = new MultisampleFramebuffer(WIDTH, HEIGHT, 8, GL_RGBA16F);
+    }
+
+
+    // Constants shared by the shaders and the textures they use
+    std::string abuf_defines = ShaderDefines().set("K", abuf_fragments).str();
+    std::string hytp_defines = ShaderDefines().set("LAYERS", hytp_layers).str();
+
+    RenderProgram &draw_tex_prg    = *quad_program("draw_tex_frag.glsl");
+    RenderProgram &draw_bamy1_prg  = *quad_program("draw_bamy1_frag.glsl");
+    RenderProgram &draw_bamc1_prg  = *quad_program("draw_bamc1_frag.glsl");
+    RenderProgram &draw_abuf2_prg  = *quad_program("draw_abuf2_frag.glsl");
+    RenderProgram &draw_blend_prg  = *quad_program("draw_blend_frag.glsl");
+    RenderProgram &draw_carry_prg  = *quad_program("draw_carry_frag.glsl");
+    RenderProgram &draw_mboit2_prg = *quad_program("draw_mboit2_frag.glsl");
+
+    RenderProgram &draw_bf_prg      = *object_program("draw_bf_frag.glsl");
+    RenderProgram &draw_ff_prg      = *object_program("draw_ff_frag.glsl");
+    RenderProgram &draw_dp_prg      = *object_program("draw_dp_frag.glsl");
+    RenderProgram &draw_ddp0_prg    = *object_program("draw_ddp0_frag.glsl");
+    RenderProgram &draw_ddp1_prg    = *object_program("draw_ddp1_frag.glsl");
+    RenderProgram &draw_bfdp_prg    = *object_program("draw_bfdp_frag.glsl");
+    RenderProgram &draw_ffdp_prg    = *object_program("draw_ffdp_frag.glsl");
+    RenderProgram &draw_simple_prg  = *object_program("draw_simple_frag.glsl");
+    RenderProgram &draw_meshk_prg   = *object_program("draw_meshk_frag.glsl");
+    RenderProgram &draw_bamy0_prg   = *object_program("draw_bamy0_frag.glsl");
+    RenderProgram &draw_bamc0_prg   = *object_program("draw_bamc0_frag.glsl");
+    RenderProgram &draw_mboit0_prg  = *object_program("draw_mboit0_frag.glsl");
+    RenderProgram &draw_mboit1_prg  = *object_program("draw_mboit1_frag.glsl");
+    RenderProgram &draw_mboit0x_prg = *object_program("draw_mboit0x_frag.glsl");
+    RenderProgram &draw_mboit1x_prg = *object_program("draw_mboit1x_frag.glsl");
+    // Weighting function tunable with -D WEIGHT_*
+    RenderProgram &draw_bamc0w_prg  = *object_program("draw_bamc0w_frag.glsl");
+
+    // Programs of the modes which need GL 4 features, built by
+    // prepare_mode() once such a mode is used
+    RenderProgram *draw_abuf0_prg = nullptr, *draw_abuf1_prg = nullptr;
+    RenderProgram *draw_abuf1l_prg = nullptr;
+    RenderProgram *draw_abps0_prg = nullptr, *draw_abps1_prg = nullptr;
+    RenderProgram *draw_abps2_prg = nullptr;
+    RenderProgram *draw_hytp0_prg = nullptr, *draw_hytp1_prg = nullptr;
+    RenderProgram *draw_hytp2_prg = nullptr, *draw_hytp3_prg = nullptr;
+    RenderProgram *draw_hytp4_prg = nullptr;
+    RenderProgram *draw_stoch_prg = nullptr;
+
+    draw_bamy0_prg.bind_frag("out_count", 1);
+    draw_bamc0_prg.bind_frag("out_transp", 1);
+    draw_bamc0w_prg.bind_frag("out_transp", 1);
+    draw_dp_prg.bind_frag("out_depth", 1);
+    for (RenderProgram *prg: {&draw_mboit0_prg, &draw_mboit0x_prg}) {
+        prg->bind_frag("out_absorbance", 0);
+        prg->bind_frag("out_moments", 1);
+    }
+    draw_mboit0x_prg.bind_frag("out_moments_high", 2);
+    for (RenderProgram *prg: {&draw_ddp0_prg, &draw_ddp1_prg}) {
+        prg->bind_frag("out_depth", 0);
+        prg->bind_frag("out_front", 1);
+        prg->bind_frag("out_back", 2);
+    }
+
+    // The modes using these programs need nothing beyond GL 3, so they are
+    // built right away (all at the same time, with
+    // GL_KHR_parallel_shader_compile)
+    bool programs_ok = true;
+    programs_ready({&draw_tex_prg, &draw_bamy1_prg, &draw_bamc1_prg,
+                    &draw_abuf2_prg, &draw_blend_prg, &draw_carry_prg,
+                    &draw_mboit2_prg, &draw_bf_prg, &draw_ff_prg,
+                    &draw_dp_prg, &draw_ddp0_prg, &draw_ddp1_prg,
+                    &draw_bfdp_prg, &draw_ffdp_prg, &draw_simple_prg,
+                    &draw_meshk_prg, &draw_bamy0_prg, &draw_bamc0_prg,
+                    &draw_mboit0_prg, &draw_mboit1_prg, &draw_mboit0x_prg,
+                    &draw_mboit1x_prg, &draw_bamc0w_prg},
+                   true, programs_ok);
+    if (!programs_ok) {
+        return 1;
+    }
+
+    std::chrono::steady_clock::time_point mesh_tp = std::chrono::steady_clock::now();
+    Mesh *entity = Mesh::load(entity_name, entity_gradient);
+    if (!entity) {
+        return 1;
+    }
+
+    std::vector<ObjectSection> entity_secs;
+    vec3 ur = entity->upper_right, ll = entity->lower_left;
+    float scale = 1.5f / maximum(
+                            maximum(fabsf(ur.x()), maximum(fabsf(ur.y()), fabsf(ur.z()))),
+                            maximum(fabsf(ll.x()), maximum(fabsf(ll.y()), fabsf(ll.z())))
+                        );
+    // The second object is drawn with the triangle order reversed
+    size_t triangles = 0, vertices = 0;
+    float acmr_sum = 0.f, original_acmr_sum = 0.f;
+    for (int copy = 0; copy < (two_objects ? 2 : 1); copy++) {
+        for (Mesh::Section &sec: entity->sections) {
+            entity_secs.emplace_back();
+            ObjectSection &os = entity_secs.back();
+
+            if (indexed_mesh) {
+                os.va = sec.make_vertex_array(copy);
+                os.positions = sec.positions;
+                os.colors = sec.colors;
+                os.vertex_count = sec.vertex_count;
+                os.indices = sec.indices[copy];
+                os.index_count = sec.index_count;
+            } else {
+                vec3 *pos, *nrm, *col;
+                sec.make_soup(copy, &pos, &nrm, &col);
+
+                os.va = new vertex_array;
+                os.va->set_elements(sec.index_count);
+                os.va->attrib(0)->format(3);
+                os.va->attrib(0)->data(pos);
+                os.va->attrib(1)->format(3);
+                os.va->attrib(1)->data(nrm);
+                os.va->attrib(2)->format(3);
+                os.va->attrib(2)->data(col);
+                delete[] nrm;
+
+                os.positions = pos;
+                os.colors = col;
+                os.vertex_count = sec.index_count;
+            }
+
+            os.rel_mv = mat4::identity();
+            if (two_objects) {
+                os.rel_mv.translate(vec3(copy ? 2.f : -2.f, 0.f, 0.f));
+            }
+            os.rel_mv.scale(vec3(scale, scale, scale));
+
+            if (!copy) {
+                size_t tris = sec.index_count / 3;
+                triangles += tris;
+                vertices += sec.vertex_count;
+                acmr_sum += acmr(sec.indices[0], sec.index_count,
+                                 sec.vertex_count) * tris;
+                original_acmr_sum += acmr(sec.obj_indices, sec.index_count,
+                                          sec.vertex_count) * tris;
+            }
+        }
+    }
+
+    fprintf(stderr, "Mesh %s: %.1f ms (%s)\n", entity_name,
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - mesh_tp).count() / 1000.f,
+            entity->cached() ? "mapped from cache" : "parsed, cache written");
+    fprintf(stderr, "  %zu triangles, %zu unique vertices; ACMR (FIFO %i): "
+                    "%.3f optimized, %.3f in OBJ order, 3 unindexed%s\n",
+            triangles, vertices, VERTEX_CACHE_SIZE,
+            triangles ? acmr_sum / triangles : 0.f,
+            triangles ? original_acmr_sum / triangles : 0.f,
+            indexed_mesh ? "" : " (drawing unindexed)");
+
+    std::vector<ObjectSection> quad_secs;
+    for (int x: {-1, 1}) {
+        if (!two_objects) {
+            if (x < 0) {
+                x = 0;
+            } else {
+                break;
+            }
+        }
+        for (int rl = 0; rl < 3; rl++) {
+            int l = x < 0 ? rl : 2 - rl;
+
+            vec3 *pos = new vec3[4], *col = new vec3[4], nrm[4];
+            for (int i = 0; i < 4; i++) {
+                pos[i] = vec3(quad_vertex_positions[i]);
+                nrm[i] = vec3(0.f, 0.f, 1.f);
+                col[i] = l == 0 ? vec3(1.f, .5f, .5f)
+                       : l == 1 ? vec3(.5f, 1.f, .5f)
+                       :          vec3(.5f, .5f, 1.f);
+            }
+
+
+            quad_secs.emplace_back();
+            quad_secs.back().va = new vertex_array;
+            quad_secs.back().va->set_elements(4);
+            quad_secs.back().va->attrib(0)->format(3);
+            quad_secs.back().va->attrib(0)->data(pos);
+            quad_secs.back().va->attrib(1)->format(3);
+            quad_secs.back().va->attrib(1)->data(nrm);
+            quad_secs.back().va->attrib(2)->format(3);
+            quad_secs.back().va->attrib(2)->data(col);
+            quad_secs.back().rel_mv = mat4::identity().translated(vec3(x * 2.f + l * .2f, -l * .2f, l * .1f));
+            quad_secs.back().positions = pos;
+            quad_secs.back().colors = col;
+            quad_secs.back().vertex_count = 4;
+        }
+    }
+
+
+    framebuffer fbs[2] = {
+        framebuffer(1),
+        framebuffer(1)
+    };
+    framebuffer fb_bamy(2, GL_RGB16F), fb_bamc(2), fb_hytp(2);
+
+    framebuffer fb_ddp[2] = {
+        framebuffer(3),
+        framebuffer(3)
+    };
+
+    framebuffer fb_ddp_front(1, GL_RGBA16F);
+
+    // Absorbance and four or eight of its moments, and the accumulated color
+    framebuffer fb_mboit4(2, GL_RGBA32F), fb_mboit8(3, GL_RGBA32F);
+    framebuffer fb_mboit_accum(1, GL_RGBA16F);
+
+    // Accumulated color, depth of the layer to be peeled
+    PingPongFramebuffer fb_dp(WIDTH, HEIGHT, {GL_RGBA16F}, {GL_R32F});
+
+    // Dual depth peeling and the screen-space refraction peel two layers per
+    // pass
+    int dual_passes = (max_layers + 1) / 2;
+    PeelQuery peel_query;
+
+    for (framebuffer &fb: fb_ddp) {
+        fb.color_format(0, GL_RG32F);
+        fb.resize(WIDTH, HEIGHT);
+    }
+    fb_ddp_front.resize(WIDTH, HEIGHT);
+
+    fb_bamc.color_format(0, GL_RGBA16F);
+    fb_bamc.color_format(1, GL_RED);
+
+    for (framebuffer *fb: {&fb_mboit4, &fb_mboit8}) {
+        fb->color_format(0, GL_R32F);
+        fb->resize(WIDTH, HEIGHT);
+        (*fb)[1].tmu() = 1;
+    }
+    fb_mboit8[2].tmu() = 2;
+    fb_mboit_accum.resize(WIDTH, HEIGHT);
+    fb_mboit_accum[0].tmu() = 1;
+
+    fb_hytp.color_format(0, GL_R16F);
+    fb_hytp.color_format(1, GL_R8_SNORM);
+
+    fbs[0].resize(WIDTH, HEIGHT);
+    fbs[1].resize(WIDTH, HEIGHT);
+    fb_bamy.resize(WIDTH, HEIGHT);
+    fb_bamc.resize(WIDTH, HEIGHT);
+    fb_hytp.resize(WIDTH, HEIGHT);
+
+    fbs[0].depth().tmu() = 1;
+    fbs[1].depth().tmu() = 1;
+    fb_bamy[1].tmu() = 1;
+    fb_bamc[1].tmu() = 1;
+    fb_hytp[0].tmu() = 1;
+
+    // One variant per node count (2, 4, 8, 16), created on first use
+    AdaptiveVariant *adtp_variants[4] = {};
+    auto adaptive_variant = [&]() -> AdaptiveVariant * {
+        if (!glext.has_extension("GL_ARB_shader_image_load_store")) {
+            return nullptr;
+        }
+
+        int i = adtp_nodes == 2 ? 0 : adtp_nodes == 4 ? 1 : adtp_nodes == 8 ? 2 : 3;
+        if (!adtp_variants[i]) {
+            adtp_variants[i] = create_adaptive_variant(adtp_nodes, pixel_sync);
+        }
+        return adtp_variants[i];
+    };
+
+    texture *adtp_l = nullptr;
+    if (!pixel_sync) {
+        adtp_l = new texture;
+        adtp_l->format(GL_R32UI, WIDTH, HEIGHT, GL_RED_INTEGER);
+    }
+
+    array_texture hytp, hytp_col;
+    hytp.format(GL_R32UI, WIDTH, HEIGHT, hytp_layers, GL_RED_INTEGER);
+    hytp_col.format(GL_RGBA8, WIDTH, HEIGHT, hytp_layers);
+    // Read together with fb_bamc by the single-pass hybrid transparency
+    hytp.tmu() = 2;
+    hytp_col.tmu() = 3;
+
+    // One variant per layer count (4, 8, 16), created on first use
+    AtomicABufferVariant *baab_variants[3] = {};
+    auto abuf_atomic_variant = [&]() -> AtomicABufferVariant * {
+        if (!glext.has_extension("GL_ARB_shader_image_load_store")) {
+            return nullptr;
+        }
+
+        int i = baab_layers == 4 ? 0 : baab_layers == 8 ? 1 : 2;
+        if (!baab_variants[i]) {
+            baab_variants[i] = create_abuf_atomic_variant(baab_layers);
+        }
+        return baab_variants[i];
+    };
+
+
+    mat4 mv = mat4::identity().translated(vec3(0.f, 0.f, -5.f));
+    float aspect = static_cast<float>(WIDTH) / HEIGHT;
+    //mat4 p = mat4::projection(M_PIf / 32.f, aspect, .1f, 10.f);
+    float lr = two_objects ? 4.f : 2.f;
+    mat4 p = mat4::orthographic(-lr, lr, lr / aspect, -lr / aspect, 0.f, 10.f);
+
+    std::default_random_engine reng;
+    std::uniform_real_distribution<float> dist(-.8f, .8f);
+    float z_comp = 0.f, z_target = 0.f, z_comp_deriv = 0.f;
+
+    enum Mode {
+        BLEND_ALPHA,
+        BLEND_ALPHA_DP,
+        BLEND_ALPHA_DDP,
+        ABUFFER_LL,
+        ABUFFER_PS,
+        BOUNDED_ATOMIC_ABUFFER,
+        BOUNDED_ATOMIC_ABUFFER_PACKED,
+        HYBRID_TRANSPARENCY,
+        HYBRID_TRANSPARENCY_1P,
+        ADAPTIVE_TRANSPARENCY,
+        ADAPTIVE_TRANSPARENCY_ATOMIC,
+        ADAPTIVE_TRANSPARENCY_TEMPORAL,
+        BLEND_MESHKIN,
+        BLEND_BAVOIL_MYER,
+        BLEND_BAVOIL_MCGUIRE,
+        BLEND_BAVOIL_MCGUIRE_WEIGHT,
+        BLEND_MBOIT4,
+        BLEND_MBOIT8,
+        STOCHASTIC_TRANSPARENCY,
+        STOCHASTIC_TRANSPARENCY_ACCUM,
+        SS_REFRACT,
+        SS_REFRACT_DP,
+        BLEND_ADD,
+        BLEND_MULT,
+
+        MODE_MAX
+    } mode = BLEND_ALPHA;
+
+    const char *mode_str[] = {
+        "plain alpha blending",
+        "alpha blending with depth peeling",
+        "alpha blending with dual depth peeling",
+        "alpha blending with an A-buffer (linked list)",
+        "alpha blending with an A-buffer (prefix sum)",
+        "alpha blending with an A-buffer (atomics, bounded)",
+        "alpha blending with an A-buffer (atomics, bounded, single pass)",
+        "hybrid transparency",
+        "hybrid transparency (single pass)",
+        "adaptive transparency",
+        "adaptive transparency (lock-free)",
+        "adaptive transparency (temporal)",
+        "Meshkin's blending",
+        "Bavoil's and Myer's blending",
+        "Bavoil's and McGuire's blending",
+        "Bavoil's and McGuire's blending with depth weighting",
+        "moment-based OIT (4 power moments)",
+        "moment-based OIT (8 power moments)",
+        "stochastic transparency",
+        "stochastic transparency with accumulation",
+        "screen-space refraction and absorption",
+        "screen-space refraction and absorption with depth peeling",
+        "additive blending",
+        "multiplicative blending"
+    };
+
+    enum Objects {
+        SUZANNE,
+        QUADS,
+
+        OBJECTS_MAX
+    } objects = SUZANNE;
+
+    const char *objects_str[] = {
+        "suzanne",
+        "quads"
+    };
+
+
+    std::vector<ObjectSection> *cur_obj = &entity_secs;
+    GLenum cur_draw_mode = GL_TRIANGLES;
+    bool need_fbs = false;
+    bool pause_motion = false;
+    bool gpu_summary = false;
+    int dp_layer = -1;
+
+    char window_title[256];
+
+    // Mode name including its configuration (where it has one)
+    auto mode_label = [&](Mode m) {
+        std::string label = mode_str[m];
+        if (m == ADAPTIVE_TRANSPARENCY || m == ADAPTIVE_TRANSPARENCY_ATOMIC ||
+            m == ADAPTIVE_TRANSPARENCY_TEMPORAL)
+        {
+            label += " [" + std::to_string(adtp_nodes) + " nodes]";
+        } else if (m == BOUNDED_ATOMIC_ABUFFER ||
+                   m == BOUNDED_ATOMIC_ABUFFER_PACKED)
+        {
+            label += " [" + std::to_string(baab_layers) + " layers]";
+        }
+        return label;
+    };
+
+    // Modes whose programs could not be built, by label: The programs of some
+    // modes depend on their configuration (node or layer count), so another
+    // configuration may still work
+    std::set<std::string> failed_modes;
+
+    // Whether the GL implementation supports a mode; its programs are only
+    // built by prepare_mode()
+    auto mode_available = [&](Mode m) {
+        if (failed_modes.count(mode_label(m))) {
+            return false;
+        }
+
+        switch (m) {
+            case ABUFFER_LL:
+                return have_ssbo;
+            case ABUFFER_PS:
+                return have_compute;
+            case BOUNDED_ATOMIC_ABUFFER:
+            case BOUNDED_ATOMIC_ABUFFER_PACKED:
+            case HYBRID_TRANSPARENCY:
+            case HYBRID_TRANSPARENCY_1P:
+            case ADAPTIVE_TRANSPARENCY:
+            case ADAPTIVE_TRANSPARENCY_ATOMIC:
+            case ADAPTIVE_TRANSPARENCY_TEMPORAL:
+                return glext.has_extension("GL_ARB_shader_image_load_store");
+            case STOCHASTIC_TRANSPARENCY:
+            case STOCHASTIC_TRANSPARENCY_ACCUM:
+                return stoch_fb != nullptr;
+            default:
+                return true;
+        }
+    };
+
+    // Node pool of modes which may run out of space
+    auto mode_pool = [&](Mode m) {
+        return m == ABUFFER_LL ? abuf_pool
+             : m == ABUFFER_PS ? abps_pool
+             : nullptr;
+    };
+
+    // GPU memory held by the resources a mode uses (node pools with their
+    // current size)
+    auto mode_memory = [&](Mode m) {
+        MemoryReport r;
+
+        switch (m) {
+            case BLEND_ALPHA_DP:
+                r.add_texture("fb_dp (accumulation)", GL_RGBA16F, WIDTH, HEIGHT);
+                r.add_texture("fb_dp (depth)", GL_R32F, WIDTH, HEIGHT, 2);
+                break;
+
+            case BLEND_ALPHA_DDP:
+                r.add_framebuffer("fb_ddp", {GL_RG32F, GL_RGBA, GL_RGBA,
+                                             GL_RG32F, GL_RGBA, GL_RGBA},
+                                  WIDTH, HEIGHT);
+                r.add("fb_ddp (depth attachment)", 4 * WIDTH * HEIGHT);
+                r.add_framebuffer("fb_ddp_front", {GL_RGBA16F}, WIDTH, HEIGHT);
+                break;
+
+            case ABUFFER_LL:
+                r.add_framebuffer("fb_bamc", {GL_RGBA16F, GL_RED}, WIDTH, HEIGHT);
+                r.add_texture("abuf_ll_head", GL_R32UI, WIDTH, HEIGHT);
+                if (have_compute) {
+                    r.add_texture("abuf_resolved", GL_RGBA8, WIDTH, HEIGHT);
+                    r.add("abuf_resolve (tile lists, dispatch parameters)",
+                          ABufferResolve::size_bytes(WIDTH, HEIGHT));
+                }
+                if (abuf_pool) {
+                    r.add(compact_nodes ? "abuf_pool (8 B nodes)"
+                                        : "abuf_pool (16 B nodes)",
+                          abuf_pool->size_bytes());
+                    r.add("abuf_pool (counter, read back ring)",
+                          abuf_pool->overhead_bytes());
+                }
+                break;
+
+            case ABUFFER_PS:
+                r.add_framebuffer("fb_bamc", {GL_RGBA16F, GL_RED}, WIDTH, HEIGHT);
+                r.add("abps_counts", 4 * WIDTH * HEIGHT);
+                r.add("abps_offsets", 4 * WIDTH * HEIGHT);
+                r.add("abps_scan (block totals)",
+                      PrefixSum::size_bytes(WIDTH * HEIGHT));
+                if (abps_pool) {
+                    r.add("abps_pool (8 B nodes)", abps_pool->size_bytes());
+                    r.add("abps_pool (counter, read back ring)",
+                          abps_pool->overhead_bytes());
+                }
+                break;
+
+            case BOUNDED_ATOMIC_ABUFFER:
+            case BOUNDED_ATOMIC_ABUFFER_PACKED:
+                r.add_framebuffer("fb_bamc", {GL_RGBA16F, GL_RED}, WIDTH, HEIGHT);
+                r.add_texture("baab keys", GL_R32UI, WIDTH, HEIGHT,
+                              baab_layers);
+                r.add_texture("baab colors", GL_RGBA8_SNORM, WIDTH, HEIGHT,
+                              baab_layers);
+                break;
+
+            case HYBRID_TRANSPARENCY:
+                r.add_framebuffer("fb_hytp", {GL_R16F, GL_R8_SNORM}, WIDTH, HEIGHT);
+                r.add_texture("hytp", GL_R32UI, WIDTH, HEIGHT, hytp_layers);
+                break;
+
+            case HYBRID_TRANSPARENCY_1P:
+                r.add_framebuffer("fb_bamc", {GL_RGBA16F, GL_RED}, WIDTH, HEIGHT);
+                r.add_texture("hytp", GL_R32UI, WIDTH, HEIGHT, hytp_layers);
+                r.add_texture("hytp_col", GL_RGBA8, WIDTH, HEIGHT,
+                              hytp_layers);
+                if (adtp_l) {
+                    r.add_texture("adtp_l (lock, shared)", GL_R32UI, WIDTH,
+                                  HEIGHT);
+                }
+                break;
+
+            case ADAPTIVE_TRANSPARENCY:
+            case ADAPTIVE_TRANSPARENCY_ATOMIC:
+            case ADAPTIVE_TRANSPARENCY_TEMPORAL: {
+                GLenum alpha_format, depth_format;
+                adaptive_formats(adtp_nodes, alpha_format, depth_format);
+                int layers = (adtp_nodes + 3) / 4;
+
+                r.add_texture("adtp alpha", alpha_format, WIDTH, HEIGHT,
+                              layers);
+                r.add_texture("adtp depth", depth_format, WIDTH, HEIGHT,
+                              layers);
+                if (m == ADAPTIVE_TRANSPARENCY_ATOMIC) {
+                    r.add_texture("adtp keys", GL_R32UI, WIDTH, HEIGHT,
+                                  adtp_nodes);
+                } else if (adtp_l) {
+                    r.add_texture("adtp_l (lock, shared)", GL_R32UI, WIDTH,
+                                  HEIGHT);
+                }
+                if (m == ADAPTIVE_TRANSPARENCY_TEMPORAL) {
+                    r.add_framebuffer("fb_bamc", {GL_RGBA16F, GL_RED}, WIDTH,
+                                      HEIGHT);
+                    r.add_texture("adtp history alpha", alpha_format, WIDTH,
+                                  HEIGHT, layers);
+                    r.add_texture("adtp history depth", depth_format, WIDTH,
+                                  HEIGHT, layers);
+                }
+                break;
+            }
+
+            case BLEND_MESHKIN:
+            case SS_REFRACT:
+            case SS_REFRACT_DP:
+                r.add_framebuffer("fbs", {GL_RGBA, GL_RGBA}, WIDTH, HEIGHT);
+                r.add("fbs (depth attachment)", 4 * WIDTH * HEIGHT);
+                break;
+
+            case BLEND_BAVOIL_MYER:
+                r.add_framebuffer("fb_bamy", {GL_RGB16F, GL_RGB16F}, WIDTH, HEIGHT);
+                break;
+
+            case BLEND_BAVOIL_MCGUIRE:
+            case BLEND_BAVOIL_MCGUIRE_WEIGHT:
+                r.add_framebuffer("fb_bamc", {GL_RGBA16F, GL_RED}, WIDTH, HEIGHT);
+                break;
+
+            case BLEND_MBOIT4:
+            case BLEND_MBOIT8:
+                if (m == BLEND_MBOIT4) {
+                    r.add_framebuffer("fb_mboit4", {GL_R32F, GL_RGBA32F},
+                                      WIDTH, HEIGHT);
+                } else {
+                    r.add_framebuffer("fb_mboit8",
+                                      {GL_R32F, GL_RGBA32F, GL_RGBA32F},
+                                      WIDTH, HEIGHT);
+                }
+                r.add_framebuffer("fb_mboit_accum", {GL_RGBA16F}, WIDTH, HEIGHT);
+                break;
+
+            case STOCHASTIC_TRANSPARENCY:
+            case STOCHASTIC_TRANSPARENCY_ACCUM:
+                if (stoch_fb) {
+                    r.add("stoch_fb", stoch_fb->size_bytes());
+                }
+                if (m == STOCHASTIC_TRANSPARENCY_ACCUM) {
+                    r.add_framebuffer("fb_bamc", {GL_RGBA16F, GL_RED}, WIDTH,
+                                      HEIGHT);
+                }
+                break;
+
+            default:
+                break;
+        }
+
+        return r;
+    };
+
+    // Builds the programs of a mode when it is used first and returns
+    // whether it can be rendered.  They are built in the background (with
+    // GL_KHR_parallel_shader_compile), so this may take a couple of frames
+    // unless @wait is set.  Once a mode is ready, its memory report is
+    // printed (once per configuration).
+    bool mode_built[MODE_MAX] = {};
+    // Modes (by label, as their resources depend on the configuration)
+    // whose memory has been reported
+    std::set<std::string> reported_modes;
+    auto prepare_mode = [&](Mode m, bool wait) {
+        if (!mode_available(m)) {
+            return false;
+        }
+
+        bool built = mode_built[m];
+        mode_built[m] = true;
+
+        bool ok = true, ready = true;
+        switch (m) {
+            case ABUFFER_LL:
+                if (!built) {
+                    draw_abuf0_prg = object_program("draw_abuf0_frag.glsl",
+                                                    abuf_nodes);
+                    draw_abuf0_prg->bind_frag("out_transp", 1);
+                    draw_abuf1_prg = quad_program("draw_abuf1_frag.glsl",
+                                                  abuf_defines + abuf_nodes);
+                    draw_abuf1l_prg = quad_program("draw_abuf1l_frag.glsl",
+                                                   abuf_defines + abuf_nodes);
+                    if (have_compute) {
+                        abuf_resolve = ABufferResolve::create(WIDTH, HEIGHT,
+                                                              abuf_nodes);
+                    }
+                }
+                ready = programs_ready({draw_abuf0_prg, draw_abuf1_prg,
+                                        draw_abuf1l_prg}, wait, ok);
+                if (abuf_resolve) {
+                    if (!wait && !abuf_resolve->ready()) {
+                        ready = false;
+                    } else if (!abuf_resolve->finish()) {
+                        // Resolve in a fragment shader instead
+                        delete abuf_resolve;
+                        abuf_resolve = nullptr;
+                    }
+                }
+                break;
+
+            case ABUFFER_PS:
+                if (!built) {
+                    draw_abps0_prg = object_program("draw_abps0_frag.glsl");
+                    draw_abps1_prg = object_program("draw_abps1_frag.glsl");
+                    draw_abps1_prg->bind_frag("out_transp", 1);
+                    draw_abps2_prg = quad_program("draw_abps2_frag.glsl",
+                                                  abuf_defines);
+                    abps_scan = PrefixSum::create(WIDTH * HEIGHT);
+                }
+                ok = abps_scan != nullptr;
+                ready = programs_ready({draw_abps0_prg, draw_abps1_prg,
+                                        draw_abps2_prg}, wait, ok);
+                if (abps_scan) {
+                    if (!wait && !abps_scan->ready()) {
+                        ready = false;
+                    } else {
+                        ok = abps_scan->finish() && ok;
+                    }
+                }
+                break;
+
+            case BOUNDED_ATOMIC_ABUFFER: {
+                AtomicABufferVariant *v = abuf_atomic_variant();
+                ok = v != nullptr;
+                if (v) {
+                    ready = programs_ready({v->depth_prg, v->color_prg,
+                                            v->resolve_prg}, wait, ok);
+                }
+                break;
+            }
+
+            case BOUNDED_ATOMIC_ABUFFER_PACKED: {
+                AtomicABufferVariant *v = abuf_atomic_variant();
+                ok = v != nullptr;
+                if (v) {
+                    ready = programs_ready({v->packed_prg,
+                                            v->packed_resolve_prg}, wait, ok);
+                }
+                break;
+            }
+
+            case HYBRID_TRANSPARENCY:
+                if (!built) {
+                    draw_hytp0_prg = object_program("draw_hytp0_frag.glsl",
+                                                    hytp_defines);
+                    draw_hytp0_prg->bind_frag("out_transp", 0);
+                    draw_hytp0_prg->bind_frag("out_vis", 1);
+                    draw_hytp1_prg = quad_program("draw_hytp1_frag.glsl",
+                                                  hytp_defines);
+                    draw_hytp2_prg = object_program("draw_hytp2_frag.glsl",
+                                                    hytp_defines);
+                }
+                ready = programs_ready({draw_hytp0_prg, draw_hytp1_prg,
+                                        draw_hytp2_prg}, wait, ok);
+                break;
+
+            case HYBRID_TRANSPARENCY_1P:
+                if (!built) {
+                    draw_hytp3_prg = object_program(pixel_sync
+                                                    ? "draw_hytp3o_frag.glsl"
+                                                    : "draw_hytp3_frag.glsl",
+                                                    hytp_defines);
+                    draw_hytp3_prg->bind_frag("out_transp", 1);
+                    draw_hytp4_prg = quad_program("draw_hytp4_frag.glsl",
+                                                  hytp_defines);
+                }
+                ready = programs_ready({draw_hytp3_prg, draw_hytp4_prg}, wait,
+                                       ok);
+                break;
+
+            case ADAPTIVE_TRANSPARENCY:
+            case ADAPTIVE_TRANSPARENCY_ATOMIC:
+            case ADAPTIVE_TRANSPARENCY_TEMPORAL: {
+                AdaptiveVariant *v = adaptive_variant();
+                ok = v != nullptr;
+                if (!v) {
+                    break;
+                }
+
+                if (m == ADAPTIVE_TRANSPARENCY) {
+                    ready = programs_ready({v->insert_prg, v->draw_prg}, wait,
+                                           ok);
+                } else if (m == ADAPTIVE_TRANSPARENCY_ATOMIC) {
+                    ready = programs_ready({v->insert_atomic_prg,
+                                            v->fixup_prg, v->draw_prg},
+                                           wait, ok);
+                } else {
+                    ready = programs_ready({v->insert_prg, v->draw_prg,
+                                            v->temporal_prg}, wait, ok);
+                }
+                break;
+            }
+
+            case STOCHASTIC_TRANSPARENCY:
+            case STOCHASTIC_TRANSPARENCY_ACCUM:
+                // Shared by both modes
+                if (!draw_stoch_prg) {
+                    draw_stoch_prg = object_program("draw_stoch_frag.glsl");
+                }
+                ready = programs_ready({draw_stoch_prg}, wait, ok);
+                break;
+
+            default:
+                // Built on startup
+                break;
+        }
+
+        if (!ok) {
+            fprintf(stderr, "%s: Failed to build the programs\n",
+                    mode_label(m).c_str());
+            failed_modes.insert(mode_label(m));
+        } else if (ready && reported_modes.insert(mode_label(m)).second) {
+            MemoryReport r = mode_memory(m);
+            if (!r.empty()) {
+                r.print(stderr, mode_label(m).c_str());
+            }
+        }
+        return ok && ready;
+    };
+
+    auto select_mode = [&](Mode m) {
+        mode = m;
+        // Modes which need the background as a texture
+        need_fbs = mode == BLEND_MESHKIN
+                || mode == SS_REFRACT || mode == SS_REFRACT_DP;
+        snprintf(window_title, sizeof(window_title), "transp - %s",
+                 mode_label(mode).c_str());
+        SDL_SetWindowTitle(wnd, window_title);
+    };
+
+    auto select_objects = [&](Objects o) {
+        objects = o;
+        cur_obj = objects == SUZANNE ? &entity_secs : &quad_secs;
+        cur_draw_mode = objects == SUZANNE ? GL_TRIANGLES: GL_TRIANGLE_STRIP;
+    };
+
+    auto quit = [&]() {
+        if (gpu_timer && trace_fname) {
+            gpu_timer->flush();
+            gpu_timer->write_trace(trace_fname);
+        }
+        if (gpu_timer && gpu_timer->dropped_frames()) {
+            fprintf(stderr, "GPU timer: Dropped %u frames whose results were "
+                            "late\n", gpu_timer->dropped_frames());
+        }
+    };
+
+    auto reset_motion = [&]() {
+        mv = mat4::identity().translated(vec3(0.f, 0.f, -5.f));
+        z_comp = z_target = z_comp_deriv = 0.f;
+        reng.seed(std::default_random_engine::default_seed);
+    };
+
+    auto step_motion = [&](float diff) {
+        if (objects == SUZANNE && !pause_motion) {
+            mv.rotate(diff, vec3(0.f, 1.f, z_comp));
+
+            if (fabsf(z_comp - z_target) < .01f) {
+                z_target = dist(reng);
+            }
+            z_comp += z_comp_deriv * diff;
+            z_comp_deriv += (z_target - z_comp) * (diff / 10.f);
+        } else if (objects != SUZANNE) {
+            mv = mat4::identity().translated(vec3(0.f, 0.f, -5.f));
+            z_comp = z_target = z_comp_deriv = 0.f;
+        }
+    };
+
+    ReferenceRenderer *reference = nullptr;
+    std::vector<uint8_t> ref_background, ref_image;
+
+    // Renders the exact result for the current frame on the CPU
+    auto render_reference = [&](uint8_t *out) {
+        if (!reference) {
+            reference = new ReferenceRenderer(WIDTH, HEIGHT);
+
+            // The background never changes, so read it once
+            ref_background.resize(WIDTH * HEIGHT * 4);
+
+            fbs[0].bind();
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            input.bind();
+            draw_tex_prg.use();
+            draw_tex_prg.uniform<texture>("fb") = input;
+            quad.draw(GL_TRIANGLE_STRIP);
+
+            glReadPixels(0, 0, WIDTH, HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE,
+                         ref_background.data());
+            framebuffer::unbind();
         }
-        entity_secs.back().rel_mv.scale(vec3(scale, scale, scale));
-
-        vec3 *col_arr = new vec3[sec.positions.size()];
-        for (size_t i = 0; i < sec.positions.size(); i++) {
-            if (entity_gradient) {
-                float green = (sec.positions[i].z() - entity.lower_left.z())
-                            / (entity.upper_right.z() - entity.lower_left.z());
-                col_arr[i] = vec3(1.f, green, 0.f);
-            } else {
-                col_arr[i] = sec.material.diffuse;
-            }
+
+        return reference->render(out, ref_background.data(), *cur_obj, mv, p,
+                                 .5f, cur_draw_mode, bfcull);
+    };
+
+    {
+        float startup_ms = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startup_tp).count() / 1000.f;
+
+        if (program_cache) {
+            unsigned loaded = program_cache->loaded();
+            unsigned built = program_cache->built();
+            fprintf(stderr, "Startup (%s): %.1f ms; program cache: %u loaded, "
+                            "%u built\n",
+                    !built ? "warm" : loaded ? "partially warm" : "cold",
+                    startup_ms, loaded, built);
+        } else {
+            fprintf(stderr, "Startup: %.1f ms; program cache disabled\n",
+                    startup_ms);
         }
-        entity_secs.back().va->attrib(2)->format(3);
-        entity_secs.back().va->attrib(2)->data(col_arr);
     }
 
-    if (two_objects) {
-        for (obj_section &sec: entity_copy.sections) {
-            // Invert triangle order
-            size_t l = sec.positions.size();
-            assert(!(l % 3) && l == sec.normals.size());
-            // Works with uneven l, too
-            for (size_t i = 0; i < l / 2; i += 3) {
-                for (std::vector<vec3> *vtx: {&sec.positions, &sec.normals}) {
-                    for (int j = 0; j < 3; j++) {
-                        vec3 v = (*vtx)[i + j];
-                        (*vtx)[i + j] = (*vtx)[l - i - 3 + j];
-                        (*vtx)[l - i - 3 + j] = v;
-                    }
-                }
-            }
+    select_mode(mode);
 
-            entity_secs.emplace_back();
-            entity_secs.back().va = sec.make_vertex_array(0, -1, 1);
-            entity_secs.back().rel_mv = mat4::identity().translated(vec3(2.f, 0.f, 0.f));
-            entity_secs.back().rel_mv.scale(vec3(scale, scale, scale));
-
-            vec3 *col_arr = new vec3[sec.positions.size()];
-            for (size_t i = 0; i < sec.positions.size(); i++) {
-                if (entity_gradient) {
-                    float green = (sec.positions[i].z() - entity.lower_left.z())
-                                / (entity.upper_right.z() - entity.lower_left.z());
-                    col_arr[i] = vec3(1.f, green, 0.f);
-                } else {
-                    col_arr[i] = sec.material.diffuse;
-                }
-            }
-            entity_secs.back().va->attrib(2)->format(3);
-            entity_secs.back().va->attrib(2)->data(col_arr);
+    fprintf(stderr, "GPU memory per mode at %ix%i (A-buffer pools at their "
+                    "current size):\n", WIDTH, HEIGHT);
+    for (int m = 0; m < MODE_MAX; m++) {
+        if (mode_available(static_cast<Mode>(m))) {
+            fprintf(stderr, "  %-72s %7.1f MB\n",
+                    mode_label(static_cast<Mode>(m)).c_str(),
+                    mode_memory(static_cast<Mode>(m)).total() / 1048576.);
         }
     }
 
-    std::vector<ObjectSection> quad_secs;
-    for (int x: {-1, 1}) {
-        if (!two_objects) {
-            if (x < 0) {
-                x = 0;
-            } else {
-                break;
-            }
-        }
-        for (int rl = 0; rl < 3; rl++) {
-            int l = x < 0 ? rl : 2 - rl;
 
-            vec3 pos[4], nrm[4], col[4];
-            for (int i = 0; i < 4; i++) {
-                pos[i] = vec3(quad_vertex_positions[i]);
-                nrm[i] = vec3(0.f, 0.f, 1.f);
-                col[i] = l == 0 ? vec3(1.f, .5f, .5f)
-                       : l == 1 ? vec3(.5f, 1.f, .5f)
-                       :          vec3(.5f, .5f, 1.f);
-            }
+    // Benchmark state: Every mode is run on every object set for
+    // bench_warmup + bench_frames frames (only the latter are measured).
+    // The motion is reset at the start of every run and advanced by a fixed
+    // time step, so all modes render the very same sequence of frames.
+    static const int bench_warmup = 16;
+    FILE *bench_fp = nullptr;
+    int bench_frame = 0;
+    std::vector<double> bench_times;
+
+    struct BenchResult {
+        Objects objects;
+        Mode mode;
+        FrameStats stats;
+        ImageError error;
+        // Only set for modes that may overflow
+        bool has_overflow;
+        FragmentPool::Stats overflow;
+    };
+    std::vector<BenchResult> bench_results;
+
+    // Mean frame times of earlier runs with the entity drawn the other way
+    // (indexed vs. unindexed) from the results file, by object set and mode
+    // label, to show what indexing gains per mode
+    std::map<std::string, double> other_means;
+
+    // Quality measurement: Up to quality_samples of the measured frames of
+    // every run are read back and compared against the exact result.  All
+    // runs on an object set render the same frames, so the references are
+    // generated only once per object set, before its first run.
+    static const int quality_samples = 16;
+    int quality_interval = std::max(1, bench_frames / quality_samples);
+    std::vector<std::vector<uint8_t>> quality_refs(std::min(quality_samples, bench_frames));
+    FrameReadback *readback = nullptr;
+    ImageError quality_error;
+
+    // Returns the reference index for the given frame of a run, or -1 if that
+    // frame is not compared
+    auto quality_sample = [&](int frame) {
+        int offset = frame - bench_warmup;
+        if (offset <= 0 || offset % quality_interval ||
+            offset / quality_interval > static_cast<int>(quality_refs.size()))
+        {
+            return -1;
+        }
+        return offset / quality_interval - 1;
+    };
 
+    auto prepare_references = [&]() {
+        fprintf(stderr, "Preparing %zu reference frames for %s...\n",
+                quality_refs.size(), objects_str[objects]);
 
-            quad_secs.emplace_back();
-            quad_secs.back().va = new vertex_array;
-            quad_secs.back().va->set_elements(4);
-            quad_secs.back().va->attrib(0)->format(3);
-            quad_secs.back().va->attrib(0)->data(pos);
-            quad_secs.back().va->attrib(1)->format(3);
-            quad_secs.back().va->attrib(1)->data(nrm);
-            quad_secs.back().va->attrib(2)->format(3);
-            quad_secs.back().va->attrib(2)->data(col);
-            quad_secs.back().rel_mv = mat4::identity().translated(vec3(x * 2.f + l * .2f, -l * .2f, l * .1f));
-        }
-    }
+        reset_motion();
 
+        int frame = 0;
+        for (size_t done = 0; done < quality_refs.size();) {
+            step_motion(1.f / 60.f);
 
-    framebuffer fbs[2] = {
-        framebuffer(1),
-        framebuffer(1)
-    };
-    framebuffer fb_bamy(2, GL_RGB16F), fb_bamc(2), fb_hytp(2);
+            int index = quality_sample(++frame);
+            if (index < 0) {
+                continue;
+            }
 
-    fb_bamc.color_format(0, GL_RGBA16F);
-    fb_bamc.color_format(1, GL_RED);
+            std::vector<uint8_t> &ref = quality_refs[index];
+            done++;
 
-    fb_hytp.color_format(0, GL_R16F);
-    fb_hytp.color_format(1, GL_R8_SNORM);
+            char fname[256];
+            if (quality_dir) {
+                snprintf(fname, sizeof(fname), "%s/ref_%s_%ix%i_%04i.png",
+                         quality_dir, objects_str[objects], WIDTH, HEIGHT,
+                         frame);
+                if (load_png(fname, ref, WIDTH, HEIGHT)) {
+                    continue;
+                }
+            }
 
-    fbs[0].resize(WIDTH, HEIGHT);
-    fbs[1].resize(WIDTH, HEIGHT);
-    fb_bamy.resize(WIDTH, HEIGHT);
-    fb_bamc.resize(WIDTH, HEIGHT);
-    fb_hytp.resize(WIDTH, HEIGHT);
+            ref.resize(WIDTH * HEIGHT * 4);
+            render_reference(ref.data());
 
-    fbs[0].depth().tmu() = 1;
-    fbs[1].depth().tmu() = 1;
-    fb_bamy[1].tmu() = 1;
-    fb_bamc[1].tmu() = 1;
-    fb_hytp[0].tmu() = 1;
+            if (quality_dir) {
+                save_png(fname, ref.data(), WIDTH, HEIGHT);
+            }
+        }
 
-    texture adtp_a, adtp_d, *adtp_l = nullptr;
-    adtp_a.format(GL_RGBA8_SNORM, WIDTH, HEIGHT);
-    adtp_d.format(GL_RGBA16_SNORM, WIDTH, HEIGHT);
-    adtp_d.tmu() = 1;
-    if (!pixel_sync) {
-        adtp_l = new texture;
-        adtp_l->format(GL_R32UI, WIDTH, HEIGHT, GL_RED_INTEGER);
-    }
+        reset_motion();
+    };
 
-    array_texture hytp, baab;
-    hytp.format(GL_R32UI, WIDTH, HEIGHT, 4, GL_RED_INTEGER);
-    baab.format(GL_RGBA8_SNORM, WIDTH, HEIGHT, 4);
-    baab.tmu() = 1;
+    auto compare_frame = [&](int index, const uint8_t *rgba) {
+        quality_error.add(rgba, quality_refs[index].data(), WIDTH * HEIGHT);
+    };
 
+    auto print_bench_results = [&]() {
+        fprintf(stderr, "\n%-7s %-58s %8s %8s %8s %8s", "objects", "mode",
+                "mean ms", "med. ms", "p95 ms", "p99 ms");
+        if (!other_means.empty()) {
+            fprintf(stderr, " %10s", indexed_mesh ? "vs. soup" : "vs. idx");
+        }
+        if (quality) {
+            fprintf(stderr, " %7s %7s %7s", "RMSE", "PSNR dB", "max err");
+        }
+        fprintf(stderr, "\n");
+
+        for (const BenchResult &r: bench_results) {
+            fprintf(stderr, "%-7s %-58s %8.3f %8.3f %8.3f %8.3f",
+                    objects_str[r.objects], mode_label(r.mode).c_str(), r.stats.mean,
+                    r.stats.median, r.stats.p95, r.stats.p99);
+            if (!other_means.empty()) {
+                auto other = other_means.find(std::string(objects_str[r.objects]) + "\n" + mode_label(r.mode));
+                if (other != other_means.end()) {
+                    fprintf(stderr, " %9.2fx", other->second / r.stats.mean);
+                } else {
+                    fprintf(stderr, " %10s", "-");
+                }
+            }
+            if (quality) {
+                fprintf(stderr, " %7.3f %7.2f %7i", r.error.rmse(),
+                        r.error.psnr(), r.error.max);
+            }
+            if (r.has_overflow && r.overflow.overflow_frames) {
+                fprintf(stderr, "  (overflowed in %" PRIu64 " frames)",
+                        r.overflow.overflow_frames);
+            }
+            fprintf(stderr, "\n");
+        }
 
-    mat4 mv = mat4::identity().translated(vec3(0.f, 0.f, -5.f));
-    float aspect = static_cast<float>(WIDTH) / HEIGHT;
-    //mat4 p = mat4::projection(M_PIf / 32.f, aspect, .1f, 10.f);
-    float lr = two_objects ? 4.f : 2.f;
-    mat4 p = mat4::orthographic(-lr, lr, lr / aspect, -lr / aspect, 0.f, 10.f);
+        if (readback && readback->dropped_frames()) {
+            fprintf(stderr, "Quality: Dropped %u frames because all read back "
+                            "buffers were in use\n", readback->dropped_frames());
+        }
+    };
 
-    std::default_random_engine reng;
-    std::uniform_real_distribution<float> dist(-.8f, .8f);
-    float z_comp = 0.f, z_target = 0.f, z_comp_deriv = 0.f;
+    static const char bench_header[] =
+        "entity,width,height,objects,mode,frames,"
+        "mean_ms,median_ms,p95_ms,p99_ms,"
+        "rmse,psnr_db,max_error,overflow_frames,"
+        "overflow_fragments,peak_fragments,indexed\n";
+
+    if (bench_fname) {
+        if (FILE *fp = fopen(bench_fname, "r")) {
+            char line[1024];
+
+            // Rows are only ever appended, so they must all follow the same
+            // layout
+            if (fgets(line, sizeof(line), fp) && strcmp(line, bench_header)) {
+                fprintf(stderr, "%s has a different column layout (written "
+                                "by an older version?); please use a new "
+                                "results file\n", bench_fname);
+                fclose(fp);
+                return 1;
+            }
 
-    std::chrono::system_clock::time_point tp = std::chrono::system_clock::now();
+            while (fgets(line, sizeof(line), fp)) {
+                // Split at commas outside of quotes
+                std::vector<std::string> fields(1);
+                bool quoted = false;
+                for (const char *c = line; *c && *c != '\n'; c++) {
+                    if (*c == '"') {
+                        quoted = !quoted;
+                    } else if (*c == ',' && !quoted) {
+                        fields.emplace_back();
+                    } else {
+                        fields.back() += *c;
+                    }
+                }
 
-    enum Mode {
-        BLEND_ALPHA,
-        BLEND_ALPHA_DP,
-        ABUFFER_LL,
-        BOUNDED_ATOMIC_ABUFFER,
-        HYBRID_TRANSPARENCY,
-        ADAPTIVE_TRANSPARENCY,
-        BLEND_MESHKIN,
-        BLEND_BAVOIL_MYER,
-        BLEND_BAVOIL_MCGUIRE,
-        BLEND_BAVOIL_MCGUIRE_WEIGHT,
-        SS_REFRACT,
-        SS_REFRACT_DP,
-        BLEND_ADD,
-        BLEND_MULT,
+                if (fields.size() == 17 && fields[0] == entity_name &&
+                    atoi(fields[1].c_str()) == WIDTH &&
+                    atoi(fields[2].c_str()) == HEIGHT &&
+                    (fields[16] == "1") != indexed_mesh)
+                {
+                    other_means[fields[3] + "\n" + fields[4]] = atof(fields[6].c_str());
+                }
+            }
+            fclose(fp);
+        }
 
-        MODE_MAX
-    } mode = BLEND_ALPHA;
+        bench_fp = fopen(bench_fname, "a");
+        if (!bench_fp) {
+            perror(bench_fname);
+            return 1;
+        }
 
-    const char *mode_str[] = {
-        "plain alpha blending",
-        "alpha blending with depth peeling",
-        "alpha blending with an A-buffer (linked list)",
-        "alpha blending with an A-buffer (atomics, bounded)",
-        "hybrid transparency",
-        "adaptive transparency",
-        "Meshkin's blending",
-        "Bavoil's and Myer's blending",
-        "Bavoil's and McGuire's blending",
-        "Bavoil's and McGuire's blending with depth weighting",
-        "screen-space refraction and absorption",
-        "screen-space refraction and absorption with depth peeling",
-        "additive blending",
-        "multiplicative blending"
-    };
+        fseek(bench_fp, 0, SEEK_END);
+        if (!ftell(bench_fp)) {
+            fputs(bench_header, bench_fp);
+        }
 
-    char window_title[128];
-    snprintf(window_title, sizeof(window_title), "transp - %s", mode_str[mode]);
-    SDL_SetWindowTitle(wnd, window_title);
+        bench_times.reserve(bench_frames);
 
-    enum Objects {
-        SUZANNE,
-        QUADS,
+        int first = 0;
+        while (!prepare_mode(static_cast<Mode>(first), true)) {
+            first++;
+        }
+        select_mode(static_cast<Mode>(first));
+        select_objects(SUZANNE);
 
-        OBJECTS_MAX
-    } objects = SUZANNE;
+        if (quality) {
+            readback = new FrameReadback(WIDTH, HEIGHT);
+            prepare_references();
+        }
 
+        reset_motion();
+    }
 
-    std::vector<ObjectSection> *cur_obj = &entity_secs;
-    GLenum cur_draw_mode = GL_TRIANGLES;
-    bool need_fbs = false;
-    bool pause_motion = false;
-    int dp_layer = -1;
 
+    std::chrono::steady_clock::time_point tp = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point summary_tp = tp, overflow_tp = tp;
 
     for (;;) {
         SDL_Event event;
         while (SDL_PollEvent(&event)) {
             if (event.type == SDL_QUIT) {
+                if (bench_fp) {
+                    print_bench_results();
+                }
+                quit();
                 return 0;
-            } else if (event.type == SDL_KEYUP) {
+            } else if (event.type == SDL_KEYUP && !bench_fp) {
                 switch (event.key.keysym.sym) {
                     case SDLK_SPACE:
+                        select_mode(static_cast<Mode>((static_cast<int>(mode) + 1) % MODE_MAX));
+                        break;
+
                     case SDLK_BACKSPACE:
-                        if (event.key.keysym.sym == SDLK_SPACE) {
-                            mode = static_cast<Mode>((static_cast<int>(mode) + 1) % MODE_MAX);
-                        } else {
-                            mode = static_cast<Mode>((static_cast<int>(mode) + MODE_MAX - 1) % MODE_MAX);
-                        }
-                        need_fbs = mode == BLEND_ALPHA_DP
-                                || mode == BLEND_MESHKIN
-                                || mode == BLEND_BAVOIL_MYER
-                                || mode == BLEND_BAVOIL_MCGUIRE
-                                || mode == BLEND_BAVOIL_MCGUIRE_WEIGHT
-                                || mode == SS_REFRACT || mode == SS_REFRACT_DP;
-                        snprintf(window_title, sizeof(window_title), "transp - %s", mode_str[mode]);
-                        SDL_SetWindowTitle(wnd, window_title);
+                        select_mode(static_cast<Mode>((static_cast<int>(mode) + MODE_MAX - 1) % MODE_MAX));
                         break;
 
                     case SDLK_RETURN:
-                        objects = static_cast<Objects>((static_cast<int>(objects) + 1) % OBJECTS_MAX);
-                        cur_obj = objects == SUZANNE ? &entity_secs : &quad_secs;
-                        cur_draw_mode = objects == SUZANNE ? GL_TRIANGLES: GL_TRIANGLE_STRIP;
+                        select_objects(static_cast<Objects>((static_cast<int>(objects) + 1) % OBJECTS_MAX));
                         break;
 
                     case SDLK_p:
@@ -1001,12 +3171,59 @@ int main(int argc, char *argv[])
                     case SDLK_l:
                         dp_layer += 1;
                         break;
+
+                    case SDLK_t:
+                        gpu_summary ^= true;
+                        if (gpu_summary && !gpu_timer) {
+                            gpu_timer = new GPUTimer(false);
+                        }
+                        if (!gpu_summary) {
+                            select_mode(mode);
+                        }
+                        break;
+
+                    case SDLK_n:
+                        adtp_nodes = adtp_nodes == 16 ? 2 : adtp_nodes * 2;
+                        select_mode(mode);
+                        break;
+
+                    case SDLK_k:
+                        baab_layers = baab_layers == 16 ? 4 : baab_layers * 2;
+                        select_mode(mode);
+                        break;
+
+                    case SDLK_m: {
+                        MemoryReport r = mode_memory(mode);
+                        if (r.empty()) {
+                            fprintf(stderr, "%s: No additional GPU memory\n",
+                                    mode_label(mode).c_str());
+                        } else {
+                            r.print(stderr, mode_label(mode).c_str());
+                        }
+                        break;
+                    }
+
+                    case SDLK_g: {
+                        ref_image.resize(WIDTH * HEIGHT * 4);
+
+                        std::chrono::steady_clock::time_point ref_tp = std::chrono::steady_clock::now();
+                        size_t frags = render_reference(ref_image.data());
+                        float ref_ms = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - ref_tp).count() / 1000.f;
+
+                        fprintf(stderr, "Reference: %zu fragments in %.1f ms\n",
+                                frags, ref_ms);
+                        if (save_png("reference.png", ref_image.data(), WIDTH, HEIGHT)) {
+                            fprintf(stderr, "Reference written to reference.png\n");
+                        }
+                        break;
+                    }
                 }
 
                 if (dp_layer >=
-                       (mode == BLEND_ALPHA_DP ? 8
-                      : mode == ABUFFER_LL     ? 32
-                      : mode == SS_REFRACT_DP  ? 4
+                       (mode == BLEND_ALPHA_DP  ? max_layers
+                      : mode == BLEND_ALPHA_DDP ? 2 * dual_passes
+                      : mode == ABUFFER_LL      ? abuf_fragments
+                      : mode == SS_REFRACT_DP   ? dual_passes
                       : 0))
                 {
                     dp_layer = -1;
@@ -1014,23 +3231,104 @@ int main(int argc, char *argv[])
             }
         }
 
-        std::chrono::system_clock::time_point ntp = std::chrono::system_clock::now();
+        std::chrono::steady_clock::time_point ntp = std::chrono::steady_clock::now();
         float diff = std::chrono::duration_cast<std::chrono::microseconds>(ntp - tp).count() / 1000000.f;
         tp = ntp;
 
-        if (objects == SUZANNE && !pause_motion) {
-            mv.rotate(diff, vec3(0.f, 1.f, z_comp));
+        if (bench_fp) {
+            if (bench_frame++ > bench_warmup) {
+                // Frame time of the previous frame
+                bench_times.push_back(diff * 1000.);
+            }
 
-            if (fabsf(z_comp - z_target) < .01f) {
-                z_target = dist(reng);
+            if (static_cast<int>(bench_times.size()) >= bench_frames) {
+                FrameStats stats = frame_stats(bench_times);
+
+                fprintf(bench_fp, "\"%s\",%i,%i,%s,\"%s\",%i,%.4f,%.4f,%.4f,%.4f",
+                        entity_name, WIDTH, HEIGHT, objects_str[objects],
+                        mode_label(mode).c_str(), bench_frames, stats.mean,
+                        stats.median, stats.p95, stats.p99);
+
+                if (readback) {
+                    readback->collect(compare_frame, true);
+
+                    fprintf(bench_fp, ",%.4f,%.4f,%i", quality_error.rmse(),
+                            quality_error.psnr(), quality_error.max);
+                } else {
+                    fprintf(bench_fp, ",,,");
+                }
+
+                FragmentPool *pool = mode_pool(mode);
+                bool has_overflow = pool != nullptr;
+                FragmentPool::Stats overflow = {0, 0, 0, 0};
+                if (has_overflow) {
+                    pool->flush();
+                    overflow = pool->stats();
+                    pool->reset_stats();
+
+                    fprintf(bench_fp, ",%" PRIu64 ",%" PRIu64 ",%zu",
+                            overflow.overflow_frames,
+                            overflow.overflow_fragments, overflow.peak);
+                } else {
+                    fprintf(bench_fp, ",,,");
+                }
+                fprintf(bench_fp, ",%i\n", indexed_mesh);
+                fflush(bench_fp);
+
+                bench_results.push_back(BenchResult{objects, mode, stats,
+                                                    quality_error, has_overflow,
+                                                    overflow});
+                quality_error = ImageError();
+
+                int next = mode;
+                do {
+                    next++;
+                } while (next < MODE_MAX &&
+                         !prepare_mode(static_cast<Mode>(next), true));
+
+                if (next >= MODE_MAX) {
+                    if (objects + 1 >= OBJECTS_MAX) {
+                        fclose(bench_fp);
+                        print_bench_results();
+                        quit();
+                        return 0;
+                    }
+
+                    next = 0;
+                    while (!prepare_mode(static_cast<Mode>(next), true)) {
+                        next++;
+                    }
+                    select_objects(static_cast<Objects>(objects + 1));
+
+                    if (readback) {
+                        prepare_references();
+                    }
+                }
+
+                select_mode(static_cast<Mode>(next));
+                reset_motion();
+
+                // The frame rendered in this iteration is the first one of
+                // the new run
+                bench_frame = 1;
+                bench_times.clear();
             }
-            z_comp += z_comp_deriv * diff;
-            z_comp_deriv += (z_target - z_comp) * (diff / 10.f);
-        } else if (objects != SUZANNE) {
-            mv = mat4::identity().translated(vec3(0.f, 0.f, -5.f));
-            z_comp = z_target = z_comp_deriv = 0.f;
+
+            diff = 1.f / 60.f;
+        }
+
+        step_motion(diff);
+
+        // Until the mode's programs are ready
+        Mode render_mode = prepare_mode(mode, false) ? mode : BLEND_ALPHA;
+
+        if (gpu_timer) {
+            // Attribute the frame to what is actually drawn
+            gpu_timer->begin_frame(mode_str[render_mode]);
         }
 
+        GPUScope bg_pass("background");
+
         if (need_fbs) {
             fbs[0].bind();
         } else {
@@ -1052,13 +3350,9 @@ int main(int argc, char *argv[])
 
         glDepthMask(true);
 
-        if (need_fbs) {
-            fbs[1].bind();
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            fbs[0].blit();
-        }
+        bg_pass.next("transparency");
 
-        switch (mode) {
+        switch (render_mode) {
             case BLEND_ALPHA:
                 glEnable(GL_BLEND);
                 // Premultiplied source (the shaders do that premultiplication)
@@ -1069,66 +3363,139 @@ int main(int argc, char *argv[])
                 break;
 
             case BLEND_ALPHA_DP:
-                blend_alpha_dp(fbs, mv, p, draw_dp_prg, dp_layer,
+                blend_alpha_dp(fb_dp, mv, p, draw_dp_prg, draw_blend_prg,
+                               peel_query, max_layers, dp_layer,
                                dp_layer >= 0 ? 1.f : .5f, *cur_obj,
-                               cur_draw_mode);
+                               cur_draw_mode, quad);
+                break;
+
+            case BLEND_ALPHA_DDP:
+                blend_alpha_ddp(fb_ddp, fb_ddp_front, mv, p, draw_ddp0_prg,
+                                draw_ddp1_prg, draw_blend_prg,
+                                peel_query, dual_passes, dp_layer,
+                                dp_layer >= 0 ? 1.f : .5f, *cur_obj,
+                                cur_draw_mode, quad);
                 break;
 
             case ABUFFER_LL:
                 if (draw_abuf0_prg && draw_abuf1_prg && draw_abuf1l_prg) {
-                    abuffer_ll(mv, p, *draw_abuf0_prg,
+                    abuffer_ll(fb_bamc, mv, p, *draw_abuf0_prg,
                                dp_layer >= 0 ? *draw_abuf1l_prg
                                              : *draw_abuf1_prg,
-                               abuf_ll_head, abuf_list_data, dp_layer,
+                               abuf_resolve, draw_abuf2_prg, abuf_ll_head,
+                               abuf_resolved, *abuf_pool, dp_layer,
                                dp_layer >= 0 ? 1.f : .5f, *cur_obj,
                                cur_draw_mode, quad);
                 }
                 break;
 
+            case ABUFFER_PS:
+                if (draw_abps0_prg && draw_abps1_prg && draw_abps2_prg) {
+                    abuffer_ps(fb_bamc, mv, p, *draw_abps0_prg,
+                               *draw_abps1_prg, *draw_abps2_prg, *abps_scan,
+                               abps_counts, abps_offsets, *abps_pool, .5f,
+                               *cur_obj, cur_draw_mode, quad);
+                }
+                break;
+
             case BOUNDED_ATOMIC_ABUFFER:
-                if (draw_baab0_prg && draw_baab1_prg) {
-                    abuf_atomic(fb_bamc, hytp, baab, mv, p, *draw_baab0_prg,
-                                *draw_baab1_prg, draw_baab2_prg, .5f, *cur_obj,
-                                cur_draw_mode, quad);
+                if (mode_available(mode)) {
+                    abuf_atomic(fb_bamc, *abuf_atomic_variant(), mv, p, .5f,
+                                *cur_obj, cur_draw_mode, quad);
+                }
+                break;
+
+            case BOUNDED_ATOMIC_ABUFFER_PACKED:
+                if (mode_available(mode)) {
+                    abuf_atomic_packed(fb_bamc, *abuf_atomic_variant(), mv, p,
+                                       .5f, *cur_obj, cur_draw_mode, quad);
                 }
                 break;
 
             case HYBRID_TRANSPARENCY:
                 if (draw_hytp0_prg && draw_hytp1_prg) {
                     hybrid_transp(fb_hytp, hytp, mv, p, *draw_hytp0_prg,
-                                  *draw_hytp1_prg, draw_hytp2_prg, .5f,
+                                  *draw_hytp1_prg, *draw_hytp2_prg, .5f,
                                   *cur_obj, cur_draw_mode, quad);
                 }
                 break;
 
+            case HYBRID_TRANSPARENCY_1P:
+                if (draw_hytp3_prg && draw_hytp4_prg) {
+                    hybrid_transp_1p(fb_bamc, hytp, hytp_col, adtp_l, mv, p,
+                                     *draw_hytp3_prg, *draw_hytp4_prg, .5f,
+                                     *cur_obj, cur_draw_mode, quad);
+                }
+                break;
+
             case ADAPTIVE_TRANSPARENCY:
-                if (draw_adtp0_prg) {
-                    adaptive_transp(adtp_a, adtp_d, adtp_l, mv, p,
-                                    *draw_adtp0_prg, draw_adtp1_prg, .5f,
+                if (mode_available(mode)) {
+                    adaptive_transp(*adaptive_variant(), adtp_l, mv, p, .5f,
                                     *cur_obj, cur_draw_mode);
                 }
                 break;
 
+            case ADAPTIVE_TRANSPARENCY_ATOMIC:
+                if (mode_available(mode)) {
+                    adaptive_transp_atomic(*adaptive_variant(), mv, p, .5f,
+                                           *cur_obj, cur_draw_mode, quad);
+                }
+                break;
+
+            case ADAPTIVE_TRANSPARENCY_TEMPORAL:
+                if (mode_available(mode)) {
+                    temporal_adaptive_transp(*adaptive_variant(), adtp_l,
+                                             fb_bamc, mv, p, draw_bamc1_prg,
+                                             .5f, *cur_obj, cur_draw_mode,
+                                             quad);
+                }
+                break;
+
             case BLEND_MESHKIN:
                 blend_meshkin(fbs, mv, p, draw_meshk_prg, .5f, *cur_obj,
                               cur_draw_mode);
                 break;
 
             case BLEND_BAVOIL_MYER:
-                blend_bamy(fbs[0], fb_bamy, mv, p, draw_bamy0_prg,
+                blend_bamy(fb_bamy, mv, p, draw_bamy0_prg,
                            draw_bamy1_prg, .5f, *cur_obj, cur_draw_mode, quad);
                 break;
 
             case BLEND_BAVOIL_MCGUIRE:
-                blend_bamc(fbs[0], fb_bamc, mv, p, draw_bamc0_prg,
+                blend_bamc(fb_bamc, mv, p, draw_bamc0_prg,
                            draw_bamc1_prg, .5f, *cur_obj, cur_draw_mode, quad);
                 break;
 
             case BLEND_BAVOIL_MCGUIRE_WEIGHT:
-                blend_bamc(fbs[0], fb_bamc, mv, p, draw_bamc0w_prg,
+                blend_bamc(fb_bamc, mv, p, draw_bamc0w_prg,
                            draw_bamc1_prg, .5f, *cur_obj, cur_draw_mode, quad);
                 break;
 
+            case BLEND_MBOIT4:
+                blend_mboit(fb_mboit4, fb_mboit_accum, 4, mv, p,
+                            draw_mboit0_prg, draw_mboit1_prg, draw_mboit2_prg,
+                            .5f, *cur_obj, cur_draw_mode, quad);
+                break;
+
+            case BLEND_MBOIT8:
+                blend_mboit(fb_mboit8, fb_mboit_accum, 8, mv, p,
+                            draw_mboit0x_prg, draw_mboit1x_prg,
+                            draw_mboit2_prg, .5f, *cur_obj, cur_draw_mode,
+                            quad);
+                break;
+
+            case STOCHASTIC_TRANSPARENCY:
+            case STOCHASTIC_TRANSPARENCY_ACCUM:
+                if (draw_stoch_prg) {
+                    stochastic_transp(*stoch_fb, fb_bamc,
+                                      mode == STOCHASTIC_TRANSPARENCY_ACCUM,
+                                      mv, p, *draw_stoch_prg, draw_simple_prg,
+                                      draw_bamc0_prg, draw_blend_prg,
+                                      draw_bamc1_prg, .5f, *cur_obj,
+                                      cur_draw_mode, quad);
+                }
+                break;
+
             case SS_REFRACT:
                 ss_refract(fbs, mv, p, draw_bf_prg, draw_ff_prg, *cur_obj,
                            cur_draw_mode);
@@ -1136,7 +3503,8 @@ int main(int argc, char *argv[])
 
             case SS_REFRACT_DP:
                 ss_refract_dp(fbs, mv, p, draw_bfdp_prg, draw_ffdp_prg,
-                              dp_layer, *cur_obj, cur_draw_mode);
+                              draw_carry_prg, peel_query, dual_passes,
+                              dp_layer, *cur_obj, cur_draw_mode, quad);
                 break;
 
             case BLEND_ADD:
@@ -1161,7 +3529,57 @@ int main(int argc, char *argv[])
                 abort();
         }
 
+        if (readback) {
+            int index = quality_sample(bench_frame);
+            if (index >= 0) {
+                bg_pass.next("readback");
+
+                framebuffer::unbind();
+                glReadBuffer(GL_BACK);
+                readback->request(index);
+            }
+        }
+
+        if (gpu_timer) {
+            gpu_timer->end_frame();
+
+            if (gpu_summary && ntp - summary_tp > std::chrono::milliseconds(500)) {
+                char summary[192];
+                gpu_timer->summary(summary, sizeof(summary));
+                snprintf(window_title, sizeof(window_title), "transp - %s [ms: %s]",
+                         mode_label(mode).c_str(), summary);
+                SDL_SetWindowTitle(wnd, window_title);
+                summary_tp = ntp;
+            }
+        }
+
+        FragmentPool *pool = mode_pool(mode);
+        if (pool && !bench_fp && ntp - overflow_tp > std::chrono::seconds(1)) {
+            const FragmentPool::Stats &ps = pool->stats();
+            if (ps.overflow_frames) {
+                fprintf(stderr, "A-buffer: %" PRIu64 " of %" PRIu64 " frames "
+                                "overflowed, %" PRIu64 " fragments went into "
+                                "the tail (pool: %zu nodes, %zu MB)\n",
+                        ps.overflow_frames, ps.frames, ps.overflow_fragments,
+                        pool->capacity(), pool->size_bytes() >> 20);
+            }
+            pool->reset_stats();
+            overflow_tp = ntp;
+        }
+
         SDL_GL_SwapWindow(wnd);
+
+        if (bench_fp) {
+            // Make the frame time include all of the GPU work for this frame
+            glFinish();
+        }
+
+        if (readback) {
+            // Keep the comparison out of the measured frame times
+            std::chrono::steady_clock::time_point rb_tp = std::chrono::steady_clock::now();
+            readback->collect(compare_frame, false);
+            tp += std::chrono::steady_clock::now() - rb_tp;
+        }
     }
 
 
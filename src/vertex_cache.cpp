@@ -0,0 +1,259 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <dake/math.hpp>
+
+#include "vertex_cache.hpp"
+
+
+using namespace dake::math;
+
+
+// Scoring parameters from Forsyth's article
+static const float CACHE_DECAY_POWER = 1.5f;
+static const float LAST_TRI_SCORE = .75f;
+static const float VALENCE_BOOST_SCALE = 2.f;
+static const float VALENCE_BOOST_POWER = .5f;
+
+
+static inline uint32_t hash_bits(const vec3 &v, uint32_t h)
+{
+    uint32_t bits[3];
+    memcpy(bits, &v, sizeof(bits));
+    for (uint32_t b: bits) {
+        h = (h ^ b) * 16777619u;
+    }
+    return h;
+}
+
+
+void weld_vertices(const vec3 *positions, const vec3 *normals,
+                   const vec3 *colors, size_t count,
+                   std::vector<uint32_t> *indices,
+                   std::vector<uint32_t> *unique)
+{
+    auto same = [&](uint32_t a, uint32_t b) {
+        return !memcmp(&positions[a], &positions[b], sizeof(vec3)) &&
+               !memcmp(&normals[a], &normals[b], sizeof(vec3)) &&
+               !memcmp(&colors[a], &colors[b], sizeof(vec3));
+    };
+
+    // Open addressing, at most half full; entries are indices into unique
+    size_t table_size = 1;
+    while (table_size < count * 2) {
+        table_size *= 2;
+    }
+    std::vector<uint32_t> table(table_size, UINT32_MAX);
+
+    indices->resize(count);
+    unique->clear();
+
+    for (size_t i = 0; i < count; i++) {
+        uint32_t h = 2166136261u;
+        h = hash_bits(positions[i], h);
+        h = hash_bits(normals[i], h);
+        h = hash_bits(colors[i], h);
+
+        size_t slot = h & (table_size - 1);
+        while (table[slot] != UINT32_MAX &&
+               !same((*unique)[table[slot]], i))
+        {
+            slot = (slot + 1) & (table_size - 1);
+        }
+
+        if (table[slot] == UINT32_MAX) {
+            table[slot] = unique->size();
+            unique->push_back(i);
+        }
+        (*indices)[i] = table[slot];
+    }
+}
+
+
+static float vertex_score(int cache_pos, uint32_t remaining)
+{
+    if (!remaining) {
+        // No triangles left to draw with this vertex
+        return -1.f;
+    }
+
+    float score = 0.f;
+    if (cache_pos >= 0) {
+        if (cache_pos < 3) {
+            // Used by the last triangle; fixed score so it does not matter
+            // in which order its vertices were submitted
+            score = LAST_TRI_SCORE;
+        } else {
+            score = powf(1.f - (cache_pos - 3) / float(VERTEX_CACHE_SIZE - 3),
+                         CACHE_DECAY_POWER);
+        }
+    }
+
+    // Favor vertices with few triangles left, so they do not end up as lone
+    // triangles which have to be drawn much later
+    return score + VALENCE_BOOST_SCALE * powf(remaining, -VALENCE_BOOST_POWER);
+}
+
+
+void optimize_vertex_cache(uint32_t *indices, size_t index_count,
+                           size_t vertex_count)
+{
+    size_t tri_count = index_count / 3;
+    if (!tri_count) {
+        return;
+    }
+
+    // Triangles that still have to be drawn, per vertex
+    std::vector<uint32_t> remaining(vertex_count), offsets(vertex_count + 1);
+    std::vector<uint32_t> tri_lists(tri_count * 3);
+    for (size_t i = 0; i < tri_count * 3; i++) {
+        remaining[indices[i]]++;
+    }
+    for (size_t v = 0; v < vertex_count; v++) {
+        offsets[v + 1] = offsets[v] + remaining[v];
+    }
+    {
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < tri_count * 3; i++) {
+            tri_lists[fill[indices[i]]++] = i / 3;
+        }
+    }
+
+    std::vector<int> cache_pos(vertex_count, -1);
+    std::vector<float> score(vertex_count);
+    for (size_t v = 0; v < vertex_count; v++) {
+        score[v] = vertex_score(-1, remaining[v]);
+    }
+
+    auto tri_score = [&](size_t t) {
+        return score[indices[t * 3 + 0]] + score[indices[t * 3 + 1]]
+             + score[indices[t * 3 + 2]];
+    };
+
+    std::vector<char> emitted(tri_count, false);
+    std::vector<uint32_t> out;
+    out.reserve(tri_count * 3);
+
+    uint32_t cache[VERTEX_CACHE_SIZE + 3];
+    int cache_used = 0;
+
+    size_t best = 0, cursor = 0;
+    for (size_t t = 1; t < tri_count; t++) {
+        if (tri_score(t) > tri_score(best)) {
+            best = t;
+        }
+    }
+
+    for (size_t n = 0; n < tri_count; n++) {
+        if (best == SIZE_MAX) {
+            // Nothing in the cache has any triangles left; just continue
+            // with the next triangle in the original order
+            while (emitted[cursor]) {
+                cursor++;
+            }
+            best = cursor;
+        }
+
+        emitted[best] = true;
+        const uint32_t *tri = &indices[best * 3];
+        out.insert(out.end(), tri, tri + 3);
+
+        for (int k = 0; k < 3; k++) {
+            uint32_t *list = &tri_lists[offsets[tri[k]]];
+            uint32_t *end = list + remaining[tri[k]];
+            uint32_t *it = std::find(list, end, static_cast<uint32_t>(best));
+            if (it != end) {
+                *it = end[-1];
+                remaining[tri[k]]--;
+            }
+        }
+
+        // The triangle's vertices go to the front of the cache, everything
+        // else moves back (and possibly out)
+        uint32_t new_cache[VERTEX_CACHE_SIZE + 3];
+        int new_used = 0;
+        for (int k = 0; k < 3; k++) {
+            if (std::find(new_cache, new_cache + new_used, tri[k]) ==
+                new_cache + new_used)
+            {
+                new_cache[new_used++] = tri[k];
+            }
+        }
+        for (int i = 0; i < cache_used; i++) {
+            if (std::find(tri, tri + 3, cache[i]) == tri + 3) {
+                new_cache[new_used++] = cache[i];
+            }
+        }
+
+        for (int i = 0; i < new_used; i++) {
+            uint32_t v = new_cache[i];
+            cache_pos[v] = i < VERTEX_CACHE_SIZE ? i : -1;
+            score[v] = vertex_score(cache_pos[v], remaining[v]);
+        }
+
+        cache_used = std::min(new_used, VERTEX_CACHE_SIZE);
+        for (int i = 0; i < cache_used; i++) {
+            cache[i] = new_cache[i];
+        }
+
+        // Only triangles using a cached vertex changed their score, so the
+        // best one is among those (if any of them are left)
+        best = SIZE_MAX;
+        float best_score = -HUGE_VALF;
+        for (int i = 0; i < cache_used; i++) {
+            uint32_t v = cache[i];
+            for (uint32_t j = 0; j < remaining[v]; j++) {
+                uint32_t t = tri_lists[offsets[v] + j];
+                float s = tri_score(t);
+                if (s > best_score) {
+                    best = t;
+                    best_score = s;
+                }
+            }
+        }
+    }
+
+    std::copy(out.begin(), out.end(), indices);
+}
+
+
+void order_vertices(uint32_t *indices, size_t index_count, size_t vertex_count,
+                    std::vector<uint32_t> *order)
+{
+    std::vector<uint32_t> remap(vertex_count, UINT32_MAX);
+
+    order->clear();
+    for (size_t i = 0; i < index_count; i++) {
+        uint32_t &r = remap[indices[i]];
+        if (r == UINT32_MAX) {
+            r = order->size();
+            order->push_back(indices[i]);
+        }
+        indices[i] = r;
+    }
+}
+
+
+float acmr(const uint32_t *indices, size_t index_count, size_t vertex_count,
+           int cache_size)
+{
+    if (index_count < 3) {
+        return 0.f;
+    }
+
+    // A vertex is in the FIFO if fewer than @cache_size misses happened
+    // after its own
+    std::vector<int64_t> inserted(vertex_count, INT64_MIN / 2);
+    int64_t misses = 0;
+    for (size_t i = 0; i < index_count; i++) {
+        if (misses - inserted[indices[i]] >= cache_size) {
+            inserted[indices[i]] = misses++;
+        }
+    }
+
+    return float(misses) / (index_count / 3);
+}
@@ -0,0 +1,45 @@
+#ifndef VERTEX_CACHE_HPP
+#define VERTEX_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <dake/math.hpp>
+
+
+// FIFO size assumed for the post-transform vertex cache (for both
+// optimizing and measuring; typical hardware has somewhere between 16 and 32
+// entries, or behaves like it)
+static const int VERTEX_CACHE_SIZE = 32;
+
+
+// Merges the vertices of a triangle soup (@count vertices) whose attributes
+// are bitwise identical.  @indices receives one index per soup vertex into
+// the list of unique vertices, @unique the soup index of every unique
+// vertex's first occurrence.
+void weld_vertices(const dake::math::vec3 *positions,
+                   const dake::math::vec3 *normals,
+                   const dake::math::vec3 *colors, size_t count,
+                   std::vector<uint32_t> *indices,
+                   std::vector<uint32_t> *unique);
+
+// Reorders the triangles of an indexed triangle list for the post-transform
+// vertex cache (Tom Forsyth, "Linear-Speed Vertex Cache Optimisation").
+// Overdraw is not taken into account: Every transparency mode shades all
+// fragments, whatever the order.
+void optimize_vertex_cache(uint32_t *indices, size_t index_count,
+                           size_t vertex_count);
+
+// Renumbers the vertices in the order in which the triangles first use them
+// (so vertex fetches become mostly sequential).  @order receives the old
+// index of every new vertex.
+void order_vertices(uint32_t *indices, size_t index_count, size_t vertex_count,
+                    std::vector<uint32_t> *order);
+
+// Average cache miss ratio (transformed vertices per triangle) of a FIFO
+// cache with @cache_size entries; 3 for a triangle soup, 0.5 at best
+float acmr(const uint32_t *indices, size_t index_count, size_t vertex_count,
+           int cache_size = VERTEX_CACHE_SIZE);
+
+#endif